@@ -0,0 +1,137 @@
+#ifndef VULKANTEST_ASSETCACHE_H
+#define VULKANTEST_ASSETCACHE_H
+
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+
+namespace jk {
+
+    // 以键值去重的资源缓存 键由路径(或文件内容的哈希)与加载参数组成
+    // 返回的句柄共享同一份资源 引用计数即句柄的use_count
+    // 最后一个句柄释放时移除缓存项并调用release 通常交给DeletionQueue延迟销毁
+    // 资源管理器持有的强引用不计入 句柄需要在VulkanApp销毁之前释放
+    template<typename T>
+    class AssetCache {
+    private:
+        using Entries = std::unordered_map<std::string, std::weak_ptr<T>>;
+
+        // 缓存本身可能先于句柄销毁 删除器只持有缓存项的弱引用
+        std::shared_ptr<Entries> entries = std::make_shared<Entries>();
+        std::function<void(std::shared_ptr<T>&)> release;
+
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+
+        static void append(std::ostringstream& out) {}
+
+        template<typename Arg, typename... Args>
+        static void append(std::ostringstream& out, const Arg& arg, const Args&... args) {
+            out << '|' << arg;
+            append(out, args...);
+        }
+    public:
+        AssetCache(std::function<void(std::shared_ptr<T>&)> release) : release(std::move(release)) {}
+
+        AssetCache(const AssetCache&) = delete;
+        AssetCache& operator=(const AssetCache&) = delete;
+
+        // 浮点参数按十六进制输出 取值不同的参数不会得到相同的键
+        template<typename... Args>
+        static std::string makeKey(const std::string& kind, const Args&... args) {
+            std::ostringstream out;
+            out << std::hexfloat << kind;
+            append(out, args...);
+            return out.str();
+        }
+
+        // 文件内容的FNV-1a哈希 不同路径下的相同文件共用一份资源 需要完整读取一遍文件
+        static bool hashFile(const std::string& path, uint64_t& hash) {
+            std::ifstream file(path, std::ios::binary);
+            if (!file.is_open()) {
+                return false;
+            }
+            hash = 1469598103934665603ull;
+            char buffer[1 << 16];
+            while (file) {
+                file.read(buffer, sizeof(buffer));
+                std::streamsize count = file.gcount();
+                for (std::streamsize i = 0; i < count; i++) {
+                    hash ^= static_cast<unsigned char>(buffer[i]);
+                    hash *= 1099511628211ull;
+                }
+            }
+            return true;
+        }
+
+        // 路径键 hashContent为true时改用内容哈希 文件无法打开时退回路径
+        static std::string pathKey(const std::string& kind, const std::string& path, bool hashContent) {
+            uint64_t hash;
+            if (hashContent && hashFile(path, hash)) {
+                std::ostringstream out;
+                out << kind << "#" << std::hex << std::setw(16) << std::setfill('0') << hash;
+                return out.str();
+            }
+            return kind + ":" + path;
+        }
+
+        // 命中时返回已有的句柄 否则调用create创建 create返回空时不缓存
+        template<typename Create>
+        std::shared_ptr<T> acquire(const std::string& key, Create&& create) {
+            auto it = entries->find(key);
+            if (it != entries->end()) {
+                if (auto handle = it->second.lock()) {
+                    hits++;
+                    return handle;
+                }
+            }
+            misses++;
+            std::shared_ptr<T> resource = create();
+            if (resource == nullptr) {
+                return nullptr;
+            }
+
+            std::weak_ptr<Entries> weakEntries = entries;
+            auto onRelease = release;
+            // 句柄与resource指向同一对象 删除器持有真正的所有权
+            std::shared_ptr<T> handle(resource.get(), [weakEntries, key, resource, onRelease](T*) mutable {
+                if (auto owner = weakEntries.lock()) {
+                    auto found = owner->find(key);
+                    if (found != owner->end() && found->second.expired()) {
+                        owner->erase(found);
+                    }
+                }
+                onRelease(resource);
+                resource.reset();
+            });
+            (*entries)[key] = handle;
+            return handle;
+        }
+
+        // 不增加引用 没有活跃句柄时返回空
+        std::shared_ptr<T> find(const std::string& key) const {
+            auto it = entries->find(key);
+            return it == entries->end() ? nullptr : it->second.lock();
+        }
+
+        inline size_t size() const {
+            return entries->size();
+        }
+
+        inline uint64_t getHits() const {
+            return hits;
+        }
+
+        inline uint64_t getMisses() const {
+            return misses;
+        }
+    };
+
+}
+
+#endif //VULKANTEST_ASSETCACHE_H
@@ -5,8 +5,11 @@
 #include "Buffer.h"
 #include "Descriptor.h"
 #include "VulkanApp.h"
+#include "MeshOptimizer.h"
 
 #include <glm/gtx/transform.hpp>
+#include <algorithm>
+#include <iostream>
 
 namespace jk {
 
@@ -68,9 +71,11 @@ namespace jk {
         };
 
         auto cube = createModelBuffer();
+        MeshOptimizer::optimize(cubeVertices, indices);
         cube->setIndexed(true);
-        cube->loadVertices(app, cubeVertices);
-        cube->loadIndices(app, indices);
+        loadVerticesOntoBuffer(cube, cubeVertices);
+        loadIndicesOntoBuffer(cube, indices);
+        cube->setBounds(MeshSimplifier::computeBounds(cubeVertices));
         return cube;
     }
 
@@ -102,12 +107,28 @@ namespace jk {
         };
 
         auto cube = createModelBuffer();
+        MeshOptimizer::optimize(cubeVertices, indices);
         cube->setIndexed(true);
-        cube->loadVertices(app, cubeVertices);
-        cube->loadIndices(app, indices);
+        loadVerticesOntoBuffer(cube, cubeVertices);
+        loadIndicesOntoBuffer(cube, indices);
+        cube->setBounds(MeshSimplifier::computeBounds(cubeVertices));
         return cube;
     }
 
+    std::shared_ptr<ModelBuffer> GeneralBufferManager::acquireCube(float size) {
+        return acquireModel(AssetCache<ModelBuffer>::makeKey("cube", size), [&]() { return genCube(size); });
+    }
+
+    std::shared_ptr<ModelBuffer> GeneralBufferManager::acquireDoublePlane(float size) {
+        return acquireModel(AssetCache<ModelBuffer>::makeKey("doublePlane", size), [&]() { return genDoublePlane(size); });
+    }
+
+    std::shared_ptr<ModelBuffer> GeneralBufferManager::acquireSphere(float radius, uint32_t rings, uint32_t sectors) {
+        return acquireModel(AssetCache<ModelBuffer>::makeKey("sphere", radius, rings, sectors), [&]() {
+            return genSphere(radius, rings, sectors);
+        });
+    }
+
     std::shared_ptr<jk::ModelBuffer> GeneralBufferManager::genSphere(float radius, uint32_t rings, uint32_t sectors) {
         std::vector<Vertex> sphereVertices;
 
@@ -150,92 +171,226 @@ namespace jk {
         
 
         auto sphere = createModelBuffer();
+        MeshOptimizer::optimize(sphereVertices, indices);
+        std::vector<Meshlet> meshlets;
+        MeshletBuilder::build(sphereVertices, indices, meshlets);
+        // 远处的星球不需要完整的经纬细分
+        std::vector<MeshLod> lods;
+        MeshSimplifier::buildLodChain(sphereVertices, indices, lods);
         sphere->setIndexed(true);
-        sphere->loadVertices(app, sphereVertices);
-        sphere->loadIndices(app, indices);
+        loadVerticesOntoBuffer(sphere, sphereVertices);
+        loadIndicesOntoBuffer(sphere, indices);
+        sphere->setLods(std::move(lods));
+        sphere->setMeshlets(std::move(meshlets));
+        sphere->setBounds(MeshSimplifier::computeBounds(sphereVertices));
         return sphere;
     }
 
 
-    void ModelBuffer::createVertexBuffer(VulkanApp* app, std::vector<Vertex> &vertices) {
-        VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
-
-        VkBuffer stagingBuffer;
-        VkDeviceMemory stagingBufferMemory;
-        app->createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer,
-                    stagingBufferMemory);
-
-        void *data;
-        auto device = app->getDevice();
-        vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-        memcpy(data, vertices.data(), (size_t) bufferSize);
-        vkUnmapMemory(device, stagingBufferMemory);
-
-        app->createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory);
+    void ModelBuffer::createDeviceBuffer(VulkanApp* app, const void* data, VkDeviceSize bufferSize, VkBufferUsageFlags usage,
+                                         VkBuffer& buffer, MemoryAllocation& bufferMemory) {
+        if (app->getMemoryAllocator()->isUnifiedMemory()) {
+            // 提交之前的主机写入对之后的命令可见 不需要屏障
+            app->createBuffer(bufferSize, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                              buffer, bufferMemory);
+            memcpy(bufferMemory.mapped, data, bufferSize);
+            bufferMemory.owner->flush(bufferMemory, 0, bufferSize);
+            uploadPath = UploadPath::Direct;
+            return;
+        }
 
-        app->copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
+        app->createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage,
+                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, bufferMemory);
+        uploadPath = UploadPath::Staging;
 
-        vkDestroyBuffer(device, stagingBuffer, nullptr);
-        vkFreeMemory(device, stagingBufferMemory, nullptr);
+        app->getStagingRing()->uploadBuffers({{data, bufferSize, buffer, 0}});
+        app->getUploadBatch()->transferBuffer(buffer);
     }
 
     void ModelBuffer::cleanup(VkDevice& device) {
-        vkDestroyBuffer(device, vertexBuffer, nullptr);
-        vkFreeMemory(device, vertexBufferMemory, nullptr);
+        if (arena != nullptr) {
+            // 只归还区间 共享缓冲由arena自己释放
+            arena->freeVertices(firstVertex, vertexCount);
+            arena->freeIndices(indexType, firstIndex, indexCount);
+            arena = nullptr;
+            return;
+        }
+        vkDestroyBuffer(device, positionBuffer, nullptr);
+        freeMemory(positionBufferMemory);
+        vkDestroyBuffer(device, attributeBuffer, nullptr);
+        freeMemory(attributeBufferMemory);
+        // 共享的常量颜色由GeneralBufferManager释放
+        if (colorBufferMemory.memory != VK_NULL_HANDLE) {
+            vkDestroyBuffer(device, colorBuffer, nullptr);
+            freeMemory(colorBufferMemory);
+        }
         cleanEndFunc(device);
     }
 
     void ModelBuffer::cleanIndexBuffer(VkDevice& device) {
         vkDestroyBuffer(device, indexBuffer, nullptr);
-        vkFreeMemory(device, indexBufferMemory, nullptr);
+        freeMemory(indexBufferMemory);
     }
 
     void ModelBuffer::loadVertices(VulkanApp* app, std::vector<Vertex> &vertices) {
-        vertexCount = static_cast<uint32_t>(vertices.size());
-        createVertexBuffer(app, vertices);
+        loadVertices(app, vertices.data(), static_cast<uint32_t>(vertices.size()));
     }
 
-    VkBuffer ModelBuffer::getVertexBuffer() {
-        return vertexBuffer;
+    void ModelBuffer::loadVertices(VulkanApp* app, const void* vertices, uint32_t vertexCount) {
+        VertexStreams streams;
+        VertexPacker::split(static_cast<const Vertex*>(vertices), vertexCount, VertexFormat::Full, false, streams);
+        loadVertexStreams(app, streams, VertexFormat::Full, vertexCount);
     }
 
-    uint32_t ModelBuffer::getVertexCount() const {
-        return vertexCount;
+    void ModelBuffer::loadVertexStreams(VulkanApp* app, const VertexStreamData& streams, VertexFormat format, uint32_t vertexCount) {
+        this->vertexCount = vertexCount;
+        vertexFormat = format;
+        dequantize = streams.dequantize;
+        createDeviceBuffer(app, streams.positions, streams.positionBytes, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                           positionBuffer, positionBufferMemory);
+        createDeviceBuffer(app, streams.attributes, streams.attributeBytes, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                           attributeBuffer, attributeBufferMemory);
+        if (streams.colorCount > 0) {
+            loadColors(app, streams.colors, streams.colorCount);
+        }
     }
 
-    void ModelBuffer::createIndexBuffer(VulkanApp* app, std::vector<uint32_t> &indices) {
-        VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
+    void ModelBuffer::loadVertexStreams(std::shared_ptr<GeometryArena> arena, const VertexStreamData& streams, uint32_t vertexCount) {
+        this->arena = std::move(arena);
+        this->vertexCount = vertexCount;
+        vertexFormat = this->arena->getVertexFormat();
+        dequantize = streams.dequantize;
+        uploadPath = this->arena->isHostVisible() ? UploadPath::Direct : UploadPath::Staging;
+        firstVertex = this->arena->allocateVertices(vertexCount);
+        this->arena->uploadVertices(firstVertex, streams);
+    }
+
+    void ModelBuffer::loadColors(VulkanApp* app, const VertexColor* colors, size_t colorCount) {
+        createDeviceBuffer(app, colors, sizeof(VertexColor) * colorCount, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                           colorBuffer, colorBufferMemory);
+    }
+
+    void ModelBuffer::allocateVertexStreams(VulkanApp* app, VertexFormat format, uint32_t vertexCount, bool colorStream,
+                                            const glm::mat4& dequantize) {
+        this->vertexCount = vertexCount;
+        vertexFormat = format;
+        this->dequantize = dequantize;
+        VkBufferUsageFlags usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+        VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        uploadPath = UploadPath::Staging;
+        if (app->getMemoryAllocator()->isUnifiedMemory()) {
+            properties |= VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+            uploadPath = UploadPath::Direct;
+        }
+        app->createBuffer(static_cast<VkDeviceSize>(VertexPacker::positionStride(format)) * vertexCount, usage,
+                          properties, positionBuffer, positionBufferMemory);
+        app->createBuffer(static_cast<VkDeviceSize>(VertexPacker::attributeStride(format)) * vertexCount, usage,
+                          properties, attributeBuffer, attributeBufferMemory);
+        if (colorStream) {
+            app->createBuffer(static_cast<VkDeviceSize>(sizeof(VertexColor)) * vertexCount, usage,
+                              properties, colorBuffer, colorBufferMemory);
+        }
+    }
 
-        VkBuffer stagingBuffer;
-        VkDeviceMemory stagingBufferMemory;
-        app->createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer,
-                    stagingBufferMemory);
+    VertexStreamUploader::VertexStreamUploader(VulkanApp* app, std::shared_ptr<ModelBuffer> model, VertexFormat format,
+                                               bool colorStream, const glm::vec3& minPos, const glm::vec3& maxPos,
+                                               uint32_t chunkVertices)
+            : app(app), model(std::move(model)), format(format), colorStream(colorStream), minPos(minPos), maxPos(maxPos),
+              chunkVertices(std::max(chunkVertices, 3u)) {
+    }
 
-        void *data;
-        auto device = app->getDevice();
-        vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-        memcpy(data, indices.data(), (size_t) bufferSize);
-        vkUnmapMemory(device, stagingBufferMemory);
+    void VertexStreamUploader::append(const Vertex* vertices, uint32_t count) {
+        if (count == 0) {
+            return;
+        }
+        if (count > chunkVertices || written + count > model->getVertexCount()) {
+            throw std::runtime_error("streamed vertices exceed the allocated buffer!");
+        }
+        VertexPacker::split(vertices, count, format, colorStream, minPos, maxPos, streams);
+
+        std::vector<StagingRing::BufferCopy> copies = {
+            {streams.positions.data(), streams.positions.size(), model->positionBuffer,
+             static_cast<VkDeviceSize>(VertexPacker::positionStride(format)) * written},
+            {streams.attributes.data(), streams.attributes.size(), model->attributeBuffer,
+             static_cast<VkDeviceSize>(VertexPacker::attributeStride(format)) * written},
+        };
+        if (colorStream) {
+            copies.push_back({streams.colors.data(), sizeof(VertexColor) * streams.colors.size(), model->colorBuffer,
+                              sizeof(VertexColor) * written});
+        }
+        written += count;
+
+        if (model->uploadPath == UploadPath::Direct) {
+            MemoryAllocation* memories[] = {&model->positionBufferMemory, &model->attributeBufferMemory, &model->colorBufferMemory};
+            for (size_t i = 0; i < copies.size(); i++) {
+                memcpy(static_cast<uint8_t*>(memories[i]->mapped) + copies[i].dstOffset, copies[i].data, copies[i].size);
+                memories[i]->owner->flush(*memories[i], copies[i].dstOffset, copies[i].size);
+            }
+            return;
+        }
+        app->getStagingRing()->uploadBuffers(copies);
+
+        // 全部写完后才交给图形队列 之前的分块都在传输队列上写入
+        if (finished()) {
+            UploadBatch* batch = app->getUploadBatch();
+            batch->transferBuffer(model->positionBuffer);
+            batch->transferBuffer(model->attributeBuffer);
+            if (colorStream) {
+                batch->transferBuffer(model->colorBuffer);
+            }
+        }
+    }
 
-        app->createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexBufferMemory);
+    VkBuffer ModelBuffer::getPositionBuffer() {
+        return arena != nullptr ? arena->getPositionBuffer() : positionBuffer;
+    }
 
-        app->copyBuffer(stagingBuffer, indexBuffer, bufferSize);
+    VkBuffer ModelBuffer::getAttributeBuffer() {
+        return arena != nullptr ? arena->getAttributeBuffer() : attributeBuffer;
+    }
 
-        vkDestroyBuffer(device, stagingBuffer, nullptr);
-        vkFreeMemory(device, stagingBufferMemory, nullptr);
+    // 没有颜色流的arena仍然使用共享的常量颜色
+    VkBuffer ModelBuffer::getColorBuffer() {
+        return arena != nullptr && arena->hasColorStream() ? arena->getColorBuffer() : colorBuffer;
+    }
+
+    uint32_t ModelBuffer::getVertexCount() const {
+        return vertexCount;
+    }
+
+    void ModelBuffer::createIndexBuffer(VulkanApp* app, const void* indices, VkDeviceSize bufferSize) {
+        createDeviceBuffer(app, indices, bufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, indexBuffer, indexBufferMemory);
     }
 
     VkBuffer ModelBuffer::getIndexBuffer() {
-        return indexBuffer;
+        return arena != nullptr ? arena->getIndexBuffer(indexType) : indexBuffer;
     }
 
     void ModelBuffer::loadIndices(VulkanApp* app, std::vector<uint32_t> &indices) {
-        indexCount = static_cast<uint32_t>(indices.size());
-        createIndexBuffer(app, indices);
+        loadIndices(app, indices.data(), static_cast<uint32_t>(indices.size()), VK_INDEX_TYPE_UINT32);
+    }
+
+    // 顶点数不足65536时使用16位索引 索引缓冲减半
+    void ModelBuffer::loadIndices(VulkanApp* app, std::vector<uint16_t> &indices) {
+        loadIndices(app, indices.data(), static_cast<uint32_t>(indices.size()), VK_INDEX_TYPE_UINT16);
+    }
+
+    void ModelBuffer::loadIndices(VulkanApp* app, const void* indices, uint32_t indexCount, VkIndexType indexType) {
+        this->indexCount = indexCount;
+        this->indexType = indexType;
+        VkDeviceSize indexSize = indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+        createIndexBuffer(app, indices, indexSize * indexCount);
+    }
+
+    void ModelBuffer::loadIndices(const void* indices, uint32_t indexCount, VkIndexType indexType) {
+        this->indexCount = indexCount;
+        this->indexType = indexType;
+        firstIndex = arena->allocateIndices(indexType, indexCount);
+        arena->uploadIndices(indexType, firstIndex, indices, indexCount);
+    }
+
+    VkIndexType ModelBuffer::getIndexType() const {
+        return indexType;
     }
 
     uint32_t ModelBuffer::getIndexCount() const {
@@ -245,7 +400,7 @@ namespace jk {
     void UniformBuffer::cleanup(VkDevice &device) {
         for (size_t i = 0; i < VulkanApp::MAX_FRAMES_IN_FLIGHT; i++) {
             vkDestroyBuffer(device, uniformBuffers[i], nullptr);
-            vkFreeMemory(device, uniformBuffersMemory[i], nullptr);
+            freeMemory(uniformBuffersMemory[i]);
         }
     }
 
@@ -258,14 +413,22 @@ namespace jk {
         uniformBuffersMapped.resize(VulkanApp::MAX_FRAMES_IN_FLIGHT);
         uniformBufferInfo.resize(VulkanApp::MAX_FRAMES_IN_FLIGHT);
 
-        auto device = app->getDevice();
+        shadow.assign(bufferSize, 0);
+        dirtyRanges.assign(VulkanApp::MAX_FRAMES_IN_FLIGHT, DirtyRange{});
 
+        // 不要求coherent 写入后由update负责flush 统一内存时放在device local内存中
+        deviceLocal = app->getMemoryAllocator()->isUnifiedMemory();
+        VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+        if (deviceLocal) {
+            properties |= VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        }
         for (size_t i = 0; i < VulkanApp::MAX_FRAMES_IN_FLIGHT; i++) {
-            app->createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            app->createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, properties,
                         uniformBuffers[i], uniformBuffersMemory[i]);
+            memset(uniformBuffersMemory[i].mapped, 0, bufferSize);
+            uniformBuffersMemory[i].owner->flush(uniformBuffersMemory[i], 0, bufferSize);
 
-            vkMapMemory(device, uniformBuffersMemory[i], 0, bufferSize, 0, &uniformBuffersMapped[i]);
+            uniformBuffersMapped[i] = uniformBuffersMemory[i].mapped;
 
             // 创建描述符
             uniformBufferInfo[i].buffer = uniformBuffers[i];
@@ -274,8 +437,36 @@ namespace jk {
         }
     }
 
+    void UniformBuffer::write(VkDeviceSize offset, const void* data, VkDeviceSize size) {
+        assert(offset + size <= bufferSize);
+        if (size == 0 || memcmp(shadow.data() + offset, data, size) == 0) {
+            return;
+        }
+        memcpy(shadow.data() + offset, data, size);
+        for (auto& range : dirtyRanges) {
+            if (range.begin == range.end) {
+                range = {offset, offset + size};
+            } else {
+                range.begin = std::min(range.begin, offset);
+                range.end = std::max(range.end, offset + size);
+            }
+        }
+    }
+
+    void UniformBuffer::update(uint32_t currentFrame) {
+        DirtyRange& range = dirtyRanges[currentFrame];
+        if (range.begin == range.end) {
+            return;
+        }
+        VkDeviceSize size = range.end - range.begin;
+        memcpy(static_cast<uint8_t*>(uniformBuffersMapped[currentFrame]) + range.begin, shadow.data() + range.begin, size);
+        uniformBuffersMemory[currentFrame].owner->flush(uniformBuffersMemory[currentFrame], range.begin, size);
+        range = DirtyRange{};
+    }
+
     void UniformBuffer::updateUniformBuffer(uint32_t currentImage, void* ubo) {
-        memcpy(uniformBuffersMapped[currentImage], ubo, bufferSize);
+        write(0, ubo, bufferSize);
+        update(currentImage);
     }
 
     std::vector<VkBuffer> &UniformBuffer::getUniformBuffers() {
@@ -286,15 +477,145 @@ namespace jk {
         return uniformBufferInfo;
     }
 
+    ObjectBuffer::ObjectBuffer(VulkanApp* app, VkDeviceSize stride, uint32_t capacity) : app(app), stride(stride) {
+        buffers.resize(VulkanApp::MAX_FRAMES_IN_FLIGHT, VK_NULL_HANDLE);
+        buffersMemory.resize(VulkanApp::MAX_FRAMES_IN_FLIGHT);
+        bufferInfo.resize(VulkanApp::MAX_FRAMES_IN_FLIGHT);
+        capacities.resize(VulkanApp::MAX_FRAMES_IN_FLIGHT, 0);
+        for (uint32_t i = 0; i < VulkanApp::MAX_FRAMES_IN_FLIGHT; i++) {
+            createBuffer(i, std::max(capacity, 1u));
+        }
+    }
+
+    void ObjectBuffer::createBuffer(uint32_t frame, uint32_t capacity) {
+        app->createBuffer(stride * capacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                          buffers[frame], buffersMemory[frame]);
+        capacities[frame] = capacity;
+        bufferInfo[frame].buffer = buffers[frame];
+        bufferInfo[frame].offset = 0;
+        bufferInfo[frame].range = stride * capacity;
+    }
+
+    void ObjectBuffer::destroyBuffer(uint32_t frame) {
+        if (buffers[frame] != VK_NULL_HANDLE) {
+            vkDestroyBuffer(app->getDevice(), buffers[frame], nullptr);
+            buffers[frame] = VK_NULL_HANDLE;
+        }
+        freeMemory(buffersMemory[frame]);
+    }
+
+    void ObjectBuffer::writeDescriptor(uint32_t frame) {
+        if (descriptorSets == nullptr) {
+            return;
+        }
+        descriptorSets->writer.writeBuffer(binding, &bufferInfo[frame], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+                .overwrite(static_cast<int>(frame)).flush();
+    }
+
+    void ObjectBuffer::cleanup(VkDevice& device) {
+        for (uint32_t i = 0; i < VulkanApp::MAX_FRAMES_IN_FLIGHT; i++) {
+            destroyBuffer(i);
+        }
+    }
+
+    void ObjectBuffer::begin(FrameInfo& frame, uint32_t expected) {
+        // 上一次写满或者预计放不下 该槽位的上一帧已经执行完毕 可以直接替换缓冲
+        required = std::max(required, expected);
+        if (required > capacities[frame.currentFrame]) {
+            uint32_t capacity = std::max(required, capacities[frame.currentFrame] * 2);
+            destroyBuffer(frame.currentFrame);
+            createBuffer(frame.currentFrame, capacity);
+            writeDescriptor(frame.currentFrame);
+        }
+        currentFrame = frame.currentFrame;
+        count = 0;
+        required = 0;
+        frame.objectBuffer = this;
+    }
+
+    bool ObjectBuffer::reserve(uint32_t n) {
+        if (count + n > capacities[currentFrame]) {
+            required = std::max(required, count + n);
+            if (!overflowReported) {
+                std::cerr << "[ObjectBuffer] " << capacities[currentFrame] << " records are not enough, "
+                          << "objects are skipped until the buffer grows at the next begin" << std::endl;
+                overflowReported = true;
+            }
+            return false;
+        }
+        return true;
+    }
+
+    void ObjectBuffer::pushIndex(VkCommandBuffer& commandBuffer, Shader& shader, uint32_t index) {
+        vkCmdPushConstants(commandBuffer, shader.getPipelineLayout(),
+                           VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+                           0, sizeof(uint32_t), &index);
+    }
+
+    FrameAllocator::FrameAllocator(VulkanApp* app, VkDeviceSize blockRange, VkDeviceSize capacity) : app(app), blockRange(blockRange) {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(app->getPhysicalDevice(), &properties);
+        if (blockRange == 0 || blockRange > properties.limits.maxUniformBufferRange) {
+            throw std::runtime_error("frame allocator block range exceeds maxUniformBufferRange!");
+        }
+        alignment = std::max<VkDeviceSize>(properties.limits.minUniformBufferOffsetAlignment, 1);
+        this->capacity = (std::max(capacity, blockRange) + alignment - 1) / alignment * alignment;
+
+        // 末尾多留一个blockRange 最后一个槽位末端的分配加上range也不会越界
+        VkDeviceSize size = this->capacity * VulkanApp::MAX_FRAMES_IN_FLIGHT + blockRange;
+        app->createBuffer(size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, buffer, memory);
+        bufferInfo.buffer = buffer;
+        bufferInfo.offset = 0;
+        bufferInfo.range = blockRange;
+    }
+
+    void FrameAllocator::cleanup(VkDevice& device) {
+        if (buffer != VK_NULL_HANDLE) {
+            vkDestroyBuffer(device, buffer, nullptr);
+            buffer = VK_NULL_HANDLE;
+        }
+        freeMemory(memory);
+    }
+
+    void FrameAllocator::begin(FrameInfo& frame) {
+        currentFrame = frame.currentFrame;
+        head = 0;
+        frame.frameAllocator = this;
+    }
+
+    void FrameAllocator::flush() {
+        memory.owner->flush(memory, capacity * currentFrame, head);
+    }
+
+    FrameAllocator::Allocation FrameAllocator::allocate(VkDeviceSize size) {
+        // 超过描述符的range时着色器读不到完整的数据
+        if (size > blockRange) {
+            throw std::runtime_error("frame allocator allocation exceeds the block range!");
+        }
+        VkDeviceSize offset = (head + alignment - 1) / alignment * alignment;
+        if (offset + size > capacity) {
+            throw std::runtime_error("frame allocator is out of space!");
+        }
+        head = offset + size;
+        VkDeviceSize base = capacity * currentFrame + offset;
+        return {static_cast<uint8_t*>(memory.mapped) + base, static_cast<uint32_t>(base)};
+    }
+
+    void FrameAllocator::bind(VkCommandBuffer& commandBuffer, Shader& shader, uint32_t set, uint32_t offset) {
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shader.getPipelineLayout(), set, 1,
+                                &descriptorSets->getDescriptorSets()[currentFrame], 1, &offset);
+    }
+
     void ModelBuffer::setIndexed(bool indexed) {
         isIndexed = indexed;
         if (indexed) {
-            bindFunc = std::bind(&ModelBuffer::indexedBind, this, std::placeholders::_1);
-            drawFunc = std::bind(&ModelBuffer::indexedDraw, this, std::placeholders::_1);
+            bindFunc = std::bind(&ModelBuffer::indexedBind, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3);
+            drawFunc = std::bind(&ModelBuffer::indexedDraw, this, std::placeholders::_1, std::placeholders::_2);
             cleanEndFunc = std::bind(&ModelBuffer::cleanIndexBuffer, this, std::placeholders::_1);
         } else {
-            bindFunc = std::bind(&ModelBuffer::defaultBind, this, std::placeholders::_1);
-            drawFunc = std::bind(&ModelBuffer::defaultDraw, this, std::placeholders::_1);
+            bindFunc = std::bind(&ModelBuffer::defaultBind, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3);
+            drawFunc = std::bind(&ModelBuffer::defaultDraw, this, std::placeholders::_1, std::placeholders::_2);
             cleanEndFunc = [](VkDevice& device) {};
         }
     }
@@ -303,41 +624,85 @@ namespace jk {
         return isIndexed;
     }
 
-    void ModelBuffer::defaultBind(VkCommandBuffer& commandBuffer) {
-        VkDeviceSize offsets[] = {0};
-        vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, offsets);
+    void ModelBuffer::bindVertexStreams(VkCommandBuffer& commandBuffer, bool positionsOnly, GeometryBinding* binding) {
+        VkBuffer positions = getPositionBuffer();
+        // 已经绑定了全部流时深度pass也可以直接使用
+        if (binding != nullptr && binding->positionBuffer == positions && (positionsOnly || !binding->positionsOnly)) {
+            return;
+        }
+        VkBuffer buffers[] = {positions, getAttributeBuffer(), getColorBuffer()};
+        VkDeviceSize offsets[] = {0, 0, 0};
+        uint32_t count = positionsOnly ? 1 : (vertexFormat == VertexFormat::Full ? 2 : 3);
+        vkCmdBindVertexBuffers(commandBuffer, VERTEX_POSITION_BINDING, count, buffers, offsets);
+        if (binding != nullptr) {
+            binding->positionBuffer = positions;
+            binding->positionsOnly = positionsOnly;
+        }
+    }
+
+    void ModelBuffer::defaultBind(VkCommandBuffer& commandBuffer, bool positionsOnly, GeometryBinding* binding) {
+        bindVertexStreams(commandBuffer, positionsOnly, binding);
     }
 
-    void ModelBuffer::defaultDraw(VkCommandBuffer& commandBuffer) {
-        vkCmdDraw(commandBuffer, vertexCount, 1, 0, 0);
+    // 不使用arena时firstVertex与firstIndex都是0
+    void ModelBuffer::defaultDraw(VkCommandBuffer& commandBuffer, uint32_t lod) {
+        vkCmdDraw(commandBuffer, vertexCount, 1, firstVertex, 0);
+    }
+
+    void ModelBuffer::indexedBind(VkCommandBuffer& commandBuffer, bool positionsOnly, GeometryBinding* binding) {
+        bindVertexStreams(commandBuffer, positionsOnly, binding);
+        VkBuffer indices = getIndexBuffer();
+        if (binding != nullptr && binding->indexBuffer == indices && binding->indexType == indexType) {
+            return;
+        }
+        vkCmdBindIndexBuffer(commandBuffer, indices, 0, indexType);
+        if (binding != nullptr) {
+            binding->indexBuffer = indices;
+            binding->indexType = indexType;
+        }
     }
 
-    void ModelBuffer::indexedBind(VkCommandBuffer& commandBuffer) {
-        VkDeviceSize offsets[] = {0};
-        vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, offsets);
-        vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+    void ModelBuffer::indexedDraw(VkCommandBuffer& commandBuffer, uint32_t lod) {
+        auto vertexOffset = static_cast<int32_t>(firstVertex);
+        if (lods.empty()) {
+            vkCmdDrawIndexed(commandBuffer, indexCount, 1, firstIndex, vertexOffset, 0);
+            return;
+        }
+        const MeshLod& range = lods[std::min(lod, static_cast<uint32_t>(lods.size() - 1))];
+        vkCmdDrawIndexed(commandBuffer, range.indexCount, 1, firstIndex + range.firstIndex, vertexOffset, 0);
     }
 
-    void ModelBuffer::indexedDraw(VkCommandBuffer& commandBuffer) {
-        vkCmdDrawIndexed(commandBuffer, indexCount, 1, 0, 0, 0);
+    void ModelBuffer::drawRanges(VkCommandBuffer& commandBuffer, const std::vector<IndexRange>& ranges) {
+        auto vertexOffset = static_cast<int32_t>(firstVertex);
+        for (const auto& range : ranges) {
+            vkCmdDrawIndexed(commandBuffer, range.indexCount, 1, firstIndex + range.firstIndex, vertexOffset, 0);
+        }
     }
 
-    void ModelBuffer::bind(VkCommandBuffer& commandBuffer) {
-        bindFunc(commandBuffer);
+    void ModelBuffer::bind(VkCommandBuffer& commandBuffer, bool positionsOnly, GeometryBinding* binding) {
+        if (binding != nullptr && binding->model == this && binding->positionBuffer == getPositionBuffer() &&
+            (positionsOnly || !binding->positionsOnly)) {
+            return;
+        }
+        bindFunc(commandBuffer, positionsOnly, binding);
+        if (binding != nullptr) {
+            binding->model = this;
+        }
     }
 
-    void ModelBuffer::draw(VkCommandBuffer& commandBuffer) {
-        drawFunc(commandBuffer);
+    void ModelBuffer::draw(VkCommandBuffer& commandBuffer, uint32_t lod) {
+        drawFunc(commandBuffer, lod);
     }
 
     ModelBuffer::ModelBuffer() {
-        bindFunc = std::bind(&ModelBuffer::defaultBind, this, std::placeholders::_1);
-        drawFunc = std::bind(&ModelBuffer::defaultDraw, this, std::placeholders::_1);
+        bindFunc = std::bind(&ModelBuffer::defaultBind, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3);
+        drawFunc = std::bind(&ModelBuffer::defaultDraw, this, std::placeholders::_1, std::placeholders::_2);
         // 空操作
         cleanEndFunc = [](VkDevice& device) {};
     }
 
-    GeneralBufferManager::GeneralBufferManager(VulkanApp *app, ResourceHelper& resourceHelper) : ResourceUser(app, resourceHelper) {
+    GeneralBufferManager::GeneralBufferManager(VulkanApp *app, ResourceHelper& resourceHelper) : ResourceUser(app, resourceHelper),
+        modelCache([this](std::shared_ptr<ModelBuffer>& model) { destroyModelBuffer(model->getID()); }) {
         device = app->getDevice();
     }
 
@@ -348,12 +713,34 @@ namespace jk {
         return uniformBuffer;
     }
 
+    std::shared_ptr<ObjectBuffer> GeneralBufferManager::createObjectBuffer(VkDeviceSize stride, uint32_t capacity) {
+        auto objectBuffer = std::make_shared<ObjectBuffer>(app, stride, capacity);
+        resourceHelper.createResource(std::static_pointer_cast<IResource>(objectBuffer));
+        return objectBuffer;
+    }
+
+    std::shared_ptr<MaterialLibrary> GeneralBufferManager::createMaterialLibrary(uint32_t capacity) {
+        auto materialLibrary = std::make_shared<MaterialLibrary>(app, capacity);
+        resourceHelper.createResource(std::static_pointer_cast<IResource>(materialLibrary));
+        return materialLibrary;
+    }
+
+    std::shared_ptr<FrameAllocator> GeneralBufferManager::createFrameAllocator(VkDeviceSize blockRange, VkDeviceSize capacity) {
+        auto frameAllocator = std::make_shared<FrameAllocator>(app, blockRange, capacity);
+        resourceHelper.createResource(std::static_pointer_cast<IResource>(frameAllocator));
+        return frameAllocator;
+    }
+
     std::shared_ptr<ModelBuffer> GeneralBufferManager::createModelBuffer() {
         auto modelBuffer = std::make_shared<ModelBuffer>();
         resourceHelper.createResource(std::static_pointer_cast<IResource>(modelBuffer));
         return modelBuffer;
     }
 
+    std::vector<MemoryHeapStats> GeneralBufferManager::getMemoryStats() const {
+        return app->getMemoryAllocator()->getHeapStats();
+    }
+
     std::shared_ptr<UniformBuffer> GeneralBufferManager::getUniformBuffer(uint32_t resID) {
         return std::static_pointer_cast<UniformBuffer>(resourceHelper.getResource(resID));
     }
@@ -362,6 +749,98 @@ namespace jk {
         return std::static_pointer_cast<ModelBuffer>(resourceHelper.getResource(resID));
     }
 
+    void GeneralBufferManager::destroyUniformBuffer(uint32_t resID) {
+        app->getDeletionQueue()->push(resourceHelper.detachResource(resID));
+    }
+
+    void GeneralBufferManager::destroyModelBuffer(uint32_t resID) {
+        app->getDeletionQueue()->push(resourceHelper.detachResource(resID));
+    }
+
+    VkBuffer GeneralBufferManager::getConstantColorBuffer() {
+        if (constantColor == nullptr) {
+            VertexColor white = {{255, 255, 255, 255}};
+            constantColor = createModelBuffer();
+            constantColor->loadColors(app, &white, 1);
+        }
+        return constantColor->colorBuffer;
+    }
+
+    std::shared_ptr<GeometryArena> GeneralBufferManager::getGeometryArena(VertexFormat format, bool colorStream) {
+        // Full格式没有颜色流
+        bool colors = colorStream && format != VertexFormat::Full;
+        uint32_t key = static_cast<uint32_t>(format) * 2 + (colors ? 1 : 0);
+        auto& arena = arenas[key];
+        if (arena == nullptr) {
+            arena = std::make_shared<GeometryArena>(app, format, colors);
+            resourceHelper.createResource(std::static_pointer_cast<IResource>(arena));
+        }
+        return arena;
+    }
+
+    void GeneralBufferManager::loadVerticesOntoBuffer(std::shared_ptr<ModelBuffer>& buf, const void* vertices, uint32_t vertexCount) {
+        VertexStreams streams;
+        VertexPacker::split(static_cast<const Vertex*>(vertices), vertexCount, vertexFormat, colorStream, streams);
+        loadVertexStreamsOntoBuffer(buf, streams, vertexFormat, colorStream, vertexCount);
+    }
+
+    void GeneralBufferManager::loadVertexStreamsOntoBuffer(std::shared_ptr<ModelBuffer>& buf, const VertexStreamData& streams,
+                                                           VertexFormat format, bool colorStream, uint32_t vertexCount) {
+        if (useGeometryArena) {
+            buf->loadVertexStreams(getGeometryArena(format, colorStream), streams, vertexCount);
+        } else {
+            buf->loadVertexStreams(app, streams, format, vertexCount);
+        }
+        if (format != VertexFormat::Full && !colorStream) {
+            buf->colorBuffer = getConstantColorBuffer();
+        }
+    }
+
+    std::unique_ptr<VertexStreamUploader> GeneralBufferManager::streamVerticesOntoBuffer(std::shared_ptr<ModelBuffer>& buf, uint32_t vertexCount,
+                                                                                        const glm::vec3& minPos, const glm::vec3& maxPos,
+                                                                                        uint32_t chunkVertices) {
+        // Full格式没有颜色流
+        bool colors = colorStream && vertexFormat != VertexFormat::Full;
+        VertexStreams streams;
+        VertexPacker::split(nullptr, 0, vertexFormat, colors, minPos, maxPos, streams);
+        buf->allocateVertexStreams(app, vertexFormat, vertexCount, colors, streams.dequantize);
+        if (vertexFormat != VertexFormat::Full && !colorStream) {
+            buf->colorBuffer = getConstantColorBuffer();
+        }
+        return std::make_unique<VertexStreamUploader>(app, buf, vertexFormat, colors, minPos, maxPos, chunkVertices);
+    }
+
+    void GeneralBufferManager::loadIndicesOntoBuffer(std::shared_ptr<ModelBuffer>& buf, std::vector<uint32_t>& indices) {
+        if (buf->getVertexCount() < 65536) {
+            std::vector<uint16_t> shortIndices(indices.begin(), indices.end());
+            loadIndicesOntoBuffer(buf, shortIndices);
+        } else {
+            loadIndicesOntoBuffer(buf, indices.data(), static_cast<uint32_t>(indices.size()), VK_INDEX_TYPE_UINT32);
+        }
+    }
+
+    UploadTicket GeneralBufferManager::submitUploads(bool deferred) {
+        return app->getUploadBatch()->submit(deferred);
+    }
+
+    bool GeneralBufferManager::isUploadReady(UploadTicket ticket) {
+        return app->getUploadBatch()->isReady(ticket);
+    }
+
+    void GeneralBufferManager::processPendingUploads() {
+        if (pendingUploads.empty()) {
+            return;
+        }
+        // 上传回调中可能注册新的任务 先换出当前列表
+        std::vector<std::function<bool()>> polling;
+        polling.swap(pendingUploads);
+        for (auto& poll : polling) {
+            if (!poll()) {
+                pendingUploads.push_back(std::move(poll));
+            }
+        }
+    }
+
     void GeneralBufferManager::cleanup() {
         // resourceHelper.cleanup(device);
     }
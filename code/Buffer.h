@@ -7,29 +7,86 @@
 
 #include <vulkan/vulkan.h>
 #include <vector>
+#include <map>
 #include <functional>
+#include <algorithm>
+#include <future>
+#include <chrono>
+#include <iostream>
+#include <cassert>
+#include <cstring>
+#include <type_traits>
 #include "Vertex.h"
+#include "MeshSimplifier.h"
+#include "Meshlet.h"
+#include "Submesh.h"
+#include "VertexFormat.h"
 #include "ResourceHelper.hpp"
 #include "Descriptor.h"
+#include "MemoryAllocator.h"
+#include "GeometryArena.h"
+#include "UploadBatch.h"
+#include "MaterialLibrary.h"
+#include "AssetCache.h"
 
 namespace jk {
 
     class VulkanApp;
 
+    // 缓冲内容的写入方式 Direct为直接写入映射的device local内存 不经过暂存拷贝与传输队列
+    enum class UploadPath {
+        Staging,
+        Direct
+    };
+
+    // 主机端保留一份副本 write只把与副本不同的字段标记为脏
+    // 每个帧槽位各自记录落后的区间 一次修改在之后的各帧中分别写入对应的缓冲
+    // 没有修改时update直接返回 静态场景每帧不做任何拷贝
     class UniformBuffer : public IResource{
     private:
+        // 待写入的区间[begin, end) begin == end表示没有
+        struct DirtyRange {
+            VkDeviceSize begin = 0;
+            VkDeviceSize end = 0;
+        };
+
         std::vector<VkBuffer> uniformBuffers;
-        std::vector<VkDeviceMemory> uniformBuffersMemory;
+        std::vector<MemoryAllocation> uniformBuffersMemory;
         std::vector<void*> uniformBuffersMapped;
 
         VkDeviceSize bufferSize;
 
         std::vector<VkDescriptorBufferInfo> uniformBufferInfo;
 
+        std::vector<uint8_t> shadow;
+        std::vector<DirtyRange> dirtyRanges;
+        // 统一内存时位于device local内存
+        bool deviceLocal = false;
+
         void createUniformBuffers(VulkanApp *app, VkDeviceSize bufferSize);
     public:
         virtual void cleanup(VkDevice& device);
 
+        // 写入[offset, offset + size) 内容与上一次相同时什么都不做
+        void write(VkDeviceSize offset, const void* data, VkDeviceSize size);
+
+        template<typename T>
+        inline void write(VkDeviceSize offset, const T& value) {
+            write(offset, &value, sizeof(T));
+        }
+
+        // 在录制使用它的命令之前调用 把当前帧槽位落后的区间写入缓冲 非coherent内存按区间flush
+        void update(uint32_t currentFrame);
+
+        inline bool isDeviceLocal() const {
+            return deviceLocal;
+        }
+
+        inline bool isDirty(uint32_t currentFrame) const {
+            return dirtyRanges[currentFrame].begin != dirtyRanges[currentFrame].end;
+        }
+
+        // 整块写入 相当于write(0, ubo, bufferSize)之后update
         void updateUniformBuffer(uint32_t currentImage, void* ubo);
 
         std::vector<VkBuffer>& getUniformBuffers();
@@ -45,31 +102,222 @@ namespace jk {
         friend class GeneralBufferManager;
     };
 
+    struct FrameInfo;
+
+    // 每帧所有物体的数据写入同一个storage buffer 绘制时只推送32位下标
+    // 需要读取storage buffer的着色器 renderFrame开始时调用begin启用 否则物体仍推送完整的数据
+    // 每个帧槽位独立 上一帧写满时在该槽位下一次begin时扩容
+    class ObjectBuffer : public IResource {
+    private:
+        VulkanApp* app;
+        VkDeviceSize stride;
+
+        std::vector<VkBuffer> buffers;
+        std::vector<MemoryAllocation> buffersMemory;
+        std::vector<VkDescriptorBufferInfo> bufferInfo;
+        std::vector<uint32_t> capacities;
+
+        // 扩容后重写这些描述符集
+        std::shared_ptr<DescriptorSets> descriptorSets;
+        uint32_t binding = 0;
+
+        uint32_t currentFrame = 0;
+        uint32_t count = 0;
+        // 本帧实际需要的记录数 超过容量时下一次begin扩容
+        uint32_t required = 0;
+        // 写满时只提示一次
+        bool overflowReported = false;
+
+        void createBuffer(uint32_t frame, uint32_t capacity);
+        void destroyBuffer(uint32_t frame);
+        void writeDescriptor(uint32_t frame);
+    public:
+        ObjectBuffer(VulkanApp* app, VkDeviceSize stride, uint32_t capacity);
+
+        virtual void cleanup(VkDevice& device);
+
+        // 在绑定描述符集之前调用 expected为本帧预计的记录数 容量不足时在这里扩容
+        void begin(FrameInfo& frame, uint32_t expected = 0);
+
+        // 还能写入n条记录 不够时记下需要的数量 这一帧里放不下的物体不绘制 下一次begin扩容
+        bool reserve(uint32_t n);
+
+        // 调用前需要reserve 返回记录的下标
+        template<typename T>
+        uint32_t write(const T& data) {
+            static_assert(std::is_trivially_copyable<T>::value, "object data must be trivially copyable");
+            assert(sizeof(T) == stride && count < capacities[currentFrame]);
+            memcpy(static_cast<uint8_t*>(buffersMemory[currentFrame].mapped) + stride * count, &data, sizeof(T));
+            required = std::max(required, count + 1);
+            return count++;
+        }
+
+        void pushIndex(VkCommandBuffer& commandBuffer, Shader& shader, uint32_t index);
+
+        inline uint32_t getCount() const {
+            return count;
+        }
+
+        inline void fillStorageDescriptorSets(std::shared_ptr<DescriptorSets> descriptorSets, uint32_t binding) {
+            this->descriptorSets = descriptorSets;
+            this->binding = binding;
+            for (uint32_t i = 0; i < descriptorSets->getDescriptorSets().size(); i++) {
+                writeDescriptor(i);
+            }
+        }
+
+        // 管线布局只需要一个下标
+        inline static PushConstantInfo getPushConstantInfo(VkPushConstantRange& pushConstantRange) {
+            pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+            pushConstantRange.offset = 0;
+            pushConstantRange.size = sizeof(uint32_t);
+            return PushConstantInfo{&pushConstantRange, 1};
+        }
+    };
+
+    // 每帧临时常量的线性分配器 所有帧槽位共用一个常驻映射的缓冲 每个槽位占其中一段
+    // begin时该槽位的上一帧已经执行完毕(beginFrame等待过它的fence) 直接从头分配
+    // 着色器通过UNIFORM_BUFFER_DYNAMIC读取 绑定时给出动态偏移 每帧任意次分配都不需要新的缓冲与描述符集
+    class FrameAllocator : public IResource {
+    public:
+        struct Allocation {
+            void* mapped = nullptr;
+            // 绑定描述符集时使用的动态偏移
+            uint32_t offset = 0;
+        };
+    private:
+        VulkanApp* app;
+
+        VkBuffer buffer = VK_NULL_HANDLE;
+        MemoryAllocation memory;
+        VkDescriptorBufferInfo bufferInfo{};
+
+        // 每个槽位的大小
+        VkDeviceSize capacity;
+        // 描述符的range 单次分配不能超过它
+        VkDeviceSize blockRange;
+        // minUniformBufferOffsetAlignment
+        VkDeviceSize alignment = 1;
+
+        std::shared_ptr<DescriptorSets> descriptorSets;
+
+        uint32_t currentFrame = 0;
+        VkDeviceSize head = 0;
+    public:
+        FrameAllocator(VulkanApp* app, VkDeviceSize blockRange, VkDeviceSize capacity);
+
+        virtual void cleanup(VkDevice& device);
+
+        // 在分配之前调用 重置当前槽位
+        void begin(FrameInfo& frame);
+        // 由endFrame调用 非coherent内存flush本帧写入的部分
+        void flush();
+
+        // 超过blockRange或槽位用尽时抛出异常
+        Allocation allocate(VkDeviceSize size);
+
+        template<typename T>
+        uint32_t push(const T& data) {
+            static_assert(std::is_trivially_copyable<T>::value, "transient data must be trivially copyable");
+            Allocation allocation = allocate(sizeof(T));
+            memcpy(allocation.mapped, &data, sizeof(T));
+            return allocation.offset;
+        }
+
+        // 绑定到第set个描述符集 着色器读取offset处的数据
+        void bind(VkCommandBuffer& commandBuffer, Shader& shader, uint32_t set, uint32_t offset);
+
+        inline VkDeviceSize getBlockRange() const {
+            return blockRange;
+        }
+
+        inline VkDeviceSize getUsed() const {
+            return head;
+        }
+
+        inline void fillUniformDescriptorSets(std::shared_ptr<DescriptorSets> descriptorSets, uint32_t binding) {
+            this->descriptorSets = descriptorSets;
+            for (uint32_t i = 0; i < descriptorSets->getDescriptorSets().size(); i++) {
+                descriptorSets->writer.writeBuffer(binding, &bufferInfo, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC).overwrite(i).flush();
+            }
+        }
+    };
+
+    class ModelBuffer;
+
+    // 命令缓冲中当前绑定的几何缓冲 与之相同时跳过绑定
+    // 按缓冲句柄比较 共享缓冲扩容后句柄改变 会自然地重新绑定
+    struct GeometryBinding {
+        // 最近一次绑定的模型 连续绘制同一个模型时整个bind都跳过
+        const ModelBuffer* model = nullptr;
+        VkBuffer positionBuffer = VK_NULL_HANDLE;
+        bool positionsOnly = false;
+        VkBuffer indexBuffer = VK_NULL_HANDLE;
+        VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+
+        inline void reset() {
+            *this = GeometryBinding{};
+        }
+    };
+
     class ModelBuffer : public IResource{
     private:
-        VkBuffer vertexBuffer;
-        VkDeviceMemory vertexBufferMemory;
+        // 位置与其余属性分开存放 深度pass只绑定位置流
+        // arena不为空时不持有缓冲 数据位于共享缓冲的firstVertex/firstIndex处
+        VkBuffer positionBuffer = VK_NULL_HANDLE;
+        MemoryAllocation positionBufferMemory;
+        VkBuffer attributeBuffer = VK_NULL_HANDLE;
+        MemoryAllocation attributeBufferMemory;
 
         VkBuffer indexBuffer;
-        VkDeviceMemory indexBufferMemory;
+        MemoryAllocation indexBufferMemory;
 
         uint32_t vertexCount = 0;     // 记录顶点数量
         uint32_t indexCount = 0;      // 记录索引数量
 
-        bool isIndexed = false;
+        std::shared_ptr<GeometryArena> arena;
+        uint32_t firstVertex = 0;
+        uint32_t firstIndex = 0;
 
-        std::function<void(VkCommandBuffer& commandBuffer)> bindFunc;
-        std::function<void(VkCommandBuffer& commandBuffer)> drawFunc;
+        bool isIndexed = false;
+        VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+
+        // 压缩格式下颜色来自单独的binding 未持有内存时为共享的常量颜色
+        VertexFormat vertexFormat = VertexFormat::Full;
+        VkBuffer colorBuffer = VK_NULL_HANDLE;
+        MemoryAllocation colorBufferMemory;
+        // 量化位置还原到模型空间的矩阵
+        glm::mat4 dequantize{1.0f};
+
+        // 统一内存时顶点与索引直接写入 使用arena时与arena一致
+        UploadPath uploadPath = UploadPath::Staging;
+
+        // 各级LOD在索引缓冲中的范围 为空时绘制整个索引缓冲
+        std::vector<MeshLod> lods;
+        MeshBounds bounds{};
+        // LOD0的网格簇 用于CPU剔除
+        std::vector<Meshlet> meshlets;
+        // 按LOD依次存放的子网格 每级submeshCount个
+        std::vector<Submesh> submeshes;
+        uint32_t submeshCount = 0;
+        std::vector<MaterialInfo> materials;
+
+        std::function<void(VkCommandBuffer& commandBuffer, bool positionsOnly, GeometryBinding* binding)> bindFunc;
+        std::function<void(VkCommandBuffer& commandBuffer, uint32_t lod)> drawFunc;
         std::function<void(VkDevice& device)> cleanEndFunc;
 
-        void defaultBind(VkCommandBuffer& commandBuffer);
-        void defaultDraw(VkCommandBuffer& commandBuffer);
-        void indexedBind(VkCommandBuffer& commandBuffer);
-        void indexedDraw(VkCommandBuffer& commandBuffer);
+        void defaultBind(VkCommandBuffer& commandBuffer, bool positionsOnly, GeometryBinding* binding);
+        void defaultDraw(VkCommandBuffer& commandBuffer, uint32_t lod);
+        void indexedBind(VkCommandBuffer& commandBuffer, bool positionsOnly, GeometryBinding* binding);
+        void indexedDraw(VkCommandBuffer& commandBuffer, uint32_t lod);
         void cleanIndexBuffer(VkDevice& device);
+        void bindVertexStreams(VkCommandBuffer& commandBuffer, bool positionsOnly, GeometryBinding* binding);
+        VkBuffer getColorBuffer();
 
-        void createVertexBuffer(VulkanApp* app, std::vector<Vertex>& vertices);
-        void createIndexBuffer(VulkanApp* app, std::vector<uint32_t>& indices);
+        // 经暂存缓冲上传到device local内存 统一内存时直接写入
+        void createDeviceBuffer(VulkanApp* app, const void* data, VkDeviceSize bufferSize, VkBufferUsageFlags usage,
+                                       VkBuffer& buffer, MemoryAllocation& bufferMemory);
+        void createIndexBuffer(VulkanApp* app, const void* indices, VkDeviceSize bufferSize);
 
     public:
         ModelBuffer();
@@ -77,43 +325,353 @@ namespace jk {
         void setIndexed(bool indexed);
         bool indexed() const;
 
-        void bind(VkCommandBuffer& commandBuffer);
-        void draw(VkCommandBuffer& commandBuffer);
+        // positionsOnly为true时只绑定位置流 供只读位置的深度管线使用
+        // binding记录已绑定的缓冲 共用同一arena的模型连续绘制时只绑定一次
+        void bind(VkCommandBuffer& commandBuffer, bool positionsOnly = false, GeometryBinding* binding = nullptr);
+        void draw(VkCommandBuffer& commandBuffer, uint32_t lod = 0);
+        // 只绘制给定的索引范围 需要是索引模型
+        void drawRanges(VkCommandBuffer& commandBuffer, const std::vector<IndexRange>& ranges);
 
+        // 以Full格式拆分后上传
         void loadVertices(VulkanApp* app, std::vector<Vertex>& vertices);
+        void loadVertices(VulkanApp* app, const void* vertices, uint32_t vertexCount);
+        void loadVertexStreams(VulkanApp* app, const VertexStreamData& streams, VertexFormat format, uint32_t vertexCount);
+        // 在共享缓冲中分配并上传 streams需要是arena的格式
+        void loadVertexStreams(std::shared_ptr<GeometryArena> arena, const VertexStreamData& streams, uint32_t vertexCount);
+        void loadColors(VulkanApp* app, const VertexColor* colors, size_t colorCount);
+        // 只按顶点数创建device local的顶点流 内容之后由VertexStreamUploader分块写入
+        void allocateVertexStreams(VulkanApp* app, VertexFormat format, uint32_t vertexCount, bool colorStream,
+                                   const glm::mat4& dequantize);
         void loadIndices(VulkanApp* app, std::vector<uint32_t>& indices);
+        void loadIndices(VulkanApp* app, std::vector<uint16_t>& indices);
+        void loadIndices(VulkanApp* app, const void* indices, uint32_t indexCount, VkIndexType indexType);
+        // 需要先用arena上传顶点
+        void loadIndices(const void* indices, uint32_t indexCount, VkIndexType indexType);
         virtual void cleanup(VkDevice& device);
 
-        VkBuffer getVertexBuffer();
+        VkBuffer getPositionBuffer();
+        VkBuffer getAttributeBuffer();
         uint32_t getVertexCount() const;
         uint32_t getIndexCount() const;
         VkBuffer getIndexBuffer();
+        VkIndexType getIndexType() const;
+
+        inline VertexFormat getVertexFormat() const {
+            return vertexFormat;
+        }
+
+        // 不使用共享缓冲时为空 两个起始位置都是0
+        inline const std::shared_ptr<GeometryArena>& getArena() const {
+            return arena;
+        }
+
+        inline uint32_t getFirstVertex() const {
+            return firstVertex;
+        }
+
+        inline uint32_t getFirstIndex() const {
+            return firstIndex;
+        }
+
+        inline const glm::mat4& getDequantizeMatrix() const {
+            return dequantize;
+        }
+
+        // 索引缓冲中依次存放各级LOD 加载索引后设置
+        inline void setLods(std::vector<MeshLod> lods) {
+            this->lods = std::move(lods);
+        }
+
+        inline const std::vector<MeshLod>& getLods() const {
+            return lods;
+        }
+
+        inline uint32_t getLodCount() const {
+            return lods.empty() ? 1 : static_cast<uint32_t>(lods.size());
+        }
+
+        inline void setBounds(const MeshBounds& bounds) {
+            this->bounds = bounds;
+        }
+
+        inline const MeshBounds& getBounds() const {
+            return bounds;
+        }
+
+        inline void setMeshlets(std::vector<Meshlet> meshlets) {
+            this->meshlets = std::move(meshlets);
+        }
+
+        inline const std::vector<Meshlet>& getMeshlets() const {
+            return meshlets;
+        }
+
+        // 需要先设置LOD submeshes的数量是LOD数的整数倍
+        inline void setSubmeshes(std::vector<Submesh> submeshes) {
+            this->submeshes = std::move(submeshes);
+            submeshCount = static_cast<uint32_t>(this->submeshes.size()) / getLodCount();
+        }
+
+        // 每级LOD的子网格数量 为0时整个LOD作为一段绘制
+        inline uint32_t getSubmeshCount() const {
+            return submeshCount;
+        }
+
+        inline const Submesh* getSubmeshes(uint32_t lod) const {
+            return submeshes.data() + static_cast<size_t>(std::min(lod, getLodCount() - 1)) * submeshCount;
+        }
+
+        inline void setMaterials(std::vector<MaterialInfo> materials) {
+            this->materials = std::move(materials);
+        }
+
+        inline const std::vector<MaterialInfo>& getMaterials() const {
+            return materials;
+        }
 
         friend class GeneralBufferManager;
         friend class SimpleObj;
+        friend class VertexStreamUploader;
+    };
+
+    // 分块写入已经按总顶点数创建好的顶点流
+    // 每块经共用的暂存环上传 主机内存占用与模型大小无关
+    class VertexStreamUploader {
+    private:
+        VulkanApp* app;
+        std::shared_ptr<ModelBuffer> model;
+        VertexFormat format;
+        bool colorStream;
+        // 量化使用整个模型的包围盒 不能逐块计算
+        glm::vec3 minPos;
+        glm::vec3 maxPos;
+
+        uint32_t chunkVertices;
+        uint32_t written = 0;
+
+        VertexStreams streams;
+    public:
+        VertexStreamUploader(VulkanApp* app, std::shared_ptr<ModelBuffer> model, VertexFormat format, bool colorStream,
+                             const glm::vec3& minPos, const glm::vec3& maxPos, uint32_t chunkVertices);
+
+        VertexStreamUploader(const VertexStreamUploader&) = delete;
+        VertexStreamUploader& operator=(const VertexStreamUploader&) = delete;
+
+        // 一次不超过chunkVertices个 顺序追加在已写入的顶点之后
+        void append(const Vertex* vertices, uint32_t count);
+
+        inline void append(const std::vector<Vertex>& vertices) {
+            append(vertices.data(), static_cast<uint32_t>(vertices.size()));
+        }
+
+        inline uint32_t getChunkVertices() const {
+            return chunkVertices;
+        }
+
+        inline uint32_t getWrittenCount() const {
+            return written;
+        }
+
+        inline bool finished() const {
+            return written == model->getVertexCount();
+        }
+    };
+
+    // 异步加载中的模型 上传完成并被图形队列获取前get()返回nullptr
+    // 状态只在主线程的GeneralBufferManager::processPendingUploads中改变
+    class AsyncModelBuffer {
+    private:
+        std::shared_ptr<ModelBuffer> modelBuffer;
+        bool finished = false;
+    public:
+        inline bool ready() const {
+            return finished;
+        }
+
+        // 加载结束但没有得到模型
+        inline bool failed() const {
+            return finished && modelBuffer == nullptr;
+        }
+
+        inline std::shared_ptr<ModelBuffer> get() const {
+            return modelBuffer;
+        }
+
+        friend class GeneralBufferManager;
     };
 
     class GeneralBufferManager : public ResourceUser {
     private:
         VkDevice device;
+
+        // 之后上传的顶点使用的格式
+        VertexFormat vertexFormat = VertexFormat::Full;
+        bool colorStream = false;
+        // 没有颜色流时共用的白色 步长为0
+        std::shared_ptr<ModelBuffer> constantColor;
+
+        VkBuffer getConstantColorBuffer();
+
+        // 每种顶点布局一个共享缓冲 首次使用时创建
+        bool useGeometryArena = true;
+        std::map<uint32_t, std::shared_ptr<GeometryArena>> arenas;
+
+        // 等待上传的异步任务 返回true表示已处理完毕
+        std::vector<std::function<bool()>> pendingUploads;
+
+        // 生成的几何体与加载的模型按参数去重
+        AssetCache<ModelBuffer> modelCache;
+
+        // 异步模型单独成批 帧循环不等待它们的传输
+        UploadTicket submitUploads(bool deferred);
+        bool isUploadReady(UploadTicket ticket);
     public:
         GeneralBufferManager(VulkanApp* app, ResourceHelper& resourceHelper);
 
         std::shared_ptr<UniformBuffer> createUniformBuffer(VkDeviceSize bufferSize);
+        // stride为每条记录的大小 容量不足时自动扩容
+        std::shared_ptr<ObjectBuffer> createObjectBuffer(VkDeviceSize stride, uint32_t capacity = 1024);
+        // 容量固定 超出时抛出异常
+        std::shared_ptr<MaterialLibrary> createMaterialLibrary(uint32_t capacity = MaterialLibrary::DEFAULT_CAPACITY);
+        // blockRange为单次分配的上限 capacity为每帧的总量
+        std::shared_ptr<FrameAllocator> createFrameAllocator(VkDeviceSize blockRange, VkDeviceSize capacity = 1024 * 1024);
 
         std::shared_ptr<ModelBuffer> createModelBuffer();
         std::shared_ptr<jk::ModelBuffer> genCube(float size = 1.0f);
         std::shared_ptr<jk::ModelBuffer> genDoublePlane(float size = 1.0f);
         std::shared_ptr<jk::ModelBuffer> genSphere(float radius = 1.0f, uint32_t rings = 32, uint32_t sectors = 32);
 
+        // 与gen系列相同 但参数相同的调用共用一份缓冲 最后一个句柄释放时销毁
+        std::shared_ptr<ModelBuffer> acquireCube(float size = 1.0f);
+        std::shared_ptr<ModelBuffer> acquireDoublePlane(float size = 1.0f);
+        std::shared_ptr<ModelBuffer> acquireSphere(float radius = 1.0f, uint32_t rings = 32, uint32_t sectors = 32);
+
+        // 键会附加当前顶点格式 不同格式上传的缓冲不共用 create返回空时不缓存
+        template<typename Create>
+        std::shared_ptr<ModelBuffer> acquireModel(const std::string& key, Create&& create) {
+            auto formatKey = AssetCache<ModelBuffer>::makeKey(key, static_cast<uint32_t>(vertexFormat), colorStream);
+            return modelCache.acquire(formatKey, std::forward<Create>(create));
+        }
+
+        inline const AssetCache<ModelBuffer>& getModelCache() const {
+            return modelCache;
+        }
+
+        // 管线的顶点输入需要与这里的格式一致
+        inline void setVertexFormat(VertexFormat format, bool colorStream = false) {
+            vertexFormat = format;
+            this->colorStream = colorStream;
+        }
+
+        inline VertexFormat getVertexFormat() const {
+            return vertexFormat;
+        }
+
+        // 关闭后每个模型单独创建缓冲 只影响之后上传的模型
+        inline void setGeometryArenaEnabled(bool enabled) {
+            useGeometryArena = enabled;
+        }
+
+        // 当前顶点格式对应的共享缓冲
+        inline std::shared_ptr<GeometryArena> getGeometryArena() {
+            return getGeometryArena(vertexFormat, colorStream);
+        }
+
+        std::shared_ptr<GeometryArena> getGeometryArena(VertexFormat format, bool colorStream);
+
+        inline bool hasColorStream() const {
+            return colorStream;
+        }
+
+        inline VertexInputLayout getVertexInputLayout() const {
+            return VertexInputLayout::of(vertexFormat, colorStream);
+        }
+
+        // 阴影等只读位置的管线使用
+        inline VertexInputLayout getDepthVertexInputLayout() const {
+            return VertexInputLayout::depthOnly(vertexFormat);
+        }
+
+        // 按当前顶点格式拆分(压缩)后上传
         inline void loadVerticesOntoBuffer(std::shared_ptr<ModelBuffer>& buf, std::vector<Vertex>& vertices) {
-            buf->loadVertices(app, vertices);
+            loadVerticesOntoBuffer(buf, vertices.data(), static_cast<uint32_t>(vertices.size()));
         }
 
-        inline void loadIndicesOntoBuffer(std::shared_ptr<ModelBuffer>& buf, std::vector<uint32_t>& indices) {
-            buf->loadIndices(app, indices);
+        // 需要先上传顶点 顶点数不足65536时自动转为16位索引
+        void loadIndicesOntoBuffer(std::shared_ptr<ModelBuffer>& buf, std::vector<uint32_t>& indices);
+
+        inline void loadIndicesOntoBuffer(std::shared_ptr<ModelBuffer>& buf, std::vector<uint16_t>& indices) {
+            loadIndicesOntoBuffer(buf, indices.data(), static_cast<uint32_t>(indices.size()), VK_INDEX_TYPE_UINT16);
         }
 
+        // 读取交错的Vertex 按当前格式拆分后上传
+        void loadVerticesOntoBuffer(std::shared_ptr<ModelBuffer>& buf, const void* vertices, uint32_t vertexCount);
+
+        // 已经拆分好的顶点流 不再经过中间数组 可以直接指向映射的缓存文件
+        // 格式与当前格式不同时模型放在对应格式的arena中 需要使用匹配的管线
+        void loadVertexStreamsOntoBuffer(std::shared_ptr<ModelBuffer>& buf, const VertexStreamData& streams,
+                                         VertexFormat format, bool colorStream, uint32_t vertexCount);
+
+        // 顶点在共享缓冲中时索引也放入同一个arena
+        inline void loadIndicesOntoBuffer(std::shared_ptr<ModelBuffer>& buf, const void* indices, uint32_t indexCount, VkIndexType indexType) {
+            if (buf->getArena() != nullptr) {
+                buf->loadIndices(indices, indexCount, indexType);
+            } else {
+                buf->loadIndices(app, indices, indexCount, indexType);
+            }
+        }
+
+        // 按当前顶点格式创建vertexCount个顶点的空缓冲 返回的uploader负责分块写入
+        // minPos与maxPos为整个模型的包围盒 压缩格式用它量化位置
+        std::unique_ptr<VertexStreamUploader> streamVerticesOntoBuffer(std::shared_ptr<ModelBuffer>& buf, uint32_t vertexCount,
+                                                                       const glm::vec3& minPos, const glm::vec3& maxPos,
+                                                                       uint32_t chunkVertices);
+
+        // prepared在工作线程中准备CPU侧数据 就绪后由upload在主线程中创建并上传ModelBuffer
+        template<typename T>
+        std::shared_ptr<AsyncModelBuffer> uploadAsync(std::future<T> prepared, std::function<std::shared_ptr<ModelBuffer>(T&)> upload) {
+            auto handle = std::make_shared<AsyncModelBuffer>();
+            auto future = std::make_shared<std::future<T>>(std::move(prepared));
+            auto ticket = std::make_shared<UploadTicket>(0);
+            pendingUploads.push_back([this, handle, future, upload, ticket]() {
+                // 已经提交 等待传输完成
+                if (*ticket != 0) {
+                    handle->finished = isUploadReady(*ticket);
+                    return handle->finished;
+                }
+                if (future->wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                    return false;
+                }
+                try {
+                    T data = future->get();
+                    // 之前录制的上传不能混进延迟的批次
+                    submitUploads(false);
+                    handle->modelBuffer = upload(data);
+                } catch (const std::exception& e) {
+                    std::cerr << "Async model load failed: " << e.what() << std::endl;
+                    handle->modelBuffer = nullptr;
+                }
+                if (handle->modelBuffer == nullptr) {
+                    handle->finished = true;
+                    return true;
+                }
+                *ticket = submitUploads(true);
+                handle->finished = isUploadReady(*ticket);
+                return handle->finished;
+            });
+            return handle;
+        }
+
+        // 每帧在主线程调用 上传已经准备好的异步数据
+        void processPendingUploads();
+
+        inline bool hasPendingUploads() const {
+            return !pendingUploads.empty();
+        }
+
+        // 各个堆的设备内存使用情况 与纹理共用同一个分配器
+        std::vector<MemoryHeapStats> getMemoryStats() const;
+
         std::shared_ptr<UniformBuffer> getUniformBuffer(uint32_t resID);
         std::shared_ptr<ModelBuffer> getModelBuffer(uint32_t resID);
 
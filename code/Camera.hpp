@@ -10,6 +10,8 @@
 #include "CommandManager.h"
 #include "RenderObject.hpp"
 
+#include <cstddef>
+
 #define VK_USE_PLATFORM_WIN32_KHR
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
@@ -42,8 +44,9 @@ namespace jk {
         glm::vec3 right;
 
         bool updated = false;
-        bool lastFrameUpdated = false;
 
+        GeneralBufferManager* bufferAllocator;
+        // 调用initDescriptorSets时才创建 不使用相机的ubo时不占用每帧的缓冲
         std::shared_ptr<UniformBuffer> uniformBuffer; 
         std::shared_ptr<DescriptorSets> viewDescriptorSets;
 
@@ -66,8 +69,7 @@ namespace jk {
         } 
     public:
 
-        Camera(GeneralBufferManager& bufferAllocator, uint32_t binding = 0) {
-            uniformBuffer = bufferAllocator.createUniformBuffer(sizeof(GlobalBufferObject));
+        Camera(GeneralBufferManager& bufferAllocator, uint32_t binding = 0) : bufferAllocator(&bufferAllocator) {
             viewLayoutBinding = jk::DescriptorSetLayout::uniformDescriptorLayoutBinding(this->binding = binding);
 
             position = glm::vec3(0.0f, 0.0f, 0.0f);
@@ -79,6 +81,11 @@ namespace jk {
         }
 
         std::shared_ptr<UniformBuffer> initDescriptorSets(DescriptorPool& descriptorPool, VkDescriptorSetLayout layout) {
+            if (uniformBuffer == nullptr) {
+                uniformBuffer = bufferAllocator->createUniformBuffer(sizeof(GlobalBufferObject));
+                // 下一次update写入当前的view与proj
+                updated = true;
+            }
             viewDescriptorSets = descriptorPool.createDescriptorSets();
             viewDescriptorSets->init(layout);
             uniformBuffer->fillUniformDescriptorSets(viewDescriptorSets, binding);
@@ -127,14 +134,15 @@ namespace jk {
             return *this;
         }
 
+        // 只在相机变化时写入view与proj 各帧槽位的追赶由UniformBuffer处理
         void update() {
-            if (updated || lastFrameUpdated) {
+            if (updated) {
                 updateView();
                 // std::cout << "position " << position.x << " " << position.y << " " << position.z << std::endl;
-                // updateUBO(frame);
-                // 因为MAX_FRAMES_IN_FLIGHT = 2，所以这里需要判断一下
-                // 如果上一帧更新了 这一帧也需要更新
-                lastFrameUpdated = updated;
+                if (uniformBuffer != nullptr) {
+                    uniformBuffer->write(offsetof(GlobalBufferObject, view), view);
+                    uniformBuffer->write(offsetof(GlobalBufferObject, proj), projection);
+                }
                 updated = false;
             }
         }
@@ -147,6 +155,21 @@ namespace jk {
             return projection;
         }
 
+        // viewportHeight为渲染目标高度(像素)
+        LodView getLodView(float viewportHeight, float threshold = 1.0f) const {
+            LodView lodView{};
+            lodView.position = position;
+            // 翻转过y轴 取绝对值
+            lodView.pixelScale = std::abs(projection[1][1]) * viewportHeight * 0.5f;
+            lodView.orthographic = projection[3][3] == 1.0f;
+            lodView.threshold = threshold;
+            return lodView;
+        }
+
+        CullView getCullView() const {
+            return CullView::fromMatrix(projection * view, position);
+        }
+
         VkDescriptorSetLayoutBinding getViewLayoutBinding() {
             return viewLayoutBinding;
         }
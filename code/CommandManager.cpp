@@ -46,21 +46,25 @@ namespace jk {
     }
 
     void CommandManager::renderModelBuffer(FrameInfo &frameInfo, 
-                                            std::shared_ptr<ModelBuffer>& vbuffer) {
+                                            std::shared_ptr<ModelBuffer>& vbuffer, uint32_t lod) {
                                     
         // 绑定顶点缓冲
-        vbuffer->bind(frameInfo.commandBuffer);
-        vbuffer->draw(frameInfo.commandBuffer);
+        vbuffer->bind(frameInfo.commandBuffer, frameInfo.depthOnly, &frameInfo.geometryBinding);
+        vbuffer->draw(frameInfo.commandBuffer, lod);
     }
 
     FrameInfo CommandManager::beginFrame(std::vector<VkCommandBuffer>& commandBuffers) {
         // 等待当前帧缓冲
         syncManager.waitFrame();
+        // 已经执行完的帧不再引用延迟销毁的资源
+        app->getDeletionQueue()->collect(syncManager.getRetiredFrame());
+        app->publishResources();
         syncManager.acquireNextImage();
 
         auto currentFrame = syncManager.getCurrentFrame();
 
         FrameInfo frame = {currentFrame, syncManager.getCurrentImageIndex(), commandBuffers[currentFrame]};
+        frame.frameNumber = ++frameCount;
 
         reset(frame.commandBuffer, 0);
 
@@ -83,6 +87,19 @@ namespace jk {
             throw std::runtime_error("failed to record command buffer!");
         }
 
+        // 本帧分配的临时常量在提交之前对设备可见
+        if (frameInfo.frameAllocator != nullptr) {
+            frameInfo.frameAllocator->flush();
+        }
+
+        // 本帧新登记的材质与其它上传一起提交
+        if (frameInfo.materialLibrary != nullptr) {
+            frameInfo.materialLibrary->flush();
+        }
+
+        // 本帧之前录制的上传先提交 已完成的批次在本帧之前获取所有权
+        app->getUploadBatch()->flush();
+
         // 提交命令缓冲
         syncManager.submit(frameInfo.commandBuffer);
         // 提交绘制结果
@@ -111,6 +128,10 @@ namespace jk {
 
     // 执行一条命令
     void CommandManager::excuteCommand(std::function<void(VkCommandBuffer &)> func) {
+        // 等待之前的上传全部完成 传输队列上的写入不会与这条命令重叠
+        if (app->getUploadBatch() != nullptr) {
+            app->getUploadBatch()->finish();
+        }
 
         // 分配命令缓冲
         VkCommandBuffer commandBuffer;
@@ -137,8 +158,8 @@ namespace jk {
 
         auto queue = app->getGraphicsQueue();
 
-        vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
-        vkQueueWaitIdle(queue);
+        app->queueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
+        app->queueWaitIdle(queue);
 
         vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
     }
@@ -31,10 +31,74 @@ namespace jk {
 
     class VulkanApp;
 
+    // LOD选择所需的视点信息
+    struct LodView {
+        glm::vec3 position{0.0f};
+        float pixelScale = 0.0f;    // 距离为1处单位长度投影到屏幕上的像素数 为0时总是使用LOD0
+        bool orthographic = false;  // 正交投影下投影大小与距离无关
+        float threshold = 1.0f;     // 允许的屏幕空间误差(像素)
+        float bias = 1.0f;          // 大于1时偏向更粗的LOD 例如阴影pass
+    };
+
+    // 视锥与网格簇剔除所需的视点信息 未启用时不做任何剔除
+    struct CullView {
+        bool enabled = false;
+        bool backface = true;       // 管线剔除背面时才能做法线锥剔除
+        glm::vec3 position{0.0f};
+        glm::vec4 planes[6]{};      // 世界空间视锥平面 法线朝内
+
+        // 由view-projection矩阵提取视锥平面
+        static CullView fromMatrix(const glm::mat4& viewProj, const glm::vec3& position) {
+            CullView view{};
+            view.enabled = true;
+            view.position = position;
+            glm::vec4 rows[4];
+            for (int i = 0; i < 4; i++) {
+                rows[i] = glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]);
+            }
+            view.planes[0] = rows[3] + rows[0];
+            view.planes[1] = rows[3] - rows[0];
+            view.planes[2] = rows[3] + rows[1];
+            view.planes[3] = rows[3] - rows[1];
+            // 近平面按[-1,1]的深度范围取 对[0,1]只是稍微保守
+            view.planes[4] = rows[3] + rows[2];
+            view.planes[5] = rows[3] - rows[2];
+            for (auto& plane : view.planes) {
+                plane /= glm::length(glm::vec3(plane));
+            }
+            return view;
+        }
+
+        inline bool outside(const glm::vec3& center, float radius) const {
+            for (const auto& plane : planes) {
+                if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) {
+                    return true;
+                }
+            }
+            return false;
+        }
+    };
+
     struct FrameInfo {
         uint32_t currentFrame;
         uint32_t imageIndex;
         VkCommandBuffer commandBuffer;
+        LodView lodView{};
+        CullView cullView{};
+        // 深度pass中为true 模型只绑定位置流
+        bool depthOnly = false;
+        // 每个pass开始时清空 共用arena的模型之间不再重复绑定
+        GeometryBinding geometryBinding{};
+        // 递增的帧序号 同一帧的多个pass共用物体数据
+        uint64_t frameNumber = 0;
+        // 由ObjectBuffer::begin设置 为空时物体推送完整的PushData
+        ObjectBuffer* objectBuffer = nullptr;
+        // 由MaterialLibrary::begin设置 为空时物体不登记材质
+        MaterialLibrary* materialLibrary = nullptr;
+        // 由FrameAllocator::begin设置
+        FrameAllocator* frameAllocator = nullptr;
+        // 全局描述符集为动态uniform时的偏移 各pass绘制前写入
+        uint32_t globalOffset = 0;
     };
 
     class CommandManager {
@@ -46,6 +110,7 @@ namespace jk {
         SyncManager syncManager;
 
         VkCommandPool commandPool;
+        uint64_t frameCount = 0;
         void createCommandPool();
         void createOneTimeCommandBuffer(VkCommandBuffer& commandBuffer);
         void createCommandBuffers(std::vector<VkCommandBuffer>& commandBuffers);
@@ -56,10 +121,16 @@ namespace jk {
         FrameInfo beginFrame(std::vector<VkCommandBuffer>& commandBuffers);
         void endFrame(FrameInfo& frameInfo);
 
+        // 最近一次beginFrame的帧序号
+        inline uint64_t getFrameCount() const {
+            return frameCount;
+        }
+
         void reset(VkCommandBuffer& commandBuffer, VkCommandBufferResetFlags flags = 0);
         void renderModelBuffer(FrameInfo &frameInfo, 
-                                std::shared_ptr<ModelBuffer>& vbuffer);
+                                std::shared_ptr<ModelBuffer>& vbuffer, uint32_t lod = 0);
         void excuteCurrentFrame(VkCommandBuffer &commandBuffers);
+        // 立即提交并等待队列空闲 会先提交未完成的上传批次 一般的上传应当使用UploadBatch
         void excuteCommand(std::function<void(VkCommandBuffer&)> func);
         void cleanup();
 
@@ -0,0 +1,27 @@
+#include "DeletionQueue.h"
+#include "VulkanApp.h"
+
+namespace jk {
+
+    void DeletionQueue::push(std::shared_ptr<IResource> resource) {
+        if (resource == nullptr) {
+            return;
+        }
+        // 当前正在录制(或刚提交)的帧可能还在使用它
+        entries.push_back({app->getCommandManager()->getFrameCount(), std::move(resource)});
+    }
+
+    void DeletionQueue::collect(uint64_t retiredFrame) {
+        // 入队顺序即帧序号顺序
+        while (!entries.empty() && entries.front().frameNumber <= retiredFrame) {
+            std::shared_ptr<IResource> resource = std::move(entries.front().resource);
+            entries.pop_front();
+            resource->cleanup(app->getDevice());
+        }
+    }
+
+    void DeletionQueue::flush() {
+        collect(UINT64_MAX);
+    }
+
+}
@@ -0,0 +1,50 @@
+#ifndef VULKANTEST_DELETIONQUEUE_H
+#define VULKANTEST_DELETIONQUEUE_H
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+
+#include <vulkan/vulkan.h>
+
+#include "ResourceHelper.hpp"
+
+namespace jk {
+
+    class VulkanApp;
+
+    // 延迟销毁 资源在入队时已经开始录制的帧全部执行完之后才cleanup
+    // 帧序号与CommandManager一致 SyncManager等待某一帧的fence后该帧及之前的帧视为已完成
+    // 运行中移除物体 模型与纹理都经过这里 不需要vkDeviceWaitIdle
+    class DeletionQueue {
+    private:
+        struct Entry {
+            uint64_t frameNumber;
+            std::shared_ptr<IResource> resource;
+        };
+
+        VulkanApp* app;
+        std::deque<Entry> entries;
+    public:
+        DeletionQueue(VulkanApp* app) : app(app) {}
+
+        DeletionQueue(const DeletionQueue&) = delete;
+        DeletionQueue& operator=(const DeletionQueue&) = delete;
+
+        // resource需要已经从资源管理器中移除 为空时什么都不做
+        void push(std::shared_ptr<IResource> resource);
+
+        // 由beginFrame在等待fence之后调用 销毁retiredFrame及之前入队的资源
+        void collect(uint64_t retiredFrame);
+
+        // 设备空闲时销毁全部
+        void flush();
+
+        inline size_t size() const {
+            return entries.size();
+        }
+    };
+
+}
+
+#endif //VULKANTEST_DELETIONQUEUE_H
@@ -7,12 +7,13 @@
 
 namespace jk {
 
-    DescriptorSets::DescriptorSetWriter& DescriptorSets::DescriptorSetWriter::writeBuffer(uint32_t binding, VkDescriptorBufferInfo *bufferInfo) {
+    DescriptorSets::DescriptorSetWriter& DescriptorSets::DescriptorSetWriter::writeBuffer(uint32_t binding, VkDescriptorBufferInfo *bufferInfo,
+                                                                                          VkDescriptorType descriptorType) {
         VkWriteDescriptorSet descriptorWrite{};
         descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
         descriptorWrite.dstBinding = binding;
         descriptorWrite.dstArrayElement = 0;
-        descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        descriptorWrite.descriptorType = descriptorType;
         descriptorWrite.descriptorCount = 1;
         descriptorWrite.pBufferInfo = bufferInfo;
         descriptorWriters.push_back(descriptorWrite);
@@ -110,11 +111,15 @@ namespace jk {
     }
 
     void DescriptorPool::createDescriptorPool(uint32_t maxSets) {
-        std::array<VkDescriptorPoolSize, 2> poolSizes{};
+        std::array<VkDescriptorPoolSize, 4> poolSizes{};
         poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
         poolSizes[0].descriptorCount = static_cast<uint32_t>(VulkanApp::MAX_FRAMES_IN_FLIGHT) * maxSets;
         poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
         poolSizes[1].descriptorCount = static_cast<uint32_t>(VulkanApp::MAX_FRAMES_IN_FLIGHT) * maxSets;
+        poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        poolSizes[2].descriptorCount = static_cast<uint32_t>(VulkanApp::MAX_FRAMES_IN_FLIGHT) * maxSets;
+        poolSizes[3].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        poolSizes[3].descriptorCount = static_cast<uint32_t>(VulkanApp::MAX_FRAMES_IN_FLIGHT) * maxSets;
 
         VkDescriptorPoolCreateInfo poolInfo{};
         poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
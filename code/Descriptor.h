@@ -56,7 +56,8 @@ namespace jk {
         public:
             DescriptorSetWriter(DescriptorSets* descriptorSets) : descriptorSets(descriptorSets) {}
 
-            DescriptorSetWriter& writeBuffer(uint32_t binding, VkDescriptorBufferInfo *bufferInfo);
+            DescriptorSetWriter& writeBuffer(uint32_t binding, VkDescriptorBufferInfo *bufferInfo,
+                                             VkDescriptorType descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
             DescriptorSetWriter& writeImage(uint32_t binding, VkDescriptorImageInfo *imageInfo);
             DescriptorSetWriter& overwrite(int index);
             DescriptorSetWriter& flush();
@@ -83,6 +84,12 @@ namespace jk {
         static inline VkDescriptorSetLayoutBinding uniformDescriptorLayoutBinding(uint32_t binding) {
             return getDescriptorSetLayoutBinding(binding, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
         }
+        static inline VkDescriptorSetLayoutBinding uniformDynamicDescriptorLayoutBinding(uint32_t binding) {
+            return getDescriptorSetLayoutBinding(binding, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+        }
+        static inline VkDescriptorSetLayoutBinding storageDescriptorLayoutBinding(uint32_t binding) {
+            return getDescriptorSetLayoutBinding(binding, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+        }
         static inline VkDescriptorSetLayoutBinding imageDescriptorLayoutBinding(uint32_t binding) {
             return getDescriptorSetLayoutBinding(binding, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT);
         }
@@ -0,0 +1,229 @@
+#include "GeometryArena.h"
+#include "VulkanApp.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace jk {
+
+    // element range allocator
+
+    bool ElementRangeAllocator::allocate(uint32_t count, uint32_t& offset) {
+        for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it) {
+            if (it->second < count) {
+                continue;
+            }
+            offset = it->first;
+            uint32_t remain = it->second - count;
+            freeRanges.erase(it);
+            if (remain > 0) {
+                freeRanges[offset + count] = remain;
+            }
+            return true;
+        }
+        return false;
+    }
+
+    void ElementRangeAllocator::free(uint32_t offset, uint32_t count) {
+        if (count == 0) {
+            return;
+        }
+        auto it = freeRanges.emplace(offset, count).first;
+        auto next = std::next(it);
+        if (next != freeRanges.end() && it->first + it->second == next->first) {
+            it->second += next->second;
+            freeRanges.erase(next);
+        }
+        if (it != freeRanges.begin()) {
+            auto prev = std::prev(it);
+            if (prev->first + prev->second == it->first) {
+                prev->second += it->second;
+                freeRanges.erase(it);
+            }
+        }
+    }
+
+    void ElementRangeAllocator::grow(uint32_t newCapacity) {
+        if (newCapacity <= capacity) {
+            return;
+        }
+        uint32_t oldCapacity = capacity;
+        capacity = newCapacity;
+        free(oldCapacity, newCapacity - oldCapacity);
+    }
+
+    // geometry arena
+
+    GeometryArena::GeometryArena(VulkanApp* app, VertexFormat format, bool colorStream)
+            : app(app), format(format), colorStream(colorStream) {
+        hostVisible = app->getMemoryAllocator()->isUnifiedMemory();
+        positions.stride = VertexPacker::positionStride(format);
+        attributes.stride = VertexPacker::attributeStride(format);
+        colors.stride = sizeof(VertexColor);
+        positions.usage = attributes.usage = colors.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+        indices[0].stride = sizeof(uint16_t);
+        indices[1].stride = sizeof(uint32_t);
+        indices[0].usage = indices[1].usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+    }
+
+    void GeometryArena::createStream(Stream& stream, uint32_t capacity) {
+        // 扩容时作为拷贝源
+        // 渲染读取其它区间时传输队列仍在写入 不能转移所有权 在两个队列族间共享
+        VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        if (hostVisible) {
+            properties |= VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+        }
+        app->createBuffer(stream.stride * capacity,
+                          stream.usage | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                          properties, stream.buffer, stream.memory, true);
+    }
+
+    void GeometryArena::destroyStream(Stream& stream) {
+        if (stream.buffer != VK_NULL_HANDLE) {
+            vkDestroyBuffer(app->getDevice(), stream.buffer, nullptr);
+            stream.buffer = VK_NULL_HANDLE;
+        }
+        freeMemory(stream.memory);
+    }
+
+    void GeometryArena::growStream(Stream& stream, uint32_t oldCapacity, uint32_t newCapacity) {
+        Stream old = stream;
+        createStream(stream, newCapacity);
+        if (old.buffer == VK_NULL_HANDLE) {
+            return;
+        }
+        UploadTicket ticket = 0;
+        if (old.memory.mapped != nullptr && stream.memory.mapped != nullptr) {
+            // 主机可见时所有写入都是直接写 旧内容也在主机上拷贝 之后的直接写入不会被GPU拷贝覆盖
+            memcpy(stream.memory.mapped, old.memory.mapped, static_cast<size_t>(old.stride * oldCapacity));
+            stream.memory.owner->flush(stream.memory, 0, old.stride * oldCapacity);
+            app->getDeletionQueue()->push(std::make_shared<RetiredStream>(app, old, ticket));
+            return;
+        }
+        // 拷贝在传输队列上执行 跟在此前的上传之后 不等待队列 帧循环照常进行
+        UploadBatch* batch = app->getUploadBatch();
+        if (oldCapacity > 0) {
+            batch->record([&](VkCommandBuffer& commandBuffer) {
+                // 之前提交的上传可能还在写旧缓冲 之后的上传可能写入新缓冲中被拷贝覆盖的区间
+                VkMemoryBarrier barrier{};
+                barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+                barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+                vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                     0, 1, &barrier, 0, nullptr, 0, nullptr);
+                VkBufferCopy region{};
+                region.size = old.stride * oldCapacity;
+                vkCmdCopyBuffer(commandBuffer, old.buffer, stream.buffer, 1, &region);
+                vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                     0, 1, &barrier, 0, nullptr, 0, nullptr);
+            });
+            // 新缓冲立即替换了句柄 之后录制的帧都会绑定它
+            // 调用者可能把当前批次作为deferred提交 所以扩容拷贝单独作为普通批次提交
+            // 下一帧之前由图形队列等待信号量并获取 共享缓冲不需要所有权转移 获取时的屏障负责可见性
+            ticket = batch->submit();
+        }
+        // 正在录制与执行中的帧可能还绑定着旧缓冲
+        app->getDeletionQueue()->push(std::make_shared<RetiredStream>(app, old, ticket));
+    }
+
+    void GeometryArena::RetiredStream::cleanup(VkDevice& device) {
+        // deferred批次可能比读取旧缓冲的帧更晚完成
+        UploadBatch* batch = app->getUploadBatch();
+        if (!batch->isComplete(ticket)) {
+            batch->wait(ticket);
+        }
+        vkDestroyBuffer(device, stream.buffer, nullptr);
+        freeMemory(stream.memory);
+    }
+
+    void GeometryArena::upload(std::initializer_list<StreamCopy> copies) {
+        std::vector<StagingRing::BufferCopy> bufferCopies;
+        for (const auto& copy : copies) {
+            if (copy.size == 0) {
+                continue;
+            }
+            VkDeviceSize offset = copy.stream->stride * copy.first;
+            MemoryAllocation& memory = copy.stream->memory;
+            if (memory.mapped != nullptr) {
+                // 新分配的区间没有命令在读取 提交之前的主机写入对之后的命令可见
+                memcpy(static_cast<uint8_t*>(memory.mapped) + offset, copy.data, static_cast<size_t>(copy.size));
+                memory.owner->flush(memory, offset, copy.size);
+                continue;
+            }
+            bufferCopies.push_back({copy.data, copy.size, copy.stream->buffer, offset});
+        }
+        if (!bufferCopies.empty()) {
+            app->getStagingRing()->uploadBuffers(bufferCopies);
+        }
+    }
+
+    uint32_t GeometryArena::allocateVertices(uint32_t count) {
+        uint32_t first = 0;
+        if (count == 0 || vertexRanges.allocate(count, first)) {
+            return first;
+        }
+        uint32_t oldCapacity = vertexRanges.getCapacity();
+        // vertexOffset是int32
+        uint64_t newCapacity = std::max<uint64_t>({INITIAL_VERTEX_CAPACITY, uint64_t(oldCapacity) * 2, uint64_t(oldCapacity) + count});
+        if (newCapacity > INT32_MAX) {
+            throw std::runtime_error("geometry arena is out of vertex space!");
+        }
+        growStream(positions, oldCapacity, static_cast<uint32_t>(newCapacity));
+        growStream(attributes, oldCapacity, static_cast<uint32_t>(newCapacity));
+        if (colorStream) {
+            growStream(colors, oldCapacity, static_cast<uint32_t>(newCapacity));
+        }
+        vertexRanges.grow(static_cast<uint32_t>(newCapacity));
+        vertexRanges.allocate(count, first);
+        return first;
+    }
+
+    void GeometryArena::freeVertices(uint32_t firstVertex, uint32_t count) {
+        vertexRanges.free(firstVertex, count);
+    }
+
+    uint32_t GeometryArena::allocateIndices(VkIndexType indexType, uint32_t count) {
+        uint32_t slot = indexSlot(indexType);
+        ElementRangeAllocator& ranges = indexRanges[slot];
+        uint32_t first = 0;
+        if (count == 0 || ranges.allocate(count, first)) {
+            return first;
+        }
+        uint32_t oldCapacity = ranges.getCapacity();
+        uint64_t newCapacity = std::max<uint64_t>({INITIAL_INDEX_CAPACITY, uint64_t(oldCapacity) * 2, uint64_t(oldCapacity) + count});
+        if (newCapacity > UINT32_MAX) {
+            throw std::runtime_error("geometry arena is out of index space!");
+        }
+        growStream(indices[slot], oldCapacity, static_cast<uint32_t>(newCapacity));
+        ranges.grow(static_cast<uint32_t>(newCapacity));
+        ranges.allocate(count, first);
+        return first;
+    }
+
+    void GeometryArena::freeIndices(VkIndexType indexType, uint32_t firstIndex, uint32_t count) {
+        indexRanges[indexSlot(indexType)].free(firstIndex, count);
+    }
+
+    void GeometryArena::uploadVertices(uint32_t firstVertex, const VertexStreamData& streams) {
+        upload({
+            {&positions, firstVertex, streams.positions, streams.positionBytes},
+            {&attributes, firstVertex, streams.attributes, streams.attributeBytes},
+            {&colors, firstVertex, streams.colors, colorStream ? sizeof(VertexColor) * streams.colorCount : 0},
+        });
+    }
+
+    void GeometryArena::uploadIndices(VkIndexType indexType, uint32_t firstIndex, const void* data, uint32_t count) {
+        Stream& stream = indices[indexSlot(indexType)];
+        upload({{&stream, firstIndex, data, stream.stride * count}});
+    }
+
+    void GeometryArena::cleanup(VkDevice& device) {
+        destroyStream(positions);
+        destroyStream(attributes);
+        destroyStream(colors);
+        destroyStream(indices[0]);
+        destroyStream(indices[1]);
+    }
+
+}
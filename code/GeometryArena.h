@@ -0,0 +1,144 @@
+#ifndef VULKANTEST_GEOMETRYARENA_H
+#define VULKANTEST_GEOMETRYARENA_H
+
+#include <cstdint>
+#include <initializer_list>
+#include <map>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "VertexFormat.h"
+#include "MemoryAllocator.h"
+#include "ResourceHelper.hpp"
+#include "UploadBatch.h"
+
+namespace jk {
+
+    class VulkanApp;
+
+    // 以元素为单位的区间分配 首次适配 释放时与相邻区间合并
+    class ElementRangeAllocator {
+    private:
+        std::map<uint32_t, uint32_t> freeRanges;   // offset -> count
+        uint32_t capacity = 0;
+    public:
+        bool allocate(uint32_t count, uint32_t& offset);
+        void free(uint32_t offset, uint32_t count);
+        // 扩容后新增的部分加入空闲表
+        void grow(uint32_t newCapacity);
+
+        inline uint32_t getCapacity() const {
+            return capacity;
+        }
+    };
+
+    // 所有模型共用的顶点/索引缓冲 ModelBuffer只记录自己在其中的起始位置与数量
+    // 同一顶点格式的模型绑定完全相同 一个pass只需要绑定一次 之后用firstIndex与vertexOffset区分
+    // 容量不足时翻倍 新缓冲通过上传批次中的GPU拷贝继承旧内容 缓冲句柄会变化 绑定时总是重新查询
+    // 16位与32位索引分开存放 两者之间切换只需要重新绑定索引缓冲
+    class GeometryArena : public IResource {
+    public:
+        static constexpr uint32_t INITIAL_VERTEX_CAPACITY = 1 << 18;
+        static constexpr uint32_t INITIAL_INDEX_CAPACITY = 1 << 20;
+    private:
+        struct Stream {
+            VkBuffer buffer = VK_NULL_HANDLE;
+            MemoryAllocation memory;
+            VkDeviceSize stride = 0;
+            VkBufferUsageFlags usage = 0;
+        };
+
+        // 扩容后换下的旧缓冲 交给DeletionQueue 在读取它的帧与扩容拷贝都完成后销毁
+        class RetiredStream : public IResource {
+        private:
+            VulkanApp* app;
+            Stream stream;
+            UploadTicket ticket;
+        public:
+            RetiredStream(VulkanApp* app, const Stream& stream, UploadTicket ticket)
+                    : app(app), stream(stream), ticket(ticket) {}
+
+            virtual void cleanup(VkDevice& device);
+        };
+
+        VulkanApp* app;
+        VertexFormat format;
+        bool colorStream;
+        // 统一内存时缓冲主机可见 上传与扩容都直接写入映射 不经过暂存环
+        bool hostVisible = false;
+
+        Stream positions;
+        Stream attributes;
+        Stream colors;
+        ElementRangeAllocator vertexRanges;
+
+        // 0为16位 1为32位
+        Stream indices[2];
+        ElementRangeAllocator indexRanges[2];
+
+        static inline uint32_t indexSlot(VkIndexType indexType) {
+            return indexType == VK_INDEX_TYPE_UINT16 ? 0 : 1;
+        }
+
+        void createStream(Stream& stream, uint32_t capacity);
+        // 创建更大的缓冲 拷贝前oldCapacity个元素的命令录制到当前上传批次
+        void growStream(Stream& stream, uint32_t oldCapacity, uint32_t newCapacity);
+        void destroyStream(Stream& stream);
+
+        struct StreamCopy {
+            Stream* stream;
+            uint32_t first;
+            const void* data;
+            VkDeviceSize size;
+        };
+        // 映射的流直接写入 其余经过暂存环 放得下时一次提交
+        void upload(std::initializer_list<StreamCopy> copies);
+    public:
+        GeometryArena(VulkanApp* app, VertexFormat format, bool colorStream);
+
+        // 返回第一个元素的位置
+        uint32_t allocateVertices(uint32_t count);
+        void freeVertices(uint32_t firstVertex, uint32_t count);
+        uint32_t allocateIndices(VkIndexType indexType, uint32_t count);
+        void freeIndices(VkIndexType indexType, uint32_t firstIndex, uint32_t count);
+
+        // streams需要是本arena的格式
+        void uploadVertices(uint32_t firstVertex, const VertexStreamData& streams);
+        void uploadIndices(VkIndexType indexType, uint32_t firstIndex, const void* data, uint32_t count);
+
+        inline VertexFormat getVertexFormat() const {
+            return format;
+        }
+
+        inline bool hasColorStream() const {
+            return colorStream;
+        }
+
+        inline bool isHostVisible() const {
+            return hostVisible;
+        }
+
+        inline VkBuffer getPositionBuffer() const {
+            return positions.buffer;
+        }
+
+        inline VkBuffer getAttributeBuffer() const {
+            return attributes.buffer;
+        }
+
+        // 没有颜色流时为VK_NULL_HANDLE
+        inline VkBuffer getColorBuffer() const {
+            return colors.buffer;
+        }
+
+        inline VkBuffer getIndexBuffer(VkIndexType indexType) const {
+            return indices[indexSlot(indexType)].buffer;
+        }
+
+        virtual void cleanup(VkDevice& device);
+    };
+
+}
+
+#endif //VULKANTEST_GEOMETRYARENA_H
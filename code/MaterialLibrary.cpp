@@ -0,0 +1,123 @@
+#include "MaterialLibrary.h"
+#include "VulkanApp.h"
+
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+namespace jk {
+
+    size_t MaterialLibrary::MaterialHash::operator()(const Material& material) const {
+        // 逐个分量组合 不直接对内存取哈希 padding的内容不确定
+        size_t seed = 0;
+        auto combine = [&seed](float value) {
+            seed ^= std::hash<float>()(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+        };
+        for (int i = 0; i < 3; i++) {
+            combine(material.color[i]);
+            combine(material.ambient[i]);
+            combine(material.diffuse[i]);
+        }
+        for (int i = 0; i < 4; i++) {
+            combine(material.specular[i]);
+        }
+        return seed;
+    }
+
+    MaterialLibrary::MaterialLibrary(VulkanApp* app, uint32_t capacity) : app(app), capacity(std::max(capacity, 1u)) {
+        app->createBuffer(sizeof(MaterialData) * this->capacity,
+                          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, memory, true);
+        bufferInfo.buffer = buffer;
+        bufferInfo.offset = 0;
+        bufferInfo.range = sizeof(MaterialData) * this->capacity;
+        entries.reserve(this->capacity);
+        data.reserve(this->capacity);
+    }
+
+    void MaterialLibrary::cleanup(VkDevice& device) {
+        if (buffer != VK_NULL_HANDLE) {
+            vkDestroyBuffer(device, buffer, nullptr);
+            buffer = VK_NULL_HANDLE;
+        }
+        freeMemory(memory);
+    }
+
+    uint32_t MaterialLibrary::acquire(const Material& material) {
+        auto it = lookup.find(material);
+        if (it != lookup.end()) {
+            entries[it->second].refCount++;
+            return it->second;
+        }
+
+        uint32_t index;
+        if (!freeIndices.empty()) {
+            index = freeIndices.back();
+            freeIndices.pop_back();
+        } else if (entries.size() < capacity) {
+            index = static_cast<uint32_t>(entries.size());
+            entries.emplace_back();
+            data.emplace_back();
+        } else {
+            throw std::runtime_error("material library is full!");
+        }
+
+        entries[index].material = material;
+        entries[index].refCount = 1;
+        data[index].color = material.color;
+        data[index].ambient = material.ambient;
+        data[index].diffuse = material.diffuse;
+        data[index].specular = material.specular;
+        lookup.emplace(material, index);
+        dirty.push_back(index);
+        return index;
+    }
+
+    void MaterialLibrary::release(uint32_t index) {
+        Entry& entry = entries[index];
+        if (entry.refCount == 0 || --entry.refCount > 0) {
+            return;
+        }
+        lookup.erase(entry.material);
+        // 本帧及之前仍在执行的帧可能还在读取这一项
+        retired.push_back({index, frameNumber});
+    }
+
+    void MaterialLibrary::begin(FrameInfo& frame) {
+        frameNumber = frame.frameNumber;
+        // 与当前帧共用槽位的帧已经执行完毕 更早释放的下标可以复用
+        auto it = std::remove_if(retired.begin(), retired.end(), [this](const Retired& r) {
+            if (r.frameNumber + VulkanApp::MAX_FRAMES_IN_FLIGHT > frameNumber) {
+                return false;
+            }
+            freeIndices.push_back(r.index);
+            return true;
+        });
+        retired.erase(it, retired.end());
+        frame.materialLibrary = this;
+    }
+
+    void MaterialLibrary::flush() {
+        if (dirty.empty()) {
+            return;
+        }
+        std::sort(dirty.begin(), dirty.end());
+        dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+
+        // 连续的下标合并为一次拷贝
+        std::vector<StagingRing::BufferCopy> copies;
+        size_t first = 0;
+        for (size_t i = 1; i <= dirty.size(); i++) {
+            if (i < dirty.size() && dirty[i] == dirty[i - 1] + 1) {
+                continue;
+            }
+            uint32_t begin = dirty[first];
+            uint32_t count = dirty[i - 1] - begin + 1;
+            copies.push_back({&data[begin], sizeof(MaterialData) * count, buffer, sizeof(MaterialData) * begin});
+            first = i;
+        }
+        app->getStagingRing()->uploadBuffers(copies);
+        dirty.clear();
+    }
+
+}
@@ -0,0 +1,111 @@
+#ifndef VULKANTEST_MATERIALLIBRARY_H
+#define VULKANTEST_MATERIALLIBRARY_H
+
+#define GLM_FORCE_DEFAULT_ALIGNED_GENTYPES
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "MemoryAllocator.h"
+#include "ResourceHelper.hpp"
+#include "Descriptor.h"
+
+namespace jk {
+
+    class VulkanApp;
+    struct FrameInfo;
+
+    struct Material {
+        glm::vec3 color {1.0f};
+        glm::vec3 ambient{0.0f};
+        glm::vec3 diffuse{0.0f};
+        glm::vec4 specular{0.0f};
+
+        inline bool operator==(const Material& other) const {
+            return color == other.color && ambient == other.ambient &&
+                   diffuse == other.diffuse && specular == other.specular;
+        }
+    };
+
+    // 材质表中的一项 std430布局
+    struct MaterialData {
+        alignas(16) glm::vec3 color{1.0f};
+        alignas(16) glm::vec3 ambient{0.0f};
+        alignas(16) glm::vec3 diffuse{0.0f};
+        alignas(16) glm::vec4 specular{0.0f};
+    };
+
+    // 相同的材质只登记一次 下标在释放前保持不变 着色器通过下标读取storage buffer中的材质表
+    // 新登记的项在帧结束时上传 释放的下标在使用它的帧都执行完之后才复用
+    // 容量固定 描述符集不需要重写
+    class MaterialLibrary : public IResource {
+    public:
+        static constexpr uint32_t DEFAULT_CAPACITY = 4096;
+    private:
+        struct Entry {
+            Material material;
+            uint32_t refCount = 0;
+        };
+
+        struct MaterialHash {
+            size_t operator()(const Material& material) const;
+        };
+
+        struct Retired {
+            uint32_t index;
+            uint64_t frameNumber;
+        };
+
+        VulkanApp* app;
+        uint32_t capacity;
+
+        VkBuffer buffer = VK_NULL_HANDLE;
+        MemoryAllocation memory;
+        VkDescriptorBufferInfo bufferInfo{};
+
+        std::vector<Entry> entries;
+        std::vector<MaterialData> data;
+        std::unordered_map<Material, uint32_t, MaterialHash> lookup;
+        std::vector<uint32_t> freeIndices;
+        std::vector<Retired> retired;
+        uint64_t frameNumber = 0;
+
+        // 本帧新登记 待上传的下标 只拷贝这些项 避免覆盖正在被读取的部分
+        std::vector<uint32_t> dirty;
+    public:
+        MaterialLibrary(VulkanApp* app, uint32_t capacity = DEFAULT_CAPACITY);
+
+        virtual void cleanup(VkDevice& device);
+
+        // 返回材质的下标 已经登记过时增加引用计数
+        uint32_t acquire(const Material& material);
+        void release(uint32_t index);
+
+        inline const Material& getMaterial(uint32_t index) const {
+            return entries[index].material;
+        }
+
+        inline uint32_t getCount() const {
+            return static_cast<uint32_t>(lookup.size());
+        }
+
+        // 在录制绘制命令之前调用 endFrame时上传本帧新登记的材质
+        void begin(FrameInfo& frame);
+        void flush();
+
+        inline void fillStorageDescriptorSets(std::shared_ptr<DescriptorSets> descriptorSets, uint32_t binding) {
+            uint32_t size = descriptorSets->getDescriptorSets().size();
+            for (uint32_t i = 0; i < size; i++) {
+                descriptorSets->writer.writeBuffer(binding, &bufferInfo, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER).overwrite(i).flush();
+            }
+        }
+    };
+
+}
+
+#endif //VULKANTEST_MATERIALLIBRARY_H
@@ -0,0 +1,401 @@
+#include "MemoryAllocator.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace jk {
+
+    namespace {
+
+        VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+            return alignment <= 1 ? value : (value + alignment - 1) / alignment * alignment;
+        }
+
+        VkDeviceSize nextPowerOfTwo(VkDeviceSize value) {
+            VkDeviceSize result = 1;
+            while (result < value) {
+                result <<= 1;
+            }
+            return result;
+        }
+
+    }
+
+    MemoryAllocator::MemoryAllocator(VkPhysicalDevice physicalDevice, VkDevice device) : device(device) {
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        bufferImageGranularity = std::max<VkDeviceSize>(properties.limits.bufferImageGranularity, 1);
+        nonCoherentAtomSize = std::max<VkDeviceSize>(properties.limits.nonCoherentAtomSize, 1);
+        for (uint32_t i = 0; i < VK_MAX_MEMORY_TYPES * 2; i++) {
+            pools[i].memoryType = i / 2;
+        }
+        // 与findMemoryType的选择一致 看第一个同时满足两者的类型所在的堆
+        const VkMemoryPropertyFlags unified = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+            if ((memoryProperties.memoryTypes[i].propertyFlags & unified) == unified) {
+                unifiedMemory = memoryProperties.memoryHeaps[heapOf(i)].size > BAR_WINDOW_SIZE;
+                break;
+            }
+        }
+    }
+
+    uint32_t MemoryAllocator::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const {
+        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+            if ((typeFilter & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+                return i;
+            }
+        }
+        throw std::runtime_error("failed to find suitable memory type!");
+    }
+
+    bool MemoryAllocator::isCoherent(const MemoryAllocation& allocation) const {
+        uint32_t memoryType = pools[allocation.pool].memoryType;
+        return (memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+    }
+
+    void MemoryAllocator::flush(const MemoryAllocation& allocation, VkDeviceSize offset, VkDeviceSize size) {
+        if (allocation.memory == VK_NULL_HANDLE || size == 0 || isCoherent(allocation)) {
+            return;
+        }
+        VkDeviceSize memorySize;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            memorySize = allocation.block == DEDICATED_BLOCK ? allocation.size : pools[allocation.pool].blocks[allocation.block].size;
+        }
+        // 起点向下对齐 终点向上对齐 超出整块内存时改为VK_WHOLE_SIZE
+        VkDeviceSize begin = (allocation.offset + offset) / nonCoherentAtomSize * nonCoherentAtomSize;
+        VkDeviceSize end = alignUp(allocation.offset + offset + size, nonCoherentAtomSize);
+
+        VkMappedMemoryRange range{};
+        range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+        range.memory = allocation.memory;
+        range.offset = begin;
+        range.size = end >= memorySize ? VK_WHOLE_SIZE : end - begin;
+        vkFlushMappedMemoryRanges(device, 1, &range);
+    }
+
+    uint32_t MemoryAllocator::heapOf(uint32_t memoryType) const {
+        return memoryProperties.memoryTypes[memoryType].heapIndex;
+    }
+
+    bool MemoryAllocator::hostVisible(uint32_t memoryType) const {
+        return (memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+    }
+
+    // 小堆(如没有resizable BAR时256MB的主机可见显存)取堆大小的1/8 避免几块就占满
+    VkDeviceSize MemoryAllocator::blockSizeOf(uint32_t memoryType) const {
+        VkDeviceSize heapSize = memoryProperties.memoryHeaps[heapOf(memoryType)].size;
+        if (heapSize <= SMALL_HEAP_LIMIT) {
+            return std::min(DEFAULT_BLOCK_SIZE, alignUp(heapSize / 8, 32));
+        }
+        return heapSize >= LARGE_HEAP_LIMIT ? LARGE_BLOCK_SIZE : DEFAULT_BLOCK_SIZE;
+    }
+
+    bool MemoryAllocator::allocateDeviceMemory(uint32_t memoryType, VkDeviceSize size, VkDeviceMemory& memory, uint8_t*& mapped) {
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = size;
+        allocInfo.memoryTypeIndex = memoryType;
+        if (vkAllocateMemory(device, &allocInfo, nullptr, &memory) != VK_SUCCESS) {
+            return false;
+        }
+        mapped = nullptr;
+        // 主机可见的块常驻映射 同一块内的多个资源不能各自vkMapMemory
+        if (hostVisible(memoryType)) {
+            void* data = nullptr;
+            if (vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &data) != VK_SUCCESS) {
+                vkFreeMemory(device, memory, nullptr);
+                return false;
+            }
+            mapped = static_cast<uint8_t*>(data);
+        }
+        HeapUsage& usage = heapUsage[heapOf(memoryType)];
+        usage.deviceMemoryCount++;
+        usage.reservedBytes += size;
+        return true;
+    }
+
+    void MemoryAllocator::freeDeviceMemory(uint32_t memoryType, VkDeviceMemory memory, VkDeviceSize size, bool mapped) {
+        if (mapped) {
+            vkUnmapMemory(device, memory);
+        }
+        vkFreeMemory(device, memory, nullptr);
+        HeapUsage& usage = heapUsage[heapOf(memoryType)];
+        usage.deviceMemoryCount--;
+        usage.reservedBytes -= size;
+    }
+
+    uint32_t MemoryAllocator::createBlock(Pool& pool, VkDeviceSize minSize) {
+        Block block;
+        block.size = blockSizeOf(pool.memoryType);
+        // 申请失败时减半重试 直到放不下两个请求为止
+        while (!allocateDeviceMemory(pool.memoryType, block.size, block.memory, block.mapped)) {
+            block.size /= 2;
+            if (block.size < minSize * 2) {
+                return UINT32_MAX;
+            }
+        }
+        block.freeRanges[0] = block.size;
+
+        for (uint32_t i = 0; i < pool.blocks.size(); i++) {
+            if (pool.blocks[i].memory == VK_NULL_HANDLE) {
+                pool.blocks[i] = std::move(block);
+                return i;
+            }
+        }
+        pool.blocks.push_back(std::move(block));
+        return static_cast<uint32_t>(pool.blocks.size() - 1);
+    }
+
+    bool MemoryAllocator::allocateFromBlock(Pool& pool, uint32_t blockIndex, VkDeviceSize size, VkDeviceSize alignment,
+                                            VkDeviceSize& offset) {
+        Block& block = pool.blocks[blockIndex];
+        if (block.memory == VK_NULL_HANDLE) {
+            return false;
+        }
+        // 最佳适配 剩余最少的空闲区间
+        auto best = block.freeRanges.end();
+        VkDeviceSize bestWaste = 0;
+        for (auto it = block.freeRanges.begin(); it != block.freeRanges.end(); ++it) {
+            VkDeviceSize aligned = alignUp(it->first, alignment);
+            if (aligned + size > it->first + it->second) {
+                continue;
+            }
+            VkDeviceSize waste = it->second - size;
+            if (best == block.freeRanges.end() || waste < bestWaste) {
+                best = it;
+                bestWaste = waste;
+            }
+        }
+        if (best == block.freeRanges.end()) {
+            return false;
+        }
+
+        VkDeviceSize rangeOffset = best->first;
+        VkDeviceSize rangeEnd = best->first + best->second;
+        offset = alignUp(rangeOffset, alignment);
+        block.freeRanges.erase(best);
+        // 对齐留下的前部空隙与尾部剩余重新放回空闲表
+        if (offset > rangeOffset) {
+            block.freeRanges[rangeOffset] = offset - rangeOffset;
+        }
+        if (offset + size < rangeEnd) {
+            block.freeRanges[offset + size] = rangeEnd - offset - size;
+        }
+        block.allocationCount++;
+        return true;
+    }
+
+    void MemoryAllocator::releaseRange(Block& block, VkDeviceSize offset, VkDeviceSize size) {
+        auto it = block.freeRanges.emplace(offset, size).first;
+        // 与后一个区间合并
+        auto next = std::next(it);
+        if (next != block.freeRanges.end() && it->first + it->second == next->first) {
+            it->second += next->second;
+            block.freeRanges.erase(next);
+        }
+        // 与前一个区间合并
+        if (it != block.freeRanges.begin()) {
+            auto prev = std::prev(it);
+            if (prev->first + prev->second == it->first) {
+                prev->second += it->second;
+                block.freeRanges.erase(it);
+            }
+        }
+    }
+
+    MemoryAllocation MemoryAllocator::allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties,
+                                               bool linear) {
+        std::lock_guard<std::mutex> lock(mutex);
+        uint32_t memoryType = findMemoryType(requirements.memoryTypeBits, properties);
+        // 粒度为1时缓冲与图像可以紧挨着放 不需要分池
+        uint32_t poolIndex = memoryType * 2 + (linear || bufferImageGranularity <= 1 ? 0 : 1);
+        Pool& pool = pools[poolIndex];
+        HeapUsage& usage = heapUsage[heapOf(memoryType)];
+
+        MemoryAllocation allocation;
+        allocation.owner = this;
+        allocation.pool = poolIndex;
+        allocation.sizeClass = NO_SIZE_CLASS;
+
+        VkDeviceSize size = requirements.size;
+        VkDeviceSize alignment = std::max<VkDeviceSize>(requirements.alignment, 1);
+        VkDeviceSize blockSize = blockSizeOf(memoryType);
+
+        auto dedicated = [&]() {
+            uint8_t* mapped = nullptr;
+            if (!allocateDeviceMemory(memoryType, size, allocation.memory, mapped)) {
+                throw std::runtime_error("failed to allocate device memory!");
+            }
+            allocation.block = DEDICATED_BLOCK;
+            allocation.offset = 0;
+            allocation.size = size;
+            allocation.mapped = mapped;
+            usage.allocationCount++;
+            usage.usedBytes += size;
+            return allocation;
+        };
+
+        if (size > blockSize / 2) {
+            return dedicated();
+        }
+
+        // 小请求取整到尺寸级别 槽位按自身大小对齐 满足任何不超过它的对齐要求
+        VkDeviceSize classLimit = MIN_CLASS_SIZE << (SIZE_CLASS_COUNT - 1);
+        if (size <= classLimit && alignment <= classLimit) {
+            VkDeviceSize classSize = std::max(MIN_CLASS_SIZE, nextPowerOfTwo(std::max(size, alignment)));
+            uint32_t sizeClass = 0;
+            while ((MIN_CLASS_SIZE << sizeClass) < classSize) {
+                sizeClass++;
+            }
+            allocation.sizeClass = sizeClass;
+            size = alignment = classSize;
+
+            auto& slots = pool.freeSlots[sizeClass];
+            if (!slots.empty()) {
+                Slot slot = slots.back();
+                slots.pop_back();
+                Block& block = pool.blocks[slot.block];
+                allocation.memory = block.memory;
+                allocation.block = slot.block;
+                allocation.offset = slot.offset;
+                allocation.size = size;
+                allocation.mapped = block.mapped != nullptr ? block.mapped + slot.offset : nullptr;
+                usage.allocationCount++;
+                usage.usedBytes += size;
+                return allocation;
+            }
+        }
+
+        VkDeviceSize offset = 0;
+        uint32_t blockIndex = UINT32_MAX;
+        for (uint32_t i = 0; i < pool.blocks.size(); i++) {
+            if (allocateFromBlock(pool, i, size, alignment, offset)) {
+                blockIndex = i;
+                break;
+            }
+        }
+        if (blockIndex == UINT32_MAX) {
+            blockIndex = createBlock(pool, size);
+            if (blockIndex == UINT32_MAX || !allocateFromBlock(pool, blockIndex, size, alignment, offset)) {
+                allocation.sizeClass = NO_SIZE_CLASS;
+                return dedicated();
+            }
+        }
+
+        Block& block = pool.blocks[blockIndex];
+        allocation.memory = block.memory;
+        allocation.block = blockIndex;
+        allocation.offset = offset;
+        allocation.size = size;
+        allocation.mapped = block.mapped != nullptr ? block.mapped + offset : nullptr;
+        usage.allocationCount++;
+        usage.usedBytes += size;
+        return allocation;
+    }
+
+    void MemoryAllocator::free(MemoryAllocation& allocation) {
+        if (allocation.owner != this || allocation.memory == VK_NULL_HANDLE) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        Pool& pool = pools[allocation.pool];
+        HeapUsage& usage = heapUsage[heapOf(pool.memoryType)];
+        usage.allocationCount--;
+        usage.usedBytes -= allocation.size;
+
+        if (allocation.block == DEDICATED_BLOCK) {
+            freeDeviceMemory(pool.memoryType, allocation.memory, allocation.size, allocation.mapped != nullptr);
+        } else if (allocation.sizeClass != NO_SIZE_CLASS) {
+            pool.freeSlots[allocation.sizeClass].push_back({allocation.block, allocation.offset});
+        } else {
+            Block& block = pool.blocks[allocation.block];
+            releaseRange(block, allocation.offset, allocation.size);
+            block.allocationCount--;
+            // 至少保留一个空块 避免反复申请释放
+            if (block.allocationCount == 0) {
+                bool otherEmpty = false;
+                for (uint32_t i = 0; i < pool.blocks.size(); i++) {
+                    const Block& other = pool.blocks[i];
+                    if (i != allocation.block && other.memory != VK_NULL_HANDLE && other.allocationCount == 0) {
+                        otherEmpty = true;
+                        break;
+                    }
+                }
+                if (otherEmpty) {
+                    freeDeviceMemory(pool.memoryType, block.memory, block.size, block.mapped != nullptr);
+                    block = Block();
+                }
+            }
+        }
+        allocation = MemoryAllocation();
+    }
+
+    MemoryAllocation MemoryAllocator::allocateForBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties) {
+        VkMemoryRequirements requirements;
+        vkGetBufferMemoryRequirements(device, buffer, &requirements);
+        MemoryAllocation allocation = allocate(requirements, properties, true);
+        if (vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset) != VK_SUCCESS) {
+            free(allocation);
+            throw std::runtime_error("failed to bind buffer memory!");
+        }
+        return allocation;
+    }
+
+    MemoryAllocation MemoryAllocator::allocateForImage(VkImage image, VkMemoryPropertyFlags properties, bool linear) {
+        VkMemoryRequirements requirements;
+        vkGetImageMemoryRequirements(device, image, &requirements);
+        MemoryAllocation allocation = allocate(requirements, properties, linear);
+        if (vkBindImageMemory(device, image, allocation.memory, allocation.offset) != VK_SUCCESS) {
+            free(allocation);
+            throw std::runtime_error("failed to bind image memory!");
+        }
+        return allocation;
+    }
+
+    std::vector<MemoryHeapStats> MemoryAllocator::getHeapStats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<MemoryHeapStats> stats(memoryProperties.memoryHeapCount);
+        for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++) {
+            stats[i].heapSize = memoryProperties.memoryHeaps[i].size;
+            stats[i].deviceLocal = (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+            stats[i].deviceMemoryCount = heapUsage[i].deviceMemoryCount;
+            stats[i].reservedBytes = heapUsage[i].reservedBytes;
+            stats[i].allocationCount = heapUsage[i].allocationCount;
+            stats[i].usedBytes = heapUsage[i].usedBytes;
+        }
+        return stats;
+    }
+
+    void MemoryAllocator::printStats(std::ostream& out) const {
+        auto stats = getHeapStats();
+        const double MB = 1024.0 * 1024.0;
+        if (unifiedMemory) {
+            out << "[MemoryAllocator] device local memory is host visible, buffers are written directly" << std::endl;
+        }
+        for (size_t i = 0; i < stats.size(); i++) {
+            const auto& heap = stats[i];
+            out << "[MemoryAllocator] heap " << i << (heap.deviceLocal ? " (device local)" : "")
+                << ": " << heap.allocationCount << " allocations in " << heap.deviceMemoryCount << " device memory objects, "
+                << heap.usedBytes / MB << " / " << heap.reservedBytes / MB << " MB used, heap size "
+                << heap.heapSize / MB << " MB" << std::endl;
+        }
+    }
+
+    void MemoryAllocator::cleanup() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& pool : pools) {
+            for (auto& block : pool.blocks) {
+                if (block.memory != VK_NULL_HANDLE) {
+                    freeDeviceMemory(pool.memoryType, block.memory, block.size, block.mapped != nullptr);
+                }
+            }
+            pool.blocks.clear();
+            for (auto& slots : pool.freeSlots) {
+                slots.clear();
+            }
+        }
+    }
+
+}
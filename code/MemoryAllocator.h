@@ -0,0 +1,153 @@
+#ifndef VULKANTEST_MEMORYALLOCATOR_H
+#define VULKANTEST_MEMORYALLOCATOR_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+namespace jk {
+
+    class MemoryAllocator;
+
+    // 从大块设备内存中切出的一段 绑定资源时使用memory与offset
+    struct MemoryAllocation {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize offset = 0;
+        VkDeviceSize size = 0;
+        void* mapped = nullptr;     // 主机可见内存常驻映射 已经加上offset
+        MemoryAllocator* owner = nullptr;
+
+        // 分配器内部使用
+        uint32_t pool = 0;
+        uint32_t block = 0;
+        uint32_t sizeClass = 0;
+    };
+
+    // 每个堆的使用情况
+    struct MemoryHeapStats {
+        VkDeviceSize heapSize = 0;
+        bool deviceLocal = false;
+        uint32_t deviceMemoryCount = 0;     // 向驱动申请的次数 包括独立分配
+        VkDeviceSize reservedBytes = 0;     // 向驱动申请的总量
+        uint32_t allocationCount = 0;
+        VkDeviceSize usedBytes = 0;         // 分给资源的量 包括对齐与尺寸级别的取整
+    };
+
+    // 按块的设备内存子分配器 思路与VMA相同
+    // 每种内存类型按需申请64~256MB的块 资源在块内分配 避免触及maxMemoryAllocationCount
+    // bufferImageGranularity大于1时缓冲与optimal图像放在不同的块中 块内不会出现粒度冲突
+    // 64KB以下的请求按2的幂取整为尺寸级别 释放后进入该级别的空闲链表直接复用
+    // 更大的请求在块内按最佳适配查找空闲区间 释放时与相邻区间合并 超过半块的请求单独申请
+    class MemoryAllocator {
+    public:
+        static constexpr VkDeviceSize SMALL_HEAP_LIMIT = 1024ull * 1024 * 1024;
+        static constexpr VkDeviceSize LARGE_HEAP_LIMIT = 8ull * 1024 * 1024 * 1024;
+        static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64ull * 1024 * 1024;
+        static constexpr VkDeviceSize LARGE_BLOCK_SIZE = 256ull * 1024 * 1024;
+        // 没有resizable BAR时主机可见的显存窗口 不当作统一内存
+        static constexpr VkDeviceSize BAR_WINDOW_SIZE = 256ull * 1024 * 1024;
+
+        static constexpr VkDeviceSize MIN_CLASS_SIZE = 256;
+        static constexpr uint32_t SIZE_CLASS_COUNT = 9;     // 256B ~ 64KB
+        static constexpr uint32_t NO_SIZE_CLASS = UINT32_MAX;
+        static constexpr uint32_t DEDICATED_BLOCK = UINT32_MAX;
+
+        MemoryAllocator(VkPhysicalDevice physicalDevice, VkDevice device);
+
+        MemoryAllocator(const MemoryAllocator&) = delete;
+        MemoryAllocator& operator=(const MemoryAllocator&) = delete;
+
+        // linear为false表示optimal tiling的图像
+        MemoryAllocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, bool linear);
+        void free(MemoryAllocation& allocation);
+
+        // 分配并绑定
+        MemoryAllocation allocateForBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties);
+        MemoryAllocation allocateForImage(VkImage image, VkMemoryPropertyFlags properties, bool linear = false);
+
+        uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
+
+        // 非coherent的主机可见内存在写入后需要flush 区间相对于allocation 按nonCoherentAtomSize扩展
+        bool isCoherent(const MemoryAllocation& allocation) const;
+        void flush(const MemoryAllocation& allocation, VkDeviceSize offset, VkDeviceSize size);
+
+        // device local内存主机可见且不只是BAR窗口 集成显卡 开启ReBAR的独显 lavapipe等软件光栅器
+        // 此时缓冲可以直接写入 不需要暂存拷贝
+        inline bool isUnifiedMemory() const {
+            return unifiedMemory;
+        }
+
+        std::vector<MemoryHeapStats> getHeapStats() const;
+        void printStats(std::ostream& out) const;
+
+        // 释放所有块 需要在销毁设备前调用
+        void cleanup();
+
+    private:
+        struct Block {
+            VkDeviceMemory memory = VK_NULL_HANDLE;
+            VkDeviceSize size = 0;
+            uint8_t* mapped = nullptr;
+            // offset -> size 按地址排序便于合并
+            std::map<VkDeviceSize, VkDeviceSize> freeRanges;
+            uint32_t allocationCount = 0;   // 包括空闲链表中缓存的尺寸级别槽位
+        };
+
+        struct Slot {
+            uint32_t block;
+            VkDeviceSize offset;
+        };
+
+        // 每种内存类型两个池 分别放线性资源与optimal图像 粒度为1时只用第一个
+        struct Pool {
+            uint32_t memoryType = 0;
+            std::vector<Block> blocks;      // 释放的块保留位置 memory为空 下标不变
+            std::vector<Slot> freeSlots[SIZE_CLASS_COUNT];
+        };
+
+        struct HeapUsage {
+            uint32_t deviceMemoryCount = 0;
+            VkDeviceSize reservedBytes = 0;
+            uint32_t allocationCount = 0;
+            VkDeviceSize usedBytes = 0;
+        };
+
+        VkDevice device;
+        VkPhysicalDeviceMemoryProperties memoryProperties{};
+        VkDeviceSize bufferImageGranularity = 1;
+        VkDeviceSize nonCoherentAtomSize = 1;
+        bool unifiedMemory = false;
+
+        Pool pools[VK_MAX_MEMORY_TYPES * 2];
+        HeapUsage heapUsage[VK_MAX_MEMORY_HEAPS];
+        mutable std::mutex mutex;
+
+        VkDeviceSize blockSizeOf(uint32_t memoryType) const;
+        bool hostVisible(uint32_t memoryType) const;
+        uint32_t heapOf(uint32_t memoryType) const;
+
+        // 申请一块设备内存 主机可见时整块映射
+        bool allocateDeviceMemory(uint32_t memoryType, VkDeviceSize size, VkDeviceMemory& memory, uint8_t*& mapped);
+        void freeDeviceMemory(uint32_t memoryType, VkDeviceMemory memory, VkDeviceSize size, bool mapped);
+
+        bool allocateFromBlock(Pool& pool, uint32_t blockIndex, VkDeviceSize size, VkDeviceSize alignment,
+                               VkDeviceSize& offset);
+        uint32_t createBlock(Pool& pool, VkDeviceSize minSize);
+        void releaseRange(Block& block, VkDeviceSize offset, VkDeviceSize size);
+    };
+
+    // 替代原先的vkFreeMemory 对空的分配什么都不做
+    inline void freeMemory(MemoryAllocation& allocation) {
+        if (allocation.owner != nullptr) {
+            allocation.owner->free(allocation);
+        }
+    }
+
+}
+
+#endif //VULKANTEST_MEMORYALLOCATOR_H
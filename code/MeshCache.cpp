@@ -0,0 +1,364 @@
+#include "MeshCache.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <filesystem>
+#include <fstream>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace jk {
+
+    std::string MeshCache::cacheDirectory = "meshcache";
+
+    // mapped file
+
+    MappedFile::~MappedFile() {
+        close();
+    }
+
+#ifdef _WIN32
+    bool MappedFile::open(const std::string& path) {
+        close();
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                                  OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+            CloseHandle(file);
+            return false;
+        }
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping == nullptr) {
+            CloseHandle(file);
+            return false;
+        }
+        void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (view == nullptr) {
+            CloseHandle(mapping);
+            CloseHandle(file);
+            return false;
+        }
+        fileHandle = file;
+        mappingHandle = mapping;
+        data = static_cast<const uint8_t*>(view);
+        size = static_cast<size_t>(fileSize.QuadPart);
+        return true;
+    }
+
+    void MappedFile::close() {
+        if (data != nullptr) {
+            UnmapViewOfFile(data);
+        }
+        if (mappingHandle != nullptr) {
+            CloseHandle(mappingHandle);
+        }
+        if (fileHandle != nullptr) {
+            CloseHandle(fileHandle);
+        }
+        data = nullptr;
+        size = 0;
+        mappingHandle = nullptr;
+        fileHandle = nullptr;
+    }
+#else
+    bool MappedFile::open(const std::string& path) {
+        close();
+        int file = ::open(path.c_str(), O_RDONLY);
+        if (file < 0) {
+            return false;
+        }
+        struct stat st{};
+        if (fstat(file, &st) != 0 || st.st_size == 0) {
+            ::close(file);
+            return false;
+        }
+        void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+        if (view == MAP_FAILED) {
+            ::close(file);
+            return false;
+        }
+        // 之后整段顺序拷贝进暂存缓冲
+        madvise(view, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+        fd = file;
+        data = static_cast<const uint8_t*>(view);
+        size = static_cast<size_t>(st.st_size);
+        return true;
+    }
+
+    void MappedFile::close() {
+        if (data != nullptr) {
+            munmap(const_cast<uint8_t*>(data), size);
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        data = nullptr;
+        size = 0;
+        fd = -1;
+    }
+#endif
+
+    // 不存在的文件记为UINT64_MAX 之后被创建时缓存同样失效
+    static void queryDependency(const std::string& path, uint64_t& size, int64_t& mtime) {
+        namespace fs = std::filesystem;
+        std::error_code ec;
+        size = static_cast<uint64_t>(fs::file_size(path, ec));
+        if (ec) {
+            size = UINT64_MAX;
+            mtime = 0;
+            return;
+        }
+        auto time = fs::last_write_time(path, ec);
+        mtime = ec ? 0 : static_cast<int64_t>(time.time_since_epoch().count());
+    }
+
+    // cached mesh
+
+    bool CachedMesh::open(const std::string& cacheFile, uint64_t pathHash, uint64_t sourceSize, int64_t sourceMtime,
+                          VertexFormat format, bool colorStream) {
+        if (!file.open(cacheFile) || file.getSize() < sizeof(MeshCacheHeader)) {
+            return false;
+        }
+        header = reinterpret_cast<const MeshCacheHeader*>(file.getData());
+
+        // 版本 源文件或顶点格式任意一项不一致都视为失效
+        // Full格式没有颜色流
+        bool colors = colorStream && format != VertexFormat::Full;
+        if (header->magic != MESH_CACHE_MAGIC || header->version != MESH_CACHE_VERSION ||
+            header->pathHash != pathHash || header->sourceSize != sourceSize || header->sourceMtime != sourceMtime ||
+            header->vertexFormat != static_cast<uint32_t>(format) || header->colorStream != (colors ? 1u : 0u) ||
+            (header->indexSize != sizeof(uint16_t) && header->indexSize != sizeof(uint32_t))) {
+            file.close();
+            return false;
+        }
+
+        uint64_t vertexCount = header->vertexCount;
+        if (header->positionBytes != vertexCount * VertexPacker::positionStride(format) ||
+            header->attributeBytes != vertexCount * VertexPacker::attributeStride(format) ||
+            header->colorCount != (colors ? vertexCount : 0)) {
+            file.close();
+            return false;
+        }
+
+        uint64_t colorBytes = header->colorCount * sizeof(VertexColor);
+        uint64_t indexBytes = static_cast<uint64_t>(header->indexCount) * header->indexSize;
+        uint64_t lodBytes = static_cast<uint64_t>(header->lodCount) * sizeof(MeshLod);
+        uint64_t meshletBytes = static_cast<uint64_t>(header->meshletCount) * sizeof(Meshlet);
+        uint64_t submeshBytes = static_cast<uint64_t>(header->submeshCount) * sizeof(Submesh);
+        uint64_t materialBytes = static_cast<uint64_t>(header->materialCount) * sizeof(MaterialInfo);
+        if (header->positionOffset + header->positionBytes > file.getSize() ||
+            header->attributeOffset + header->attributeBytes > file.getSize() ||
+            header->colorOffset + colorBytes > file.getSize() || header->indexOffset + indexBytes > file.getSize() ||
+            header->lodOffset + lodBytes > file.getSize() || header->meshletOffset + meshletBytes > file.getSize() ||
+            header->submeshOffset + submeshBytes > file.getSize() || header->materialOffset + materialBytes > file.getSize() ||
+            header->libraryOffset + header->libraryPathLength > file.getSize()) {
+            file.close();
+            return false;
+        }
+
+        // 只修改了.mtl时obj本身不变 需要单独校验
+        if (header->libraryPathLength > 0) {
+            std::string library(reinterpret_cast<const char*>(file.getData() + header->libraryOffset), header->libraryPathLength);
+            uint64_t librarySize;
+            int64_t libraryMtime;
+            queryDependency(library, librarySize, libraryMtime);
+            if (librarySize != header->librarySize || libraryMtime != header->libraryMtime) {
+                file.close();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    VertexStreamData CachedMesh::getVertexStreams() const {
+        VertexStreamData streams;
+        streams.positions = file.getData() + header->positionOffset;
+        streams.positionBytes = static_cast<size_t>(header->positionBytes);
+        streams.attributes = file.getData() + header->attributeOffset;
+        streams.attributeBytes = static_cast<size_t>(header->attributeBytes);
+        streams.colors = reinterpret_cast<const VertexColor*>(file.getData() + header->colorOffset);
+        streams.colorCount = static_cast<size_t>(header->colorCount);
+        memcpy(&streams.dequantize[0][0], header->dequantize, sizeof(header->dequantize));
+        return streams;
+    }
+
+    // mesh cache
+
+    static uint64_t hashPath(const std::string& path) {
+        // FNV-1a
+        uint64_t hash = 1469598103934665603ull;
+        for (unsigned char c : path) {
+            hash ^= c;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    bool MeshCache::querySource(const std::string& sourcePath, uint64_t& pathHash, uint64_t& sourceSize, int64_t& sourceMtime) {
+        namespace fs = std::filesystem;
+        std::error_code ec;
+        fs::path source = fs::weakly_canonical(fs::path(sourcePath), ec);
+        if (ec) {
+            return false;
+        }
+        sourceSize = static_cast<uint64_t>(fs::file_size(source, ec));
+        if (ec) {
+            return false;
+        }
+        auto mtime = fs::last_write_time(source, ec);
+        if (ec) {
+            return false;
+        }
+        sourceMtime = static_cast<int64_t>(mtime.time_since_epoch().count());
+        pathHash = hashPath(source.generic_string());
+        return true;
+    }
+
+    std::string MeshCache::cacheFileOf(uint64_t pathHash, VertexFormat format, bool colorStream) {
+        // Full格式没有颜色流
+        bool colors = colorStream && format != VertexFormat::Full;
+        char name[48];
+        snprintf(name, sizeof(name), "%016llx-f%u%s.jkmesh", static_cast<unsigned long long>(pathHash),
+                 static_cast<uint32_t>(format), colors ? "c" : "");
+        return (std::filesystem::path(cacheDirectory) / name).string();
+    }
+
+    std::unique_ptr<CachedMesh> MeshCache::open(const std::string& sourcePath, VertexFormat format, bool colorStream) {
+        uint64_t pathHash, sourceSize;
+        int64_t sourceMtime;
+        if (!querySource(sourcePath, pathHash, sourceSize, sourceMtime)) {
+            return nullptr;
+        }
+        auto mesh = std::make_unique<CachedMesh>();
+        if (!mesh->open(cacheFileOf(pathHash, format, colorStream), pathHash, sourceSize, sourceMtime, format, colorStream)) {
+            return nullptr;
+        }
+        return mesh;
+    }
+
+    bool MeshCache::write(const std::string& sourcePath, const VertexStreams& streams, VertexFormat format,
+                          bool colorStream, uint32_t vertexCount,
+                          const void* indices, uint32_t indexCount, VkIndexType indexType,
+                          const std::vector<MeshLod>& lods, const MeshBounds& bounds,
+                          const std::vector<Meshlet>& meshlets, const std::vector<Submesh>& submeshes,
+                          const std::vector<MaterialInfo>& materials, const std::string& libraryPath) {
+        namespace fs = std::filesystem;
+
+        MeshCacheHeader header{};
+        if (!querySource(sourcePath, header.pathHash, header.sourceSize, header.sourceMtime)) {
+            return false;
+        }
+
+        auto align = [](uint64_t offset) { return (offset + 15) & ~uint64_t(15); };
+
+        header.magic = MESH_CACHE_MAGIC;
+        header.version = MESH_CACHE_VERSION;
+        header.vertexFormat = static_cast<uint32_t>(format);
+        header.colorStream = colorStream && format != VertexFormat::Full ? 1 : 0;
+        header.vertexCount = vertexCount;
+        header.indexCount = indexCount;
+        header.indexSize = indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+        memcpy(header.dequantize, &streams.dequantize[0][0], sizeof(header.dequantize));
+        header.positionOffset = align(sizeof(MeshCacheHeader));
+        header.positionBytes = streams.positions.size();
+        header.attributeOffset = align(header.positionOffset + header.positionBytes);
+        header.attributeBytes = streams.attributes.size();
+        header.colorOffset = align(header.attributeOffset + header.attributeBytes);
+        header.colorCount = header.colorStream ? streams.colors.size() : 0;
+        header.indexOffset = align(header.colorOffset + header.colorCount * sizeof(VertexColor));
+        header.lodOffset = align(header.indexOffset + static_cast<uint64_t>(header.indexCount) * header.indexSize);
+        header.lodCount = static_cast<uint32_t>(lods.size());
+        header.boundsRadius = bounds.radius;
+        header.boundsCenter[0] = bounds.center.x;
+        header.boundsCenter[1] = bounds.center.y;
+        header.boundsCenter[2] = bounds.center.z;
+        header.meshletOffset = align(header.lodOffset + static_cast<uint64_t>(header.lodCount) * sizeof(MeshLod));
+        header.meshletCount = static_cast<uint32_t>(meshlets.size());
+        header.submeshOffset = align(header.meshletOffset + static_cast<uint64_t>(header.meshletCount) * sizeof(Meshlet));
+        header.submeshCount = static_cast<uint32_t>(submeshes.size());
+        header.materialOffset = align(header.submeshOffset + static_cast<uint64_t>(header.submeshCount) * sizeof(Submesh));
+        header.materialCount = static_cast<uint32_t>(materials.size());
+        header.libraryOffset = header.materialOffset + static_cast<uint64_t>(header.materialCount) * sizeof(MaterialInfo);
+        header.libraryPathLength = static_cast<uint32_t>(libraryPath.size());
+        if (!libraryPath.empty()) {
+            queryDependency(libraryPath, header.librarySize, header.libraryMtime);
+        }
+
+        std::error_code ec;
+        fs::create_directories(cacheDirectory, ec);
+
+        // 先写临时文件再重命名 避免读到写了一半的缓存
+        // 临时文件名带进程号与序号 多个线程或进程同时写同一个缓存时不会互相覆盖
+        static std::atomic<uint32_t> tempCounter{0};
+#ifdef _WIN32
+        unsigned long processId = GetCurrentProcessId();
+#else
+        unsigned long processId = static_cast<unsigned long>(getpid());
+#endif
+        std::string target = cacheFileOf(header.pathHash, format, colorStream);
+        std::string temp = target + "." + std::to_string(processId) + "." +
+                           std::to_string(tempCounter.fetch_add(1, std::memory_order_relaxed)) + ".tmp";
+        {
+            std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+            if (!out) {
+                return false;
+            }
+            const char padding[16] = {};
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out.write(padding, static_cast<std::streamsize>(header.positionOffset - sizeof(header)));
+            out.write(reinterpret_cast<const char*>(streams.positions.data()), static_cast<std::streamsize>(header.positionBytes));
+            uint64_t positionEnd = header.positionOffset + header.positionBytes;
+            out.write(padding, static_cast<std::streamsize>(header.attributeOffset - positionEnd));
+            out.write(reinterpret_cast<const char*>(streams.attributes.data()), static_cast<std::streamsize>(header.attributeBytes));
+            uint64_t attributeEnd = header.attributeOffset + header.attributeBytes;
+            out.write(padding, static_cast<std::streamsize>(header.colorOffset - attributeEnd));
+            out.write(reinterpret_cast<const char*>(streams.colors.data()), static_cast<std::streamsize>(header.colorCount * sizeof(VertexColor)));
+            uint64_t colorEnd = header.colorOffset + header.colorCount * sizeof(VertexColor);
+            out.write(padding, static_cast<std::streamsize>(header.indexOffset - colorEnd));
+            out.write(static_cast<const char*>(indices), static_cast<std::streamsize>(static_cast<uint64_t>(indexCount) * header.indexSize));
+            uint64_t indexEnd = header.indexOffset + static_cast<uint64_t>(indexCount) * header.indexSize;
+            out.write(padding, static_cast<std::streamsize>(header.lodOffset - indexEnd));
+            out.write(reinterpret_cast<const char*>(lods.data()), static_cast<std::streamsize>(lods.size() * sizeof(MeshLod)));
+            uint64_t lodEnd = header.lodOffset + static_cast<uint64_t>(header.lodCount) * sizeof(MeshLod);
+            out.write(padding, static_cast<std::streamsize>(header.meshletOffset - lodEnd));
+            out.write(reinterpret_cast<const char*>(meshlets.data()), static_cast<std::streamsize>(meshlets.size() * sizeof(Meshlet)));
+            uint64_t meshletEnd = header.meshletOffset + static_cast<uint64_t>(header.meshletCount) * sizeof(Meshlet);
+            out.write(padding, static_cast<std::streamsize>(header.submeshOffset - meshletEnd));
+            out.write(reinterpret_cast<const char*>(submeshes.data()), static_cast<std::streamsize>(submeshes.size() * sizeof(Submesh)));
+            uint64_t submeshEnd = header.submeshOffset + static_cast<uint64_t>(header.submeshCount) * sizeof(Submesh);
+            out.write(padding, static_cast<std::streamsize>(header.materialOffset - submeshEnd));
+            out.write(reinterpret_cast<const char*>(materials.data()), static_cast<std::streamsize>(materials.size() * sizeof(MaterialInfo)));
+            out.write(libraryPath.data(), static_cast<std::streamsize>(libraryPath.size()));
+            if (!out) {
+                fs::remove(temp, ec);
+                return false;
+            }
+        }
+        fs::rename(temp, target, ec);
+        if (ec) {
+            // windows下目标已存在时rename会失败
+            fs::remove(target, ec);
+            fs::rename(temp, target, ec);
+        }
+        return !ec;
+    }
+
+}
@@ -0,0 +1,186 @@
+#ifndef VULKANTEST_MESHCACHE_H
+#define VULKANTEST_MESHCACHE_H
+
+#include <cstdint>
+#include <string>
+#include <memory>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "Vertex.h"
+#include "VertexFormat.h"
+#include "MeshSimplifier.h"
+#include "Meshlet.h"
+#include "Submesh.h"
+
+namespace jk {
+
+    // 只读内存映射文件 windows下用file mapping 其它平台用mmap
+    class MappedFile {
+    private:
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+#ifdef _WIN32
+        void* fileHandle = nullptr;
+        void* mappingHandle = nullptr;
+#else
+        int fd = -1;
+#endif
+    public:
+        MappedFile() = default;
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        bool open(const std::string& path);
+        void close();
+
+        inline const uint8_t* getData() const {
+            return data;
+        }
+
+        inline size_t getSize() const {
+            return size;
+        }
+    };
+
+    #define MESH_CACHE_MAGIC 0x434d4b4au // "JKMC"
+    #define MESH_CACHE_VERSION 7
+
+    // 二进制网格缓存文件头 之后依次是位置流 属性流 颜色流 索引数据 LOD表 网格簇表 子网格表 材质表 材质库路径
+    // 顶点按写入时的格式拆分好 命中时直接从映射内存拷贝 不再重新拆分
+    struct MeshCacheHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t pathHash;      // 源文件路径
+        uint64_t sourceSize;    // 源文件大小
+        int64_t sourceMtime;    // 源文件修改时间
+        uint32_t vertexFormat;  // VertexFormat
+        uint32_t colorStream;   // 是否带颜色流
+        uint32_t vertexCount;
+        uint32_t indexCount;
+        uint32_t indexSize;     // 2 或 4
+        float dequantize[16];
+        uint64_t positionOffset;
+        uint64_t positionBytes;
+        uint64_t attributeOffset;
+        uint64_t attributeBytes;
+        uint64_t colorOffset;
+        uint64_t colorCount;
+        uint64_t indexOffset;
+        uint64_t lodOffset;
+        uint32_t lodCount;
+        float boundsRadius;
+        float boundsCenter[3];
+        uint32_t meshletCount;
+        uint64_t meshletOffset;
+        uint64_t submeshOffset;
+        uint32_t submeshCount;  // 所有LOD的子网格总数
+        uint32_t materialCount;
+        uint64_t materialOffset;
+        // 材质表来自的.mtl文件 同样按大小与修改时间校验 路径长度为0表示没有材质库
+        uint64_t libraryOffset;
+        uint32_t libraryPathLength;
+        uint64_t librarySize;   // 写入时文件不存在则为UINT64_MAX
+        int64_t libraryMtime;
+    };
+
+    // 映射后的缓存网格 数据直接指向映射内存 不做拷贝
+    class CachedMesh {
+    private:
+        MappedFile file;
+        const MeshCacheHeader* header = nullptr;
+    public:
+        bool open(const std::string& cacheFile, uint64_t pathHash, uint64_t sourceSize, int64_t sourceMtime,
+                  VertexFormat format, bool colorStream);
+
+        // 指向映射内存的顶点流 CachedMesh销毁前有效
+        VertexStreamData getVertexStreams() const;
+
+        inline VertexFormat getVertexFormat() const {
+            return static_cast<VertexFormat>(header->vertexFormat);
+        }
+
+        inline bool hasColorStream() const {
+            return header->colorStream != 0;
+        }
+
+        inline const void* getIndexData() const {
+            return file.getData() + header->indexOffset;
+        }
+
+        inline uint32_t getVertexCount() const {
+            return header->vertexCount;
+        }
+
+        inline uint32_t getIndexCount() const {
+            return header->indexCount;
+        }
+
+        inline VkIndexType getIndexType() const {
+            return header->indexSize == sizeof(uint16_t) ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+        }
+
+        inline std::vector<MeshLod> getLods() const {
+            auto lods = reinterpret_cast<const MeshLod*>(file.getData() + header->lodOffset);
+            return std::vector<MeshLod>(lods, lods + header->lodCount);
+        }
+
+        inline std::vector<Meshlet> getMeshlets() const {
+            auto meshlets = reinterpret_cast<const Meshlet*>(file.getData() + header->meshletOffset);
+            return std::vector<Meshlet>(meshlets, meshlets + header->meshletCount);
+        }
+
+        inline std::vector<Submesh> getSubmeshes() const {
+            auto submeshes = reinterpret_cast<const Submesh*>(file.getData() + header->submeshOffset);
+            return std::vector<Submesh>(submeshes, submeshes + header->submeshCount);
+        }
+
+        inline std::vector<MaterialInfo> getMaterials() const {
+            auto materials = reinterpret_cast<const MaterialInfo*>(file.getData() + header->materialOffset);
+            return std::vector<MaterialInfo>(materials, materials + header->materialCount);
+        }
+
+        inline MeshBounds getBounds() const {
+            MeshBounds bounds{};
+            bounds.center = {header->boundsCenter[0], header->boundsCenter[1], header->boundsCenter[2]};
+            bounds.radius = header->boundsRadius;
+            return bounds;
+        }
+    };
+
+    // OBJ等源文件解析结果的磁盘缓存
+    // 以源文件路径与顶点格式作为键 源文件修改时间 大小变化都会使缓存失效 材质库文件同样参与校验
+    class MeshCache {
+    private:
+        static std::string cacheDirectory;
+
+        static bool querySource(const std::string& sourcePath, uint64_t& pathHash, uint64_t& sourceSize, int64_t& sourceMtime);
+        // 不同顶点格式的缓存分别存放 切换格式时互不覆盖
+        static std::string cacheFileOf(uint64_t pathHash, VertexFormat format, bool colorStream);
+    public:
+        static inline void setCacheDirectory(const std::string& directory) {
+            cacheDirectory = directory;
+        }
+
+        static inline const std::string& getCacheDirectory() {
+            return cacheDirectory;
+        }
+
+        // 命中返回映射后的网格 否则返回nullptr 缓存的顶点格式与要求的不同也视为未命中
+        static std::unique_ptr<CachedMesh> open(const std::string& sourcePath, VertexFormat format, bool colorStream);
+
+        // streams为按format拆分好的顶点流 libraryPath为解析时使用的材质库 没有时为空
+        static bool write(const std::string& sourcePath, const VertexStreams& streams, VertexFormat format,
+                          bool colorStream, uint32_t vertexCount,
+                          const void* indices, uint32_t indexCount, VkIndexType indexType,
+                          const std::vector<MeshLod>& lods, const MeshBounds& bounds,
+                          const std::vector<Meshlet>& meshlets, const std::vector<Submesh>& submeshes,
+                          const std::vector<MaterialInfo>& materials, const std::string& libraryPath);
+    };
+
+}
+
+#endif //VULKANTEST_MESHCACHE_H
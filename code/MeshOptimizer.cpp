@@ -0,0 +1,351 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+
+namespace jk {
+
+    // 以插入次数作为时间戳的FIFO缓存
+    // 顶点在第cachedAt次插入时进入缓存 之后再经过cacheSize次插入被挤出
+    class FifoCache {
+    private:
+        std::vector<uint32_t> cachedAt;
+        uint32_t clock;
+        uint32_t misses = 0;
+        uint32_t cacheSize;
+    public:
+        // 时钟从cacheSize+1开始 保证初始状态全部未命中
+        FifoCache(uint32_t vertexCount, uint32_t cacheSize)
+            : cachedAt(vertexCount, 0), clock(cacheSize + 1), cacheSize(cacheSize) {}
+
+        // 返回是否未命中
+        inline bool access(uint32_t v) {
+            if (clock - cachedAt[v] > cacheSize) {
+                cachedAt[v] = clock++;
+                misses++;
+                return true;
+            }
+            return false;
+        }
+
+        // 清空缓存
+        inline void reset() {
+            clock += cacheSize + 1;
+        }
+
+        inline uint32_t getMisses() const {
+            return misses;
+        }
+    };
+
+    VertexCacheStats MeshOptimizer::analyzeVertexCache(const uint32_t* indices, size_t indexCount, uint32_t vertexCount,
+                                                       uint32_t cacheSize) {
+        VertexCacheStats stats{};
+        if (indexCount == 0 || vertexCount == 0) {
+            return stats;
+        }
+
+        FifoCache cache(vertexCount, cacheSize);
+        std::vector<bool> used(vertexCount, false);
+        uint32_t uniqueCount = 0;
+        for (size_t i = 0; i < indexCount; i++) {
+            cache.access(indices[i]);
+            if (!used[indices[i]]) {
+                used[indices[i]] = true;
+                uniqueCount++;
+            }
+        }
+        stats.transformed = cache.getMisses();
+        stats.acmr = static_cast<float>(stats.transformed) / static_cast<float>(indexCount / 3);
+        stats.atvr = static_cast<float>(stats.transformed) / static_cast<float>(uniqueCount);
+        return stats;
+    }
+
+    void MeshOptimizer::optimizeVertexCache(std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize) {
+        // Tipsify: Sander et al. "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw"
+        size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0 || vertexCount == 0) {
+            return;
+        }
+
+        // 顶点->三角形邻接表
+        std::vector<uint32_t> liveCount(vertexCount, 0);
+        for (uint32_t index : indices) {
+            liveCount[index]++;
+        }
+        std::vector<uint32_t> adjacencyOffset(vertexCount + 1, 0);
+        for (uint32_t v = 0; v < vertexCount; v++) {
+            adjacencyOffset[v + 1] = adjacencyOffset[v] + liveCount[v];
+        }
+        std::vector<uint32_t> adjacency(indices.size());
+        {
+            std::vector<uint32_t> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+            for (size_t t = 0; t < triangleCount; t++) {
+                for (int k = 0; k < 3; k++) {
+                    adjacency[fill[indices[t * 3 + k]]++] = static_cast<uint32_t>(t);
+                }
+            }
+        }
+
+        std::vector<uint32_t> cacheTime(vertexCount, 0);
+        std::vector<bool> emitted(triangleCount, false);
+        std::vector<uint32_t> deadEnd;
+        std::vector<uint32_t> candidates;
+        deadEnd.reserve(indices.size());
+        candidates.reserve(64);
+
+        std::vector<uint32_t> result;
+        result.reserve(indices.size());
+
+        uint32_t time = cacheSize + 1;
+        uint32_t cursor = 0;
+        int64_t fanning = 0;
+
+        while (fanning >= 0) {
+            uint32_t f = static_cast<uint32_t>(fanning);
+            candidates.clear();
+
+            // 以f为中心发射所有未输出的三角形
+            for (uint32_t a = adjacencyOffset[f]; a < adjacencyOffset[f + 1]; a++) {
+                uint32_t t = adjacency[a];
+                if (emitted[t]) {
+                    continue;
+                }
+                for (int k = 0; k < 3; k++) {
+                    uint32_t v = indices[t * 3 + k];
+                    result.push_back(v);
+                    deadEnd.push_back(v);
+                    candidates.push_back(v);
+                    liveCount[v]--;
+                    if (time - cacheTime[v] > cacheSize) {
+                        cacheTime[v] = time++;
+                    }
+                }
+                emitted[t] = true;
+            }
+
+            // 选下一个中心: 优先选仍在缓存中且发射后不会被挤出的顶点
+            fanning = -1;
+            int64_t bestPriority = -1;
+            for (uint32_t v : candidates) {
+                if (liveCount[v] == 0) {
+                    continue;
+                }
+                int64_t priority = 0;
+                if (static_cast<int64_t>(time) - cacheTime[v] + 2 * static_cast<int64_t>(liveCount[v]) <= cacheSize) {
+                    priority = static_cast<int64_t>(time) - cacheTime[v];
+                }
+                if (priority > bestPriority) {
+                    bestPriority = priority;
+                    fanning = v;
+                }
+            }
+
+            if (fanning < 0) {
+                // 死胡同 先回溯最近用过的顶点 再顺序扫描
+                while (!deadEnd.empty()) {
+                    uint32_t d = deadEnd.back();
+                    deadEnd.pop_back();
+                    if (liveCount[d] > 0) {
+                        fanning = d;
+                        break;
+                    }
+                }
+                while (fanning < 0 && cursor < vertexCount) {
+                    if (liveCount[cursor] > 0) {
+                        fanning = cursor;
+                    }
+                    cursor++;
+                }
+            }
+        }
+
+        indices.swap(result);
+    }
+
+    void MeshOptimizer::optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices,
+                                         float threshold, uint32_t cacheSize) {
+        size_t triangleCount = indices.size() / 3;
+        if (triangleCount < 2) {
+            return;
+        }
+        auto vertexCount = static_cast<uint32_t>(vertices.size());
+        float meshAcmr = analyzeVertexCache(indices.data(), indices.size(), vertexCount, cacheSize).acmr;
+
+        // 划分簇: 三个顶点全部未命中处是天然的边界
+        // 簇内ACMR已经足够低时也可以切开 因为新簇从空缓存开始 代价有限
+        std::vector<uint32_t> clusters;
+        FifoCache cache(vertexCount, cacheSize);
+        uint32_t clusterStart = 0;
+        uint32_t clusterMisses = 0;
+        for (size_t t = 0; t < triangleCount; t++) {
+            uint32_t misses = 0;
+            for (int k = 0; k < 3; k++) {
+                misses += cache.access(indices[t * 3 + k]) ? 1 : 0;
+            }
+            if (t == 0 || misses == 3) {
+                // 软边界之后缓存为空 第一个三角形必然全部未命中
+                if (clusters.empty() || clusters.back() != t) {
+                    clusters.push_back(static_cast<uint32_t>(t));
+                }
+                clusterStart = static_cast<uint32_t>(t);
+                clusterMisses = misses;
+                continue;
+            }
+            clusterMisses += misses;
+            uint32_t clusterTriangles = static_cast<uint32_t>(t) - clusterStart + 1;
+            if (t + 1 < triangleCount &&
+                static_cast<float>(clusterMisses) / clusterTriangles <= threshold * meshAcmr) {
+                clusters.push_back(static_cast<uint32_t>(t + 1));
+                clusterStart = static_cast<uint32_t>(t + 1);
+                clusterMisses = 0;
+                cache.reset();
+            }
+        }
+        clusters.push_back(static_cast<uint32_t>(triangleCount));
+        size_t clusterCount = clusters.size() - 1;
+        if (clusterCount < 2) {
+            return;
+        }
+
+        // 面积加权的网格中心
+        glm::vec3 meshCenter{0.0f};
+        float meshArea = 0.0f;
+        for (size_t t = 0; t < triangleCount; t++) {
+            const glm::vec3& p0 = vertices[indices[t * 3 + 0]].pos;
+            const glm::vec3& p1 = vertices[indices[t * 3 + 1]].pos;
+            const glm::vec3& p2 = vertices[indices[t * 3 + 2]].pos;
+            float area = glm::length(glm::cross(p1 - p0, p2 - p0));
+            meshCenter += (p0 + p1 + p2) * (area / 3.0f);
+            meshArea += area;
+        }
+        meshCenter = meshArea > 0.0f ? meshCenter / meshArea : glm::vec3(0.0f);
+
+        // 簇中心相对网格中心在簇平均法线上的投影 越大越靠外 越应该先画
+        std::vector<float> sortKey(clusterCount);
+        for (size_t c = 0; c < clusterCount; c++) {
+            glm::vec3 center{0.0f};
+            glm::vec3 normal{0.0f};
+            float area = 0.0f;
+            for (uint32_t t = clusters[c]; t < clusters[c + 1]; t++) {
+                const glm::vec3& p0 = vertices[indices[t * 3 + 0]].pos;
+                const glm::vec3& p1 = vertices[indices[t * 3 + 1]].pos;
+                const glm::vec3& p2 = vertices[indices[t * 3 + 2]].pos;
+                glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+                float a = glm::length(n);
+                center += (p0 + p1 + p2) * (a / 3.0f);
+                normal += n;
+                area += a;
+            }
+            float normalLength = glm::length(normal);
+            if (area <= 0.0f || normalLength <= 0.0f) {
+                sortKey[c] = 0.0f;
+                continue;
+            }
+            sortKey[c] = glm::dot(center / area - meshCenter, normal / normalLength);
+        }
+
+        std::vector<uint32_t> order(clusterCount);
+        for (uint32_t c = 0; c < clusterCount; c++) {
+            order[c] = c;
+        }
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+            return sortKey[a] > sortKey[b];
+        });
+
+        std::vector<uint32_t> result;
+        result.reserve(indices.size());
+        for (uint32_t c : order) {
+            result.insert(result.end(), indices.begin() + clusters[c] * 3, indices.begin() + clusters[c + 1] * 3);
+        }
+        indices.swap(result);
+    }
+
+    void MeshOptimizer::optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+        const uint32_t unused = UINT32_MAX;
+        std::vector<uint32_t> remap(vertices.size(), unused);
+        std::vector<Vertex> result;
+        result.reserve(vertices.size());
+        for (uint32_t& index : indices) {
+            if (remap[index] == unused) {
+                remap[index] = static_cast<uint32_t>(result.size());
+                result.push_back(vertices[index]);
+            }
+            index = remap[index];
+        }
+        vertices.swap(result);
+    }
+
+    void MeshOptimizer::optimize(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+                                 const std::string& name, bool overdraw) {
+        std::vector<Submesh> parts(1);
+        parts[0].indexCount = static_cast<uint32_t>(indices.size());
+        optimize(vertices, indices, parts, name, overdraw);
+    }
+
+    void MeshOptimizer::optimize(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+                                 const std::vector<Submesh>& parts, const std::string& name, bool overdraw) {
+        if (indices.size() < 3) {
+            return;
+        }
+        auto vertexCount = static_cast<uint32_t>(vertices.size());
+        VertexCacheStats before{};
+        if (!name.empty()) {
+            before = analyzeVertexCache(indices.data(), indices.size(), vertexCount);
+        }
+
+        if (parts.size() == 1 && parts[0].firstIndex == 0 && parts[0].indexCount == indices.size()) {
+            optimizeVertexCache(indices, vertexCount);
+            if (overdraw) {
+                optimizeOverdraw(indices, vertices);
+            }
+        } else {
+            // 每个子网格先映射到局部的顶点编号 重排时的数组只与子网格大小有关
+            // 全局到局部的映射整个模型只分配一次 每个子网格结束后只重置用到的项
+            const uint32_t unused = UINT32_MAX;
+            std::vector<uint32_t> localIndex(vertexCount, unused);
+            std::vector<uint32_t> localToGlobal;
+            std::vector<Vertex> localVertices;
+            std::vector<uint32_t> part;
+            for (const auto& range : parts) {
+                part.assign(indices.begin() + range.firstIndex, indices.begin() + range.firstIndex + range.indexCount);
+                localToGlobal.clear();
+                for (uint32_t& index : part) {
+                    if (localIndex[index] == unused) {
+                        localIndex[index] = static_cast<uint32_t>(localToGlobal.size());
+                        localToGlobal.push_back(index);
+                    }
+                    index = localIndex[index];
+                }
+                optimizeVertexCache(part, static_cast<uint32_t>(localToGlobal.size()));
+                if (overdraw) {
+                    localVertices.clear();
+                    for (uint32_t v : localToGlobal) {
+                        localVertices.push_back(vertices[v]);
+                    }
+                    optimizeOverdraw(part, localVertices);
+                }
+                for (size_t i = 0; i < part.size(); i++) {
+                    indices[range.firstIndex + i] = localToGlobal[part[i]];
+                }
+                for (uint32_t v : localToGlobal) {
+                    localIndex[v] = unused;
+                }
+            }
+        }
+        optimizeVertexFetch(vertices, indices);
+
+        if (!name.empty()) {
+            report(name, before, analyzeVertexCache(indices.data(), indices.size(), static_cast<uint32_t>(vertices.size())));
+        }
+    }
+
+    void MeshOptimizer::report(const std::string& name, const VertexCacheStats& before, const VertexCacheStats& after) {
+        std::cout << "[MeshOptimizer] " << name << ": " << std::fixed << std::setprecision(3)
+                  << "ACMR " << before.acmr << " -> " << after.acmr
+                  << ", ATVR " << before.atvr << " -> " << after.atvr
+                  << " (cache " << DEFAULT_CACHE_SIZE << ")" << std::defaultfloat << std::endl;
+    }
+
+}
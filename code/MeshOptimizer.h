@@ -0,0 +1,54 @@
+#ifndef VULKANTEST_MESHOPTIMIZER_H
+#define VULKANTEST_MESHOPTIMIZER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Vertex.h"
+#include "Submesh.h"
+
+namespace jk {
+
+    // FIFO顶点缓存模拟结果
+    struct VertexCacheStats {
+        uint32_t transformed = 0;   // 顶点着色器调用次数
+        float acmr = 0.0f;          // 每个三角形的平均缓存未命中
+        float atvr = 0.0f;          // 顶点调用次数/实际顶点数 理想值为1
+    };
+
+    // 导入时的网格优化 只处理焊接后的索引网格
+    // 依次是三角形重排(Tipsify) 按簇排序减少overdraw 顶点按首次使用重排
+    class MeshOptimizer {
+    public:
+        static const uint32_t DEFAULT_CACHE_SIZE = 16;
+
+        // 重排三角形提高post-transform缓存命中率
+        static void optimizeVertexCache(std::vector<uint32_t>& indices, uint32_t vertexCount,
+                                        uint32_t cacheSize = DEFAULT_CACHE_SIZE);
+
+        // 在缓存友好的顺序上按簇排序 朝外的簇先画 threshold为允许的ACMR恶化比例
+        static void optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices,
+                                     float threshold = 1.05f, uint32_t cacheSize = DEFAULT_CACHE_SIZE);
+
+        // 按索引首次出现的顺序重排顶点 未被引用的顶点会被丢弃
+        static void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+
+        static VertexCacheStats analyzeVertexCache(const uint32_t* indices, size_t indexCount, uint32_t vertexCount,
+                                                   uint32_t cacheSize = DEFAULT_CACHE_SIZE);
+
+        // 打印优化前后的ACMR/ATVR 之后还有其它重排(如网格簇)时由调用者在最后打印
+        static void report(const std::string& name, const VertexCacheStats& before, const VertexCacheStats& after);
+
+        // 完整流程 name非空时打印优化前后的ACMR/ATVR
+        static void optimize(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+                             const std::string& name = "", bool overdraw = true);
+
+        // 三角形只在各自的子网格内重排 子网格之间的边界保持不变
+        static void optimize(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+                             const std::vector<Submesh>& parts, const std::string& name = "", bool overdraw = true);
+    };
+
+}
+
+#endif //VULKANTEST_MESHOPTIMIZER_H
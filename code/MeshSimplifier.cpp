@@ -0,0 +1,336 @@
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+namespace jk {
+
+    // 对称4x4误差矩阵 只存上三角
+    struct Quadric {
+        double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+        double a11 = 0, a12 = 0, a13 = 0;
+        double a22 = 0, a23 = 0;
+        double a33 = 0;
+        double weight = 0;
+
+        static Quadric fromPlane(double a, double b, double c, double d, double weight) {
+            Quadric q;
+            q.a00 = a * a * weight; q.a01 = a * b * weight; q.a02 = a * c * weight; q.a03 = a * d * weight;
+            q.a11 = b * b * weight; q.a12 = b * c * weight; q.a13 = b * d * weight;
+            q.a22 = c * c * weight; q.a23 = c * d * weight;
+            q.a33 = d * d * weight;
+            q.weight = weight;
+            return q;
+        }
+
+        Quadric& operator+=(const Quadric& q) {
+            a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+            a11 += q.a11; a12 += q.a12; a13 += q.a13;
+            a22 += q.a22; a23 += q.a23;
+            a33 += q.a33;
+            weight += q.weight;
+            return *this;
+        }
+
+        // v^T Q v 除以总面积 得到平均的平方距离
+        double error(const glm::vec3& p) const {
+            double x = p.x, y = p.y, z = p.z;
+            double e = a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z + 2 * a03 * x
+                     + a11 * y * y + 2 * a12 * y * z + 2 * a13 * y
+                     + a22 * z * z + 2 * a23 * z
+                     + a33;
+            return e > 0 && weight > 0 ? e / weight : 0;
+        }
+    };
+
+    struct Collapse {
+        uint32_t src;
+        uint32_t dst;
+        double cost;
+    };
+
+    struct PositionHash {
+        size_t operator()(const glm::vec3& p) const {
+            uint32_t bits[3];
+            memcpy(bits, &p, sizeof(bits));
+            return (static_cast<size_t>(bits[0]) * 73856093u) ^ (static_cast<size_t>(bits[1]) * 19349663u) ^
+                   (static_cast<size_t>(bits[2]) * 83492791u);
+        }
+    };
+
+    static inline uint64_t edgeKey(uint32_t a, uint32_t b) {
+        return a < b ? (static_cast<uint64_t>(a) << 32) | b : (static_cast<uint64_t>(b) << 32) | a;
+    }
+
+    MeshBounds MeshSimplifier::computeBounds(const std::vector<Vertex>& vertices) {
+        MeshBounds bounds{};
+        if (vertices.empty()) {
+            return bounds;
+        }
+        // 以AABB中心为球心 足够紧且计算简单
+        glm::vec3 minPos = vertices[0].pos;
+        glm::vec3 maxPos = vertices[0].pos;
+        for (const auto& v : vertices) {
+            minPos = glm::min(minPos, v.pos);
+            maxPos = glm::max(maxPos, v.pos);
+        }
+        bounds.center = (minPos + maxPos) * 0.5f;
+        float radius2 = 0.0f;
+        for (const auto& v : vertices) {
+            glm::vec3 d = v.pos - bounds.center;
+            radius2 = std::max(radius2, glm::dot(d, d));
+        }
+        bounds.radius = std::sqrt(radius2);
+        return bounds;
+    }
+
+    float MeshSimplifier::simplify(const std::vector<Vertex>& vertices, const uint32_t* indices, size_t indexCount,
+                                   size_t targetIndexCount, float targetError, std::vector<uint32_t>& result) {
+        result.assign(indices, indices + indexCount);
+        size_t vertexCount = vertices.size();
+        if (indexCount <= targetIndexCount || vertexCount == 0) {
+            return 0.0f;
+        }
+
+        float radius = computeBounds(vertices).radius;
+        double errorLimit = static_cast<double>(targetError) * radius;
+        double errorLimit2 = errorLimit * errorLimit;
+
+        // 位置相同但属性不同的顶点位于接缝上
+        std::vector<bool> locked(vertexCount, false);
+        {
+            std::unordered_map<glm::vec3, uint32_t, PositionHash> firstAtPosition;
+            firstAtPosition.reserve(vertexCount);
+            for (size_t i = 0; i < indexCount; i++) {
+                uint32_t v = indices[i];
+                auto [it, inserted] = firstAtPosition.try_emplace(vertices[v].pos, v);
+                if (!inserted && it->second != v) {
+                    locked[v] = true;
+                    locked[it->second] = true;
+                }
+            }
+        }
+        // 只被一个三角形使用的边是开放边界
+        {
+            std::unordered_map<uint64_t, uint32_t> edgeUse;
+            edgeUse.reserve(indexCount);
+            for (size_t i = 0; i + 2 < indexCount; i += 3) {
+                for (int k = 0; k < 3; k++) {
+                    edgeUse[edgeKey(indices[i + k], indices[i + (k + 1) % 3])]++;
+                }
+            }
+            for (const auto& [key, count] : edgeUse) {
+                if (count == 1) {
+                    locked[static_cast<uint32_t>(key >> 32)] = true;
+                    locked[static_cast<uint32_t>(key & 0xffffffffu)] = true;
+                }
+            }
+        }
+
+        // 面积加权的平面误差
+        std::vector<Quadric> quadrics(vertexCount);
+        for (size_t i = 0; i + 2 < indexCount; i += 3) {
+            const glm::vec3& p0 = vertices[indices[i + 0]].pos;
+            const glm::vec3& p1 = vertices[indices[i + 1]].pos;
+            const glm::vec3& p2 = vertices[indices[i + 2]].pos;
+            glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+            float area = glm::length(n);
+            if (area <= 0.0f) {
+                continue;
+            }
+            n /= area;
+            Quadric q = Quadric::fromPlane(n.x, n.y, n.z, -glm::dot(n, p0), area);
+            for (int k = 0; k < 3; k++) {
+                quadrics[indices[i + k]] += q;
+            }
+        }
+
+        double maxError = 0.0;
+        std::vector<uint32_t> adjacencyOffset(vertexCount + 1);
+        std::vector<uint32_t> adjacency;
+        std::vector<uint32_t> remap(vertexCount);
+        std::vector<bool> touched(vertexCount);
+        std::vector<Collapse> collapses;
+
+        // 每一轮按代价从低到高折叠互不相邻的边
+        while (result.size() > targetIndexCount) {
+            size_t triangleCount = result.size() / 3;
+
+            std::fill(adjacencyOffset.begin(), adjacencyOffset.end(), 0);
+            for (uint32_t v : result) {
+                adjacencyOffset[v + 1]++;
+            }
+            for (size_t v = 0; v < vertexCount; v++) {
+                adjacencyOffset[v + 1] += adjacencyOffset[v];
+            }
+            adjacency.resize(result.size());
+            {
+                std::vector<uint32_t> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+                for (size_t t = 0; t < triangleCount; t++) {
+                    for (int k = 0; k < 3; k++) {
+                        adjacency[fill[result[t * 3 + k]]++] = static_cast<uint32_t>(t);
+                    }
+                }
+            }
+
+            collapses.clear();
+            for (size_t t = 0; t < triangleCount; t++) {
+                for (int k = 0; k < 3; k++) {
+                    uint32_t a = result[t * 3 + k];
+                    uint32_t b = result[t * 3 + (k + 1) % 3];
+                    if (!locked[a]) {
+                        Quadric q = quadrics[a];
+                        q += quadrics[b];
+                        collapses.push_back({a, b, q.error(vertices[b].pos)});
+                    }
+                    if (!locked[b]) {
+                        Quadric q = quadrics[a];
+                        q += quadrics[b];
+                        collapses.push_back({b, a, q.error(vertices[a].pos)});
+                    }
+                }
+            }
+            if (collapses.empty()) {
+                break;
+            }
+            std::sort(collapses.begin(), collapses.end(), [](const Collapse& l, const Collapse& r) {
+                return l.cost < r.cost;
+            });
+
+            for (size_t v = 0; v < vertexCount; v++) {
+                remap[v] = static_cast<uint32_t>(v);
+            }
+            std::fill(touched.begin(), touched.end(), false);
+
+            size_t removedTriangles = 0;
+            size_t collapsed = 0;
+            for (const auto& c : collapses) {
+                if (c.cost > errorLimit2) {
+                    break;
+                }
+                if (touched[c.src] || touched[c.dst]) {
+                    continue;
+                }
+
+                // 折叠后src周围的三角形不能翻转
+                bool flipped = false;
+                size_t shared = 0;
+                for (uint32_t a = adjacencyOffset[c.src]; a < adjacencyOffset[c.src + 1] && !flipped; a++) {
+                    const uint32_t* tri = &result[adjacency[a] * 3];
+                    if (tri[0] == c.dst || tri[1] == c.dst || tri[2] == c.dst) {
+                        shared++;
+                        continue;
+                    }
+                    glm::vec3 p[3], q[3];
+                    for (int k = 0; k < 3; k++) {
+                        p[k] = vertices[tri[k]].pos;
+                        q[k] = tri[k] == c.src ? vertices[c.dst].pos : p[k];
+                    }
+                    glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+                    glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+                    flipped = glm::dot(before, after) <= 0.0f;
+                }
+                if (flipped) {
+                    continue;
+                }
+
+                remap[c.src] = c.dst;
+                quadrics[c.dst] += quadrics[c.src];
+                maxError = std::max(maxError, c.cost);
+                // src周围的顶点本轮都不再移动 保证翻转检查有效
+                for (uint32_t a = adjacencyOffset[c.src]; a < adjacencyOffset[c.src + 1]; a++) {
+                    const uint32_t* tri = &result[adjacency[a] * 3];
+                    touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = true;
+                }
+                collapsed++;
+                removedTriangles += shared;
+                if (result.size() - removedTriangles * 3 <= targetIndexCount) {
+                    break;
+                }
+            }
+            if (collapsed == 0) {
+                break;
+            }
+
+            // 应用折叠 去掉退化三角形
+            size_t write = 0;
+            for (size_t t = 0; t < triangleCount; t++) {
+                uint32_t a = remap[result[t * 3 + 0]];
+                uint32_t b = remap[result[t * 3 + 1]];
+                uint32_t c = remap[result[t * 3 + 2]];
+                if (a == b || b == c || a == c) {
+                    continue;
+                }
+                result[write++] = a;
+                result[write++] = b;
+                result[write++] = c;
+            }
+            result.resize(write);
+        }
+
+        return radius > 0.0f ? static_cast<float>(std::sqrt(maxError) / radius) : 0.0f;
+    }
+
+    void MeshSimplifier::buildLodChain(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+                                       std::vector<MeshLod>& lods, uint32_t maxLevels,
+                                       float reduction, float maxError) {
+        std::vector<Submesh> parts(1);
+        parts[0].indexCount = static_cast<uint32_t>(indices.size());
+        buildLodChain(vertices, indices, lods, parts, maxLevels, reduction, maxError);
+    }
+
+    void MeshSimplifier::buildLodChain(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+                                       std::vector<MeshLod>& lods, std::vector<Submesh>& parts,
+                                       uint32_t maxLevels, float reduction, float maxError) {
+        lods.clear();
+        lods.push_back({0, static_cast<uint32_t>(indices.size()), 0.0f});
+        size_t partCount = parts.size();
+        if (partCount == 0) {
+            return;
+        }
+
+        std::vector<uint32_t> source;
+        std::vector<uint32_t> simplified;
+        std::vector<uint32_t> level;
+        std::vector<Submesh> levelParts(partCount);
+        for (uint32_t l = 1; l < maxLevels; l++) {
+            const MeshLod& previous = lods.back();
+            const Submesh* previousParts = parts.data() + parts.size() - partCount;
+            auto levelStart = static_cast<uint32_t>(indices.size());
+            level.clear();
+            float error = 0.0f;
+            for (size_t p = 0; p < partCount; p++) {
+                // 在上一级的基础上继续简化 追加会使indices重新分配 先拷贝出来
+                source.assign(indices.begin() + previousParts[p].firstIndex,
+                              indices.begin() + previousParts[p].firstIndex + previousParts[p].indexCount);
+                auto target = static_cast<size_t>(static_cast<float>(source.size()) * reduction) / 3 * 3;
+                error = std::max(error, simplify(vertices, source.data(), source.size(), target, maxError, simplified));
+                MeshOptimizer::optimizeVertexCache(simplified, static_cast<uint32_t>(vertices.size()));
+                // 网格簇只建在LOD0上
+                levelParts[p] = {};
+                levelParts[p].firstIndex = levelStart + static_cast<uint32_t>(level.size());
+                levelParts[p].indexCount = static_cast<uint32_t>(simplified.size());
+                levelParts[p].materialId = previousParts[p].materialId;
+                level.insert(level.end(), simplified.begin(), simplified.end());
+            }
+
+            // 简化不动了就没必要继续
+            if (level.empty() || level.size() > static_cast<size_t>(previous.indexCount) * 9 / 10) {
+                break;
+            }
+
+            MeshLod lod{};
+            lod.firstIndex = levelStart;
+            lod.indexCount = static_cast<uint32_t>(level.size());
+            // 每级误差相对上一级 累加作为相对原始网格的保守估计
+            lod.error = previous.error + error;
+            lods.push_back(lod);
+            indices.insert(indices.end(), level.begin(), level.end());
+            parts.insert(parts.end(), levelParts.begin(), levelParts.end());
+        }
+    }
+
+}
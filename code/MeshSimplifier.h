@@ -0,0 +1,52 @@
+#ifndef VULKANTEST_MESHSIMPLIFIER_H
+#define VULKANTEST_MESHSIMPLIFIER_H
+
+#include <cstdint>
+#include <vector>
+
+#include "Vertex.h"
+#include "Submesh.h"
+
+namespace jk {
+
+    // 一级LOD在索引缓冲中的范围 各级共享同一个顶点缓冲
+    struct MeshLod {
+        uint32_t firstIndex = 0;
+        uint32_t indexCount = 0;
+        float error = 0.0f;     // 相对包围球半径的几何误差
+    };
+
+    // 模型空间包围球
+    struct MeshBounds {
+        glm::vec3 center{0.0f};
+        float radius = 0.0f;
+    };
+
+    // 基于二次误差度量(QEM)的边折叠简化
+    // 只把顶点折叠到已有顶点上 不产生新顶点 所以各级LOD可以共用顶点缓冲
+    // 纹理接缝与开放边界上的顶点被锁定 避免破坏uv与轮廓
+    class MeshSimplifier {
+    public:
+        // 把indices简化到targetIndexCount以下 或者误差达到targetError(相对包围球半径)为止
+        // 返回实际误差
+        static float simplify(const std::vector<Vertex>& vertices, const uint32_t* indices, size_t indexCount,
+                              size_t targetIndexCount, float targetError, std::vector<uint32_t>& result);
+
+        // 以indices为LOD0逐级简化 新的LOD依次追加在indices之后
+        // 三角形数减少不明显时提前结束
+        static void buildLodChain(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+                                  std::vector<MeshLod>& lods, uint32_t maxLevels = 4,
+                                  float reduction = 0.5f, float maxError = 0.1f);
+
+        // 分子网格逐级简化 parts开始时为LOD0的子网格
+        // 每生成一级就按相同顺序追加该级的子网格 材质沿用上一级 同一级的子网格在indices中连续存放
+        static void buildLodChain(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+                                  std::vector<MeshLod>& lods, std::vector<Submesh>& parts,
+                                  uint32_t maxLevels = 4, float reduction = 0.5f, float maxError = 0.1f);
+
+        static MeshBounds computeBounds(const std::vector<Vertex>& vertices);
+    };
+
+}
+
+#endif //VULKANTEST_MESHSIMPLIFIER_H
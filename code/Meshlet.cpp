@@ -0,0 +1,232 @@
+#include "Meshlet.h"
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace jk {
+
+    void MeshletBuilder::computeBounds(const std::vector<Vertex>& vertices, const uint32_t* indices, uint32_t indexCount,
+                                       Meshlet& meshlet) {
+        if (indexCount == 0) {
+            return;
+        }
+        glm::vec3 minPos = vertices[indices[0]].pos;
+        glm::vec3 maxPos = minPos;
+        for (uint32_t i = 1; i < indexCount; i++) {
+            minPos = glm::min(minPos, vertices[indices[i]].pos);
+            maxPos = glm::max(maxPos, vertices[indices[i]].pos);
+        }
+        glm::vec3 center = (minPos + maxPos) * 0.5f;
+        float radius2 = 0.0f;
+        for (uint32_t i = 0; i < indexCount; i++) {
+            glm::vec3 d = vertices[indices[i]].pos - center;
+            radius2 = std::max(radius2, glm::dot(d, d));
+        }
+        for (int k = 0; k < 3; k++) {
+            meshlet.center[k] = center[k];
+        }
+        meshlet.radius = std::sqrt(radius2);
+
+        // 法线锥 轴取各三角形法线的平均
+        uint32_t triangleCount = indexCount / 3;
+        std::vector<glm::vec3> normals(triangleCount, glm::vec3(0.0f));
+        glm::vec3 axis{0.0f};
+        for (uint32_t t = 0; t < triangleCount; t++) {
+            const glm::vec3& p0 = vertices[indices[t * 3 + 0]].pos;
+            const glm::vec3& p1 = vertices[indices[t * 3 + 1]].pos;
+            const glm::vec3& p2 = vertices[indices[t * 3 + 2]].pos;
+            glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+            float length = glm::length(n);
+            if (length <= 0.0f) {
+                continue;
+            }
+            normals[t] = n / length;
+            axis += normals[t];
+        }
+        meshlet.coneCutoff = 2.0f;
+        float axisLength = glm::length(axis);
+        if (axisLength <= 0.0f) {
+            return;
+        }
+        axis /= axisLength;
+
+        float minDot = 1.0f;
+        for (const auto& n : normals) {
+            if (n != glm::vec3(0.0f)) {
+                minDot = std::min(minDot, glm::dot(n, axis));
+            }
+        }
+        // 超过约84度的锥几乎不可能被剔除 不值得测试
+        if (minDot <= 0.1f) {
+            return;
+        }
+
+        // 锥顶沿轴反向移动到所有三角形平面的背面
+        float maxT = 0.0f;
+        for (uint32_t t = 0; t < triangleCount; t++) {
+            if (normals[t] == glm::vec3(0.0f)) {
+                continue;
+            }
+            const glm::vec3& p0 = vertices[indices[t * 3 + 0]].pos;
+            float dc = glm::dot(center - p0, normals[t]);
+            float dn = glm::dot(axis, normals[t]);
+            maxT = std::max(maxT, dc / dn);
+        }
+        glm::vec3 apex = center - axis * maxT;
+        for (int k = 0; k < 3; k++) {
+            meshlet.coneAxis[k] = axis[k];
+            meshlet.coneApex[k] = apex[k];
+        }
+        meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+    }
+
+    void MeshletBuilder::build(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+                               std::vector<Meshlet>& meshlets, uint32_t maxVertices, uint32_t maxTriangles) {
+        meshlets.clear();
+        build(vertices, indices, {0, static_cast<uint32_t>(indices.size())}, meshlets, maxVertices, maxTriangles);
+    }
+
+    void MeshletBuilder::build(const std::vector<Vertex>& vertices, std::vector<uint32_t>& allIndices, IndexRange range,
+                               std::vector<Meshlet>& meshlets, uint32_t maxVertices, uint32_t maxTriangles) {
+        const uint32_t* indices = allIndices.data() + range.firstIndex;
+        size_t triangleCount = range.indexCount / 3;
+        auto vertexCount = static_cast<uint32_t>(vertices.size());
+        if (triangleCount == 0 || vertexCount == 0) {
+            return;
+        }
+
+        // 顶点->三角形邻接表
+        std::vector<uint32_t> adjacencyOffset(vertexCount + 1, 0);
+        for (size_t i = 0; i < triangleCount * 3; i++) {
+            adjacencyOffset[indices[i] + 1]++;
+        }
+        for (uint32_t v = 0; v < vertexCount; v++) {
+            adjacencyOffset[v + 1] += adjacencyOffset[v];
+        }
+        std::vector<uint32_t> adjacency(triangleCount * 3);
+        {
+            std::vector<uint32_t> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+            for (size_t t = 0; t < triangleCount; t++) {
+                for (int k = 0; k < 3; k++) {
+                    adjacency[fill[indices[t * 3 + k]]++] = static_cast<uint32_t>(t);
+                }
+            }
+        }
+
+        std::vector<bool> emitted(triangleCount, false);
+        // 顶点最后一次被哪个簇使用 簇内重排时也作为局部编号
+        std::vector<uint32_t> owner(vertexCount, UINT32_MAX);
+        std::vector<uint32_t> localIndex(vertexCount, 0);
+        std::vector<uint32_t> localToGlobal;
+        std::vector<uint32_t> local;
+        std::vector<uint32_t> candidates;
+        std::vector<uint32_t> result;
+        result.reserve(triangleCount * 3);
+
+        uint32_t meshletIndex = 0;
+        uint32_t meshletVertices = 0;
+        uint32_t meshletTriangles = 0;
+        size_t cursor = 0;
+
+        auto newVertices = [&](uint32_t t) {
+            uint32_t count = 0;
+            for (int k = 0; k < 3; k++) {
+                count += owner[indices[t * 3 + k]] != meshletIndex ? 1 : 0;
+            }
+            return count;
+        };
+
+        auto flush = [&]() {
+            if (meshletTriangles == 0) {
+                return;
+            }
+            Meshlet meshlet{};
+            meshlet.indexCount = meshletTriangles * 3;
+            uint32_t offset = static_cast<uint32_t>(result.size()) - meshlet.indexCount;
+            // 按邻接关系收集的顺序会打乱之前的缓存优化 簇内按局部编号重新做一次三角形重排
+            localToGlobal.clear();
+            local.assign(result.begin() + offset, result.end());
+            for (uint32_t& index : local) {
+                if (localToGlobal.empty() || localIndex[index] >= localToGlobal.size() ||
+                    localToGlobal[localIndex[index]] != index) {
+                    localIndex[index] = static_cast<uint32_t>(localToGlobal.size());
+                    localToGlobal.push_back(index);
+                }
+                index = localIndex[index];
+            }
+            MeshOptimizer::optimizeVertexCache(local, static_cast<uint32_t>(localToGlobal.size()));
+            for (size_t i = 0; i < local.size(); i++) {
+                result[offset + i] = localToGlobal[local[i]];
+            }
+            meshlet.firstIndex = range.firstIndex + offset;
+            meshlet.vertexCount = meshletVertices;
+            computeBounds(vertices, result.data() + offset, meshlet.indexCount, meshlet);
+            meshlets.push_back(meshlet);
+            meshletIndex++;
+            meshletVertices = 0;
+            meshletTriangles = 0;
+            candidates.clear();
+        };
+
+        auto add = [&](uint32_t t) {
+            for (int k = 0; k < 3; k++) {
+                uint32_t v = indices[t * 3 + k];
+                result.push_back(v);
+                if (owner[v] == meshletIndex) {
+                    continue;
+                }
+                owner[v] = meshletIndex;
+                meshletVertices++;
+                for (uint32_t a = adjacencyOffset[v]; a < adjacencyOffset[v + 1]; a++) {
+                    if (!emitted[adjacency[a]]) {
+                        candidates.push_back(adjacency[a]);
+                    }
+                }
+            }
+            emitted[t] = true;
+            meshletTriangles++;
+        };
+
+        while (true) {
+            // 在相邻三角形中选新增顶点最少的 顺带清理已输出的候选
+            int64_t best = -1;
+            uint32_t bestNew = 4;
+            size_t live = 0;
+            for (size_t i = 0; i < candidates.size(); i++) {
+                uint32_t t = candidates[i];
+                if (emitted[t]) {
+                    continue;
+                }
+                candidates[live++] = t;
+                uint32_t count = newVertices(t);
+                if (count < bestNew) {
+                    best = t;
+                    bestNew = count;
+                }
+            }
+            candidates.resize(live);
+
+            // 没有相邻的三角形时沿原有顺序继续 原顺序本身已经有较好的局部性
+            if (best < 0) {
+                while (cursor < triangleCount && emitted[cursor]) {
+                    cursor++;
+                }
+                if (cursor == triangleCount) {
+                    break;
+                }
+                best = static_cast<int64_t>(cursor);
+                bestNew = newVertices(static_cast<uint32_t>(cursor));
+            }
+
+            if (meshletVertices + bestNew > maxVertices || meshletTriangles + 1 > maxTriangles) {
+                flush();
+            }
+            add(static_cast<uint32_t>(best));
+        }
+        flush();
+
+        std::copy(result.begin(), result.end(), allIndices.begin() + range.firstIndex);
+    }
+
+}
@@ -0,0 +1,55 @@
+#ifndef VULKANTEST_MESHLET_H
+#define VULKANTEST_MESHLET_H
+
+#include <cstdint>
+#include <vector>
+
+#include "Vertex.h"
+
+namespace jk {
+
+    // 索引缓冲中的一段连续范围
+    struct IndexRange {
+        uint32_t firstIndex = 0;
+        uint32_t indexCount = 0;
+    };
+
+    // 网格簇 对应LOD0索引中的一段连续三角形
+    // 用float数组存放 保证写入缓存文件的布局不受glm对齐设置影响
+    struct Meshlet {
+        uint32_t firstIndex = 0;
+        uint32_t indexCount = 0;
+        // 模型空间包围球
+        float center[3] = {};
+        float radius = 0.0f;
+        // 法线锥 视点位于锥内时整个簇都是背面
+        float coneAxis[3] = {};
+        float coneCutoff = 2.0f;    // 大于1表示法线过于发散 不做背面剔除
+        float coneApex[3] = {};
+        uint32_t vertexCount = 0;
+    };
+
+    class MeshletBuilder {
+    public:
+        static const uint32_t DEFAULT_MAX_VERTICES = 64;
+        static const uint32_t DEFAULT_MAX_TRIANGLES = 124;
+
+        // 从已有的三角形顺序出发 贪心地把相邻三角形并入当前簇
+        // indices会被重排为按簇连续存放 三角形集合不变 每个簇内再做一次缓存优化
+        static void build(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+                          std::vector<Meshlet>& meshlets,
+                          uint32_t maxVertices = DEFAULT_MAX_VERTICES, uint32_t maxTriangles = DEFAULT_MAX_TRIANGLES);
+
+        // 只重排range内的三角形 生成的簇追加到meshlets之后 簇不会跨越range的边界
+        static void build(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, IndexRange range,
+                          std::vector<Meshlet>& meshlets,
+                          uint32_t maxVertices = DEFAULT_MAX_VERTICES, uint32_t maxTriangles = DEFAULT_MAX_TRIANGLES);
+
+        // 计算一个簇的包围球与法线锥
+        static void computeBounds(const std::vector<Vertex>& vertices, const uint32_t* indices, uint32_t indexCount,
+                                  Meshlet& meshlet);
+    };
+
+}
+
+#endif //VULKANTEST_MESHLET_H
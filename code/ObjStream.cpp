@@ -0,0 +1,261 @@
+#include "ObjStream.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+
+namespace jk {
+
+    namespace {
+
+        enum Pool {
+            POSITION_POOL = 0,
+            TEXCOORD_POOL,
+            NORMAL_POOL,
+        };
+
+        const char* skipSpaces(const char* c) {
+            while (*c != '\0' && std::isspace(static_cast<unsigned char>(*c))) {
+                c++;
+            }
+            return c;
+        }
+
+        // 返回行首关键字对应的属性池 面返回-2 其它返回-1
+        int classify(const char*& c) {
+            c = skipSpaces(c);
+            if (c[0] == 'v') {
+                if (std::isspace(static_cast<unsigned char>(c[1]))) {
+                    c += 1;
+                    return POSITION_POOL;
+                }
+                if (c[1] == 't' && std::isspace(static_cast<unsigned char>(c[2]))) {
+                    c += 2;
+                    return TEXCOORD_POOL;
+                }
+                if (c[1] == 'n' && std::isspace(static_cast<unsigned char>(c[2]))) {
+                    c += 2;
+                    return NORMAL_POOL;
+                }
+            } else if (c[0] == 'f' && std::isspace(static_cast<unsigned char>(c[1]))) {
+                c += 1;
+                return -2;
+            }
+            return -1;
+        }
+
+        const uint32_t POOL_COMPONENTS[3] = {3, 2, 3};
+        const char* POOL_SUFFIX[3] = {".v", ".vt", ".vn"};
+
+    }
+
+    ObjStream::~ObjStream() {
+        removePools();
+    }
+
+    void ObjStream::removePools() {
+        for (int i = 0; i < 3; i++) {
+            pools[i].close();
+            if (!poolPaths[i].empty()) {
+                std::error_code ec;
+                std::filesystem::remove(poolPaths[i], ec);
+                poolPaths[i].clear();
+            }
+        }
+    }
+
+    bool ObjStream::open(const std::string& path) {
+        removePools();
+        file.close();
+        file.clear();
+        this->path = path;
+        positionCount = texCoordCount = normalCount = 0;
+        cornerCount = 0;
+        minPos = maxPos = glm::vec3(0.0f);
+        face.clear();
+        faceTriangle = 0;
+        error.clear();
+
+        file.open(path, std::ios::in);
+        if (!file) {
+            error = "failed to open " + path;
+            return false;
+        }
+
+        std::error_code ec;
+        auto directory = std::filesystem::temp_directory_path(ec);
+        if (ec) {
+            directory = std::filesystem::current_path();
+        }
+        std::string stem = "jk_objstream_" + std::to_string(std::hash<std::string>{}(path)) + "_" +
+                           std::to_string(reinterpret_cast<uintptr_t>(this));
+        std::ofstream outputs[3];
+        for (int i = 0; i < 3; i++) {
+            poolPaths[i] = (directory / (stem + POOL_SUFFIX[i])).string();
+            outputs[i].open(poolPaths[i], std::ios::binary | std::ios::trunc);
+            if (!outputs[i]) {
+                error = "failed to create temporary file " + poolPaths[i];
+                return false;
+            }
+        }
+
+        uint64_t* counts[3] = {&positionCount, &texCoordCount, &normalCount};
+        while (std::getline(file, line)) {
+            const char* c = line.c_str();
+            int kind = classify(c);
+            if (kind >= 0) {
+                float values[3] = {};
+                for (uint32_t k = 0; k < POOL_COMPONENTS[kind]; k++) {
+                    char* end = nullptr;
+                    values[k] = std::strtof(c, &end);
+                    c = end;
+                }
+                outputs[kind].write(reinterpret_cast<const char*>(values), sizeof(float) * POOL_COMPONENTS[kind]);
+                if (kind == POSITION_POOL) {
+                    glm::vec3 p{values[0], values[1], values[2]};
+                    minPos = positionCount == 0 ? p : glm::min(minPos, p);
+                    maxPos = positionCount == 0 ? p : glm::max(maxPos, p);
+                }
+                (*counts[kind])++;
+            } else if (kind == -2) {
+                uint64_t n = 0;
+                while (*(c = skipSpaces(c)) != '\0') {
+                    n++;
+                    while (*c != '\0' && !std::isspace(static_cast<unsigned char>(*c))) {
+                        c++;
+                    }
+                }
+                if (n >= 3) {
+                    cornerCount += (n - 2) * 3;
+                }
+            }
+        }
+
+        for (int i = 0; i < 3; i++) {
+            outputs[i].close();
+            if (*counts[i] > 0 && !pools[i].open(poolPaths[i])) {
+                error = "failed to map temporary file " + poolPaths[i];
+                return false;
+            }
+        }
+        if (positionCount == 0) {
+            error = path + " has no vertices";
+            return false;
+        }
+
+        // 第二遍重新计数 相对索引按读到该行时已有的数量解析
+        positionCount = texCoordCount = normalCount = 0;
+        file.clear();
+        file.seekg(0);
+        return true;
+    }
+
+    bool ObjStream::parseFace(const char* c) {
+        face.clear();
+        faceTriangle = 0;
+
+        // 1开始 负数为相对索引 缺省为-1
+        auto resolve = [](int64_t index, uint64_t count) -> int64_t {
+            if (index > 0) {
+                return index - 1;
+            }
+            return index < 0 ? static_cast<int64_t>(count) + index : -2;
+        };
+
+        while (*(c = skipSpaces(c)) != '\0') {
+            char* end = nullptr;
+            Corner corner{-1, -1, -1};
+            corner.position = resolve(std::strtoll(c, &end, 10), positionCount);
+            if (end == c) {
+                error = "invalid face in " + path + ": " + line;
+                return false;
+            }
+            c = end;
+            if (*c == '/') {
+                c++;
+                if (*c != '/') {
+                    corner.texCoord = resolve(std::strtoll(c, &end, 10), texCoordCount);
+                    c = end;
+                }
+                if (*c == '/') {
+                    c++;
+                    corner.normal = resolve(std::strtoll(c, &end, 10), normalCount);
+                    c = end;
+                }
+            }
+            face.push_back(corner);
+        }
+        return true;
+    }
+
+    bool ObjStream::emitCorner(const Corner& corner, std::vector<Vertex>& vertices) {
+        if (corner.position < 0 || static_cast<uint64_t>(corner.position) >= positionCount ||
+            corner.texCoord < -1 || corner.texCoord >= static_cast<int64_t>(texCoordCount) ||
+            corner.normal < -1 || corner.normal >= static_cast<int64_t>(normalCount)) {
+            error = "face index out of range in " + path + ": " + line;
+            return false;
+        }
+
+        // 与SimpleObj::parse中的转换保持一致
+        Vertex vertex{};
+        auto pool = [this](int kind, int64_t index) {
+            return reinterpret_cast<const float*>(pools[kind].getData()) + index * POOL_COMPONENTS[kind];
+        };
+        const float* p = pool(POSITION_POOL, corner.position);
+        vertex.pos = {p[0], p[1], p[2]};
+        if (corner.texCoord >= 0) {
+            const float* t = pool(TEXCOORD_POOL, corner.texCoord);
+            vertex.texCoord = {t[0], 1.0f - t[1]};
+        } else {
+            vertex.texCoord = {0.0f, 0.0f};
+        }
+        if (corner.normal >= 0) {
+            const float* n = pool(NORMAL_POOL, corner.normal);
+            vertex.normal = {n[0], n[1], n[2]};
+        } else {
+            vertex.normal = {0.0f, 0.0f, 0.0f};
+        }
+        vertex.color = {1.0f, 1.0f, 1.0f};
+        vertices.push_back(vertex);
+        return true;
+    }
+
+    bool ObjStream::read(std::vector<Vertex>& vertices, uint32_t maxVertices) {
+        vertices.clear();
+        maxVertices -= maxVertices % 3;
+        if (maxVertices == 0) {
+            error = "chunk must hold at least one triangle";
+        }
+        if (failed()) {
+            return false;
+        }
+
+        uint64_t* counts[3] = {&positionCount, &texCoordCount, &normalCount};
+        while (vertices.size() + 3 <= maxVertices) {
+            // 一个面可能跨越多个块
+            if (face.size() >= 3 && faceTriangle < face.size() - 2) {
+                if (!emitCorner(face[0], vertices) ||
+                    !emitCorner(face[faceTriangle + 1], vertices) ||
+                    !emitCorner(face[faceTriangle + 2], vertices)) {
+                    return false;
+                }
+                faceTriangle++;
+                continue;
+            }
+            if (!std::getline(file, line)) {
+                break;
+            }
+            const char* c = line.c_str();
+            int kind = classify(c);
+            if (kind >= 0) {
+                (*counts[kind])++;
+            } else if (kind == -2 && !parseFace(c)) {
+                return false;
+            }
+        }
+        return !vertices.empty();
+    }
+
+}
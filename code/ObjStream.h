@@ -0,0 +1,86 @@
+#ifndef VULKANTEST_OBJSTREAM_H
+#define VULKANTEST_OBJSTREAM_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "Vertex.h"
+#include "MeshCache.h"
+
+namespace jk {
+
+    // 分块读取超大obj 用于内存放不下整个模型的场景
+    // 第一遍扫描把v/vt/vn写入临时文件并映射 统计三角形角点数与包围盒
+    // 第二遍按面展开为不焊接的三角形列表 每次最多输出一块
+    // 常驻内存只有一块顶点与一行文本 属性池由操作系统按页换入换出
+    class ObjStream {
+    private:
+        std::string path;
+        std::ifstream file;
+        std::string line;
+
+        // 属性池 临时文件中依次存放float
+        std::string poolPaths[3];
+        MappedFile pools[3];
+        uint64_t positionCount = 0;
+        uint64_t texCoordCount = 0;
+        uint64_t normalCount = 0;
+
+        uint64_t cornerCount = 0;
+        glm::vec3 minPos{0.0f};
+        glm::vec3 maxPos{0.0f};
+
+        // 当前正在展开的面 按扇形三角化
+        struct Corner {
+            int64_t position;
+            int64_t texCoord;
+            int64_t normal;
+        };
+        std::vector<Corner> face;
+        size_t faceTriangle = 0;
+
+        std::string error;
+
+        bool parseFace(const char* cursor);
+        bool emitCorner(const Corner& corner, std::vector<Vertex>& vertices);
+        void removePools();
+    public:
+        ObjStream() = default;
+        ~ObjStream();
+
+        ObjStream(const ObjStream&) = delete;
+        ObjStream& operator=(const ObjStream&) = delete;
+
+        // 第一遍扫描 失败时getError()给出原因
+        bool open(const std::string& path);
+
+        // 清空vertices后填入不超过maxVertices个顶点(三的倍数) 读完后返回false
+        bool read(std::vector<Vertex>& vertices, uint32_t maxVertices);
+
+        // 展开后的顶点总数 即三角形数的三倍
+        inline uint64_t getCornerCount() const {
+            return cornerCount;
+        }
+
+        inline const glm::vec3& getMinPosition() const {
+            return minPos;
+        }
+
+        inline const glm::vec3& getMaxPosition() const {
+            return maxPos;
+        }
+
+        inline bool failed() const {
+            return !error.empty();
+        }
+
+        inline const std::string& getError() const {
+            return error;
+        }
+    };
+
+}
+
+#endif //VULKANTEST_OBJSTREAM_H
@@ -43,6 +43,23 @@ namespace jk {
             i++;
         }
 
+        // 优先选择只支持传输的队列族 通常对应独立的DMA引擎 其次是不支持图形的队列族
+        // 纹理按行分块拷贝 要求图像传输粒度为1
+        for (uint32_t family = 0; family < queueFamilyCount; family++) {
+            VkQueueFlags flags = queueFamilies[family].queueFlags;
+            VkExtent3D granularity = queueFamilies[family].minImageTransferGranularity;
+            if (!(flags & VK_QUEUE_TRANSFER_BIT) || (flags & VK_QUEUE_GRAPHICS_BIT) ||
+                granularity.width != 1 || granularity.height != 1 || granularity.depth != 1) {
+                continue;
+            }
+            if (!indices.transferFamily.has_value() || !(flags & VK_QUEUE_COMPUTE_BIT)) {
+                indices.transferFamily = family;
+            }
+        }
+        if (!indices.transferFamily.has_value()) {
+            indices.transferFamily = indices.graphicsFamily;
+        }
+
         return indices;
     }
 
@@ -26,6 +26,8 @@ namespace jk {
     struct QueueFamilyIndices {
         std::optional<uint32_t> graphicsFamily;
         std::optional<uint32_t> presentFamily;
+        // 上传使用的队列族 没有独立的传输队列族时与图形队列族相同
+        std::optional<uint32_t> transferFamily;
 
         bool isComplete() {
             return graphicsFamily.has_value() && presentFamily.has_value();
@@ -1,12 +1,21 @@
 #include "RenderBatchManager.h"
 #include "VulkanApp.h"
 
+#include <algorithm>
+#include <cstring>
+
 namespace jk {
 
     void RenderBatch::cleanup(VkDevice& device){
-        for (auto& [resID, renderObject] : renderObjectPool.getResources()) {
-            std::static_pointer_cast<RenderObject>(renderObject)->cleanup(device);
-        }
+        renderObjectPool.forEach<RenderObject>([&](RenderObject* renderObject) {
+            renderObject->cleanup(device);
+        });
+    }
+
+    void RenderBatch::publishRenderObjects(DeletionQueue* deletionQueue) {
+        renderObjectPool.publish([deletionQueue](std::shared_ptr<IResource> renderObject) {
+            deletionQueue->push(renderObject);
+        });
     }
 
     RenderBatchManager::RenderBatchManager(VulkanApp* app, Shader& shader) : 
@@ -36,7 +45,8 @@ namespace jk {
         if (renderBatch == nullptr) {
             return;
         }
-        renderBatch->destroyRenderObject(renderObject->getID(), device);
+        // 正在执行的帧可能还在绘制它
+        app->getDeletionQueue()->push(renderBatch->detachRenderObject(renderObject->getID()));
     }
 
     std::shared_ptr<RenderObject> RenderBatchManager::getRenderObject(uint32_t batchID, uint32_t resID) {
@@ -47,15 +57,110 @@ namespace jk {
         return renderBatch->getRenderObject(resID);
     }
 
+    uint64_t RenderBatchManager::makeSortKey(uint32_t batchRank, RenderObject* object, FrameInfo& frame) {
+        uint64_t pass = frame.depthOnly ? 1 : 0;
+        uint64_t pipeline = shader.getID() & 0xFF;
+        uint64_t batchKey = std::min<uint32_t>(batchRank, 0xFFF);
+        // 深度pass不绑定材质
+        uint64_t material = frame.depthOnly ? 0 : rankOf(materialRanks, static_cast<uint32_t>(object->getMaterialIndex()));
+        uint64_t mesh = rankOf(meshRanks, object->getModelBufferID());
+        // 非负浮点数的位模式与数值同序 取高16位即可覆盖很大的距离范围
+        float distance = glm::distance(glm::vec3(object->modelMatrix()[3]), frame.lodView.position);
+        uint32_t bits;
+        memcpy(&bits, &distance, sizeof(bits));
+        uint64_t depth = bits >> 16;
+        return pass << 60 | pipeline << 52 | batchKey << 40 | material << 28 | mesh << 16 | depth;
+    }
+
+    void RenderBatchManager::sortDrawList() {
+        size_t count = drawList.size();
+        sortScratch.resize(count);
+        for (uint32_t shift = 0; shift < 64; shift += 8) {
+            size_t offsets[256] = {};
+            for (auto& item : drawList) {
+                offsets[(item.key >> shift) & 0xFF]++;
+            }
+            if (offsets[(drawList[0].key >> shift) & 0xFF] == count) {
+                continue;
+            }
+            size_t sum = 0;
+            for (auto& offset : offsets) {
+                size_t n = offset;
+                offset = sum;
+                sum += n;
+            }
+            for (auto& item : drawList) {
+                sortScratch[offsets[(item.key >> shift) & 0xFF]++] = item;
+            }
+            drawList.swap(sortScratch);
+        }
+    }
+
+    StateChangeCounts RenderBatchManager::countStateChanges() const {
+        StateChangeCounts counts;
+        const DrawItem* previous = nullptr;
+        for (auto& item : drawList) {
+            if (previous == nullptr || item.batch != previous->batch) {
+                counts.descriptorSets++;
+            }
+            if (previous == nullptr || item.object->getMaterialIndex() != previous->object->getMaterialIndex()) {
+                counts.materials++;
+            }
+            if (previous == nullptr || item.object->getModelBufferID() != previous->object->getModelBufferID()) {
+                counts.meshes++;
+            }
+            previous = &item;
+        }
+        return counts;
+    }
+
+    uint32_t RenderBatchManager::getRenderObjectCount() {
+        uint32_t count = 0;
+        for (auto& [batchID, pair] : renderBatchMap) {
+            auto renderBatch = static_cast<RenderBatch*>(resourceHelper.getRawResource(batchID));
+            if (renderBatch != nullptr) {
+                count += renderBatch->getRenderObjectCount();
+            }
+        }
+        return count;
+    }
+
     void RenderBatchManager::drawBatches(FrameInfo &frame) {
         shader.bind(frame.commandBuffer);
+        drawList.clear();
+        meshRanks.clear();
+        materialRanks.clear();
+        uint32_t batchRank = 0;
         for (auto& [batchID, pair] : renderBatchMap) {
-            auto renderBatch = std::static_pointer_cast<RenderBatch>(resourceHelper.getResource(batchID));
-            // auto bacthDescriptors = renderBatch->descriptorSets;
-            // descriptorSetsGroup[1] = bacthDescriptors->getDescriptorSets()[frame.currentFrame];
-            // vkCmdBindDescriptorSets(frame.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, 
-            //                         shader.getPipelineLayout(), 0, descriptorSetsGroup.size(), descriptorSetsGroup.data(), 0, nullptr);
-            renderBatch->drawBatch(commandManager, shader, frame);
+            auto renderBatch = static_cast<RenderBatch*>(resourceHelper.getRawResource(batchID));
+            // 已经销毁的批次 resID的代数不再匹配
+            if (renderBatch == nullptr) {
+                continue;
+            }
+            renderBatch->publishRenderObjects(app->getDeletionQueue());
+            renderBatch->renderObjectPool.forEach<RenderObject>([&](RenderObject* obj) {
+                // 先换上加载完成的模型并登记材质 网格键与材质键与本帧实际绘制的一致
+                obj->resolvePendingModel();
+                obj->prepareMaterial(frame);
+                drawList.push_back({makeSortKey(batchRank, obj, frame), renderBatch, obj});
+            });
+            batchRank++;
+        }
+        stats.drawCount = static_cast<uint32_t>(drawList.size());
+        if (drawList.empty()) {
+            return;
+        }
+        stats.unsorted = countStateChanges();
+        sortDrawList();
+        stats.sorted = countStateChanges();
+
+        RenderBatch* bound = nullptr;
+        for (auto& item : drawList) {
+            if (item.batch != bound) {
+                item.batch->bindDescriptorSets(shader, frame);
+                bound = item.batch;
+            }
+            item.object->draw(commandManager, shader, frame);
         }
     }
-}
\ No newline at end of file
+}
@@ -2,6 +2,7 @@
 #define VULKANTEST_RENDERBATCHMANAGER_H
 
 #include "RenderObject.hpp"
+#include "DeletionQueue.h"
 
 namespace jk {
     class RenderBatch : public IResource{
@@ -10,6 +11,8 @@ namespace jk {
         std::vector<std::shared_ptr<DescriptorSets>> descriptorSets;
         std::array<std::vector<VkDescriptorSet>, 2> descriptorSetsGroup;
         std::shared_ptr<jk::DescriptorSets> globalDescriptorSet;
+        // 全局描述符集由FrameAllocator填写 绑定时使用frame.globalOffset
+        bool dynamicGlobal = false;
         uint32_t descriptorCount = 2;
         uint32_t label;
     public:
@@ -27,12 +30,26 @@ namespace jk {
             renderObjectPool.destroyResource(resID, device);
         }
 
+        // 移出批次 由调用者决定何时cleanup
+        inline std::shared_ptr<IResource> detachRenderObject(uint32_t resID) {
+            return renderObjectPool.detachResource(resID);
+        }
+
+        // 并入其他线程加入或移出的物体 移出的物体交给deletionQueue
+        void publishRenderObjects(DeletionQueue* deletionQueue);
+
+        // 已经并入的物体数
+        inline uint32_t getRenderObjectCount() const {
+            return static_cast<uint32_t>(renderObjectPool.size());
+        }
+
         inline std::vector<std::shared_ptr<DescriptorSets>>& getDescriptorSets() {
             return descriptorSets;
         }
 
-        inline void setGlobalDescriptorSet(std::shared_ptr<jk::DescriptorSets> globalDescriptorSet) {
+        inline void setGlobalDescriptorSet(std::shared_ptr<jk::DescriptorSets> globalDescriptorSet, bool dynamic = false) {
             this->globalDescriptorSet = globalDescriptorSet;
+            this->dynamicGlobal = dynamic;
         }
 
         inline std::shared_ptr<jk::DescriptorSets> getGlobalDescriptorSet() {
@@ -56,18 +73,23 @@ namespace jk {
         }
 
         void drawBatchInternal(CommandManager &commandManager, Shader &shader, FrameInfo &frame) {
-            for (auto& [resID, renderObject] : renderObjectPool.getResources()) {
-                auto obj = std::static_pointer_cast<RenderObject>(renderObject);
+            // 连续遍历 不复制shared_ptr
+            renderObjectPool.forEach<RenderObject>([&](RenderObject* obj) {
                 obj->draw(commandManager, shader, frame);
-            }
+            });
         }
 
-        // 如果不使用BatchManager，需要手动绑定descriptorSets
-        void drawBatch(CommandManager &commandManager, Shader &shader, FrameInfo &frame) {
+        inline void bindDescriptorSets(Shader &shader, FrameInfo &frame) {
             // std::array<VkDescriptorSet, 2> descriptorSetsGroup = {globalDescriptorSets->getDescriptorSets()[frame.currentFrame], descriptorSets->getDescriptorSets()[frame.currentFrame]};
             vkCmdBindDescriptorSets(frame.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, 
                                     shader.getPipelineLayout(), 0, descriptorSetsGroup[frame.currentFrame].size(), 
-                                    descriptorSetsGroup[frame.currentFrame].data(), 0, nullptr);
+                                    descriptorSetsGroup[frame.currentFrame].data(),
+                                    dynamicGlobal ? 1 : 0, &frame.globalOffset);
+        }
+
+        // 如果不使用BatchManager，需要手动绑定descriptorSets
+        void drawBatch(CommandManager &commandManager, Shader &shader, FrameInfo &frame) {
+            bindDescriptorSets(shader, frame);
             drawBatchInternal(commandManager, shader, frame);
         }
 
@@ -76,14 +98,57 @@ namespace jk {
         friend class RenderBatchManager;
     };
 
+    // 相邻两次绘制之间的状态切换次数
+    struct StateChangeCounts {
+        uint32_t descriptorSets = 0;
+        uint32_t materials = 0;
+        uint32_t meshes = 0;
+    };
+
+    // 最近一次drawBatches的统计 unsorted为按批次表与资源池原有顺序绘制时的切换次数
+    struct DrawOrderStats {
+        uint32_t drawCount = 0;
+        StateChangeCounts unsorted;
+        StateChangeCounts sorted;
+    };
+
+    // 所有批次的物体合并为一个绘制列表 按64位排序键基数排序后绘制
+    // 键从高到低为 pass(4) 管线(8) 描述符集/批次(12) 材质(12) 网格(12) 深度(16)
+    // 批次 材质 网格写入的是本帧内的稠密序号而不是resID 20位的槽位下标不会被截断
+    // 状态相同的绘制相邻 状态都相同时由近到远 利于early-Z
     class RenderBatchManager : public ResourceUser {
     private:
+        struct DrawItem {
+            uint64_t key;
+            RenderBatch* batch;
+            RenderObject* object;
+        };
+
         VkDevice device;
         CommandManager& commandManager;
         Shader& shader;
         std::unordered_map<uint32_t, bool> renderBatchMap;
         std::array<VkDescriptorSet, 2> descriptorSetsGroup;
 
+        // 每帧重建 保留容量
+        std::vector<DrawItem> drawList;
+        std::vector<DrawItem> sortScratch;
+        DrawOrderStats stats;
+        // 本帧出现过的网格与材质 按首次出现的顺序编号
+        std::unordered_map<uint32_t, uint32_t> meshRanks;
+        std::unordered_map<uint32_t, uint32_t> materialRanks;
+
+        // 超过4095个不同的值时共用最后一个序号 排序不再完全分组 但绘制结果不变
+        static inline uint64_t rankOf(std::unordered_map<uint32_t, uint32_t>& ranks, uint32_t id) {
+            uint32_t rank = ranks.try_emplace(id, static_cast<uint32_t>(ranks.size())).first->second;
+            return std::min<uint32_t>(rank, 0xFFF);
+        }
+
+        uint64_t makeSortKey(uint32_t batchRank, RenderObject* object, FrameInfo& frame);
+        // LSD基数排序 稳定 所有键在某一字节上相同时跳过这一趟
+        void sortDrawList();
+        StateChangeCounts countStateChanges() const;
+
         inline std::shared_ptr<RenderBatch> getRenderBatch(uint32_t resID) {
             return std::static_pointer_cast<RenderBatch>(resourceHelper.getResource(resID));
         }
@@ -106,6 +171,13 @@ namespace jk {
         std::shared_ptr<RenderObject> getRenderObject(uint32_t batchID, uint32_t resID);
 
         void drawBatches(FrameInfo &frame);
+
+        // 所有批次已经并入的物体数 用于预估本帧对象缓冲的记录数
+        uint32_t getRenderObjectCount();
+
+        inline const DrawOrderStats& getDrawOrderStats() const {
+            return stats;
+        }
     };
 
 
@@ -7,12 +7,16 @@
 #define GLM_FORCE_DEFAULT_ALIGNED_GENTYPES
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <unordered_map>
 
 #include "Buffer.h"
 #include "Texture.h"
 #include "ResourceHelper.hpp"
 #include "CommandManager.h"
 #include "Descriptor.h"
+#include "MaterialLibrary.h"
 
 namespace jk {
 
@@ -33,14 +37,7 @@ namespace jk {
         glm::vec4 color{0.0f};
     };
 
-    struct Material {
-        glm::vec3 color {1.0f};
-        glm::vec3 ambient{0.0f};
-        glm::vec3 diffuse{0.0f};
-        glm::vec4 specular{0.0f};
-    };
-
-    // 内存对齐
+    // 内存对齐 与std430布局一致 也作为ObjectBuffer中的记录
     struct PushData {
         alignas(16) glm::mat4 model {1.0f};
         alignas(16) glm::mat4 normal {1.0f};
@@ -50,6 +47,8 @@ namespace jk {
         alignas(16) glm::vec3 diffuse{0.0f};
         alignas(16) glm::vec4 specular{0.0f};
         alignas(16) int args{0};
+        // 材质表中的下标 小于0时使用上面的材质字段 位于args之后的填充中 不改变大小
+        int materialIndex{-1};
     };
 
     struct Transform {
@@ -61,6 +60,8 @@ namespace jk {
     class RenderObject : public IResource {
     private:
         std::shared_ptr<ModelBuffer> modelBuffer;
+        // 异步加载中的模型 完成后替换当前的占位模型
+        std::shared_ptr<AsyncModelBuffer> pendingModelBuffer;
         uint32_t renderBatchID = 0;
 
         // Material material{};
@@ -70,10 +71,36 @@ namespace jk {
         // std::function<void(Shader& shader, FrameInfo &frame)> pushFunc;
         std::function<glm::mat4()> modelMatrixFunc;
         Transform transform;
+
+        // 剔除后需要绘制的索引范围 每帧复用
+        std::vector<IndexRange> visibleRanges;
+
+        // 对象缓冲已满时本帧跳过 下一帧开始时扩容
+        bool reserveObjectData(FrameInfo &frame) {
+            return frame.objectBuffer == nullptr || objectFrame == frame.frameNumber || frame.objectBuffer->reserve(1);
+        }
     protected:
+        // 本帧写入对象缓冲的记录 阴影pass与主pass共用
+        uint64_t objectFrame = 0;
+        uint32_t objectIndex = 0;
+
         virtual void pushFunc(Shader& shader, FrameInfo &frame) {
 
         }
+
+        // 为true时逐个子网格绘制 每段之前调用pushSubmeshFunc
+        virtual bool hasSubmeshMaterials() {
+            return false;
+        }
+
+        virtual void pushSubmeshFunc(Shader& shader, FrameInfo &frame, int32_t materialId) {
+
+        }
+
+        // 排序键读取材质下标 在计算之前登记本帧使用的材质
+        virtual void prepareMaterial(FrameInfo &frame) {
+
+        }
     public:
 
         RenderObject(std::shared_ptr<ModelBuffer> modelBuffer)// , bool enableLocalTransform = true)
@@ -91,6 +118,42 @@ namespace jk {
                 }
         inline std::shared_ptr<ModelBuffer> getModelBuffer() const { return modelBuffer; }
 
+        // 排序键使用 不复制shared_ptr
+        inline uint32_t getModelBufferID() const { return modelBuffer->getID(); }
+
+        // 没有使用材质表的物体返回-1
+        virtual int32_t getMaterialIndex() const {
+            return -1;
+        }
+
+        inline RenderObject& setModelBuffer(std::shared_ptr<ModelBuffer> modelBuffer) {
+            assert(modelBuffer != nullptr);
+            this->modelBuffer = std::move(modelBuffer);
+            pendingModelBuffer = nullptr;
+            return *this;
+        }
+
+        // 保持当前模型作为占位 直到异步加载完成
+        inline RenderObject& setModelBuffer(std::shared_ptr<AsyncModelBuffer> pending) {
+            pendingModelBuffer = std::move(pending);
+            return *this;
+        }
+
+        // 异步加载完成时换上新模型 加载失败时保留占位模型
+        // 排序键读取模型id 需要在计算之前调用
+        inline void resolvePendingModel() {
+            if (pendingModelBuffer != nullptr && pendingModelBuffer->ready()) {
+                if (!pendingModelBuffer->failed()) {
+                    modelBuffer = pendingModelBuffer->get();
+                }
+                pendingModelBuffer = nullptr;
+            }
+        }
+
+        inline bool isModelPending() const {
+            return pendingModelBuffer != nullptr && !pendingModelBuffer->ready();
+        }
+
         inline RenderObject& setPosition(glm::vec3 position) {
             transform.position = position;
             return *this;
@@ -177,9 +240,151 @@ namespace jk {
         // }
 
         void draw(CommandManager &commandManager, Shader &shader, FrameInfo &frame) {
+            resolvePendingModel();
+            const CullView& cullView = frame.cullView;
+            if (cullView.enabled && !isVisible(cullView)) {
+                return;
+            }
+            uint32_t lod = selectLod(frame.lodView);
+            // 深度pass不关心材质 子网格连续存放 可以整体绘制
+            if (!frame.depthOnly && modelBuffer->getSubmeshCount() > 1 && hasSubmeshMaterials()) {
+                drawSubmeshes(shader, frame, lod);
+                return;
+            }
+            // 只有LOD0有网格簇
+            bool clustered = lod == 0 && cullView.enabled &&
+                             cullMeshlets(cullView, 0, static_cast<uint32_t>(modelBuffer->getMeshlets().size()));
+            if (clustered && visibleRanges.empty()) {
+                return;
+            }
+            if (!reserveObjectData(frame)) {
+                return;
+            }
+
             pushFunc(shader, frame);
-            modelBuffer->bind(frame.commandBuffer);
-            commandManager.renderModelBuffer(frame, modelBuffer);
+            if (clustered) {
+                modelBuffer->bind(frame.commandBuffer, frame.depthOnly, &frame.geometryBinding);
+                modelBuffer->drawRanges(frame.commandBuffer, visibleRanges);
+                return;
+            }
+            commandManager.renderModelBuffer(frame, modelBuffer, lod);
+        }
+
+        // 所有子网格共用一次缓冲绑定 逐段切换材质后绘制
+        void drawSubmeshes(Shader &shader, FrameInfo &frame, uint32_t lod) {
+            const CullView& cullView = frame.cullView;
+            const Submesh* submeshes = modelBuffer->getSubmeshes(lod);
+            bool pushed = false;
+            for (uint32_t i = 0; i < modelBuffer->getSubmeshCount(); i++) {
+                const Submesh& submesh = submeshes[i];
+                if (submesh.indexCount == 0) {
+                    continue;
+                }
+                if (!(lod == 0 && cullView.enabled && cullMeshlets(cullView, submesh.firstMeshlet, submesh.meshletCount))) {
+                    visibleRanges.assign(1, {submesh.firstIndex, submesh.indexCount});
+                }
+                if (visibleRanges.empty()) {
+                    continue;
+                }
+                // 每个子网格的材质各占一条记录 第一段还可能需要物体本身的记录
+                uint32_t records = (!pushed && objectFrame != frame.frameNumber) ? 2 : 1;
+                if (frame.objectBuffer != nullptr && !frame.objectBuffer->reserve(records)) {
+                    break;
+                }
+                if (!pushed) {
+                    pushFunc(shader, frame);
+                    modelBuffer->bind(frame.commandBuffer, frame.depthOnly, &frame.geometryBinding);
+                    pushed = true;
+                }
+                pushSubmeshFunc(shader, frame, submesh.materialId);
+                modelBuffer->drawRanges(frame.commandBuffer, visibleRanges);
+            }
+        }
+
+        static float maxScale(const glm::mat4& model) {
+            return std::max(glm::length(glm::vec3(model[0])),
+                            std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+        }
+
+        // 整个模型的包围球在视锥外时跳过 没有包围球的模型总是可见
+        bool isVisible(const CullView& view) {
+            const MeshBounds& bounds = modelBuffer->getBounds();
+            if (bounds.radius <= 0.0f) {
+                return true;
+            }
+            glm::mat4 model = modelMatrix();
+            glm::vec3 center = glm::vec3(model * glm::vec4(bounds.center, 1.0f));
+            return !view.outside(center, bounds.radius * maxScale(model));
+        }
+
+        // 对[firstMeshlet, firstMeshlet + meshletCount)逐簇做法线锥与视锥剔除 相邻的可见簇合并为一次绘制
+        // 没有网格簇时返回false 由调用者按普通方式绘制
+        bool cullMeshlets(const CullView& view, uint32_t firstMeshlet, uint32_t meshletCount) {
+            const auto& meshlets = modelBuffer->getMeshlets();
+            if (meshletCount == 0 || firstMeshlet + meshletCount > meshlets.size() || !modelBuffer->indexed()) {
+                return false;
+            }
+
+            glm::mat4 model = modelMatrix();
+            float scale = maxScale(model);
+            // 背面判断在仿射变换下不变 在模型空间中测试 镜像变换会翻转绕序 此时跳过
+            bool coneTest = view.backface && glm::determinant(glm::mat3(model)) > 0.0f;
+            glm::vec3 eye = glm::vec3(glm::inverse(model) * glm::vec4(view.position, 1.0f));
+
+            visibleRanges.clear();
+            for (uint32_t i = firstMeshlet; i < firstMeshlet + meshletCount; i++) {
+                const Meshlet& meshlet = meshlets[i];
+                if (coneTest && meshlet.coneCutoff <= 1.0f) {
+                    glm::vec3 apex{meshlet.coneApex[0], meshlet.coneApex[1], meshlet.coneApex[2]};
+                    glm::vec3 axis{meshlet.coneAxis[0], meshlet.coneAxis[1], meshlet.coneAxis[2]};
+                    if (glm::dot(glm::normalize(apex - eye), axis) >= meshlet.coneCutoff) {
+                        continue;
+                    }
+                }
+                glm::vec3 center = glm::vec3(model * glm::vec4(meshlet.center[0], meshlet.center[1], meshlet.center[2], 1.0f));
+                if (view.outside(center, meshlet.radius * scale)) {
+                    continue;
+                }
+                if (!visibleRanges.empty() &&
+                    visibleRanges.back().firstIndex + visibleRanges.back().indexCount == meshlet.firstIndex) {
+                    visibleRanges.back().indexCount += meshlet.indexCount;
+                } else {
+                    visibleRanges.push_back({meshlet.firstIndex, meshlet.indexCount});
+                }
+            }
+            return true;
+        }
+
+        // 取屏幕空间误差不超过阈值的最粗一级
+        // 误差以包围球半径为单位 乘以包围球投影到屏幕上的半径即为像素误差
+        uint32_t selectLod(const LodView& view) {
+            const auto& lods = modelBuffer->getLods();
+            const MeshBounds& bounds = modelBuffer->getBounds();
+            if (lods.size() <= 1 || view.pixelScale <= 0.0f || bounds.radius <= 0.0f) {
+                return 0;
+            }
+
+            glm::mat4 model = modelMatrix();
+            glm::vec3 center = glm::vec3(model * glm::vec4(bounds.center, 1.0f));
+            float radius = bounds.radius * maxScale(model);
+
+            float projectedRadius = radius * view.pixelScale;
+            if (!view.orthographic) {
+                float distance = glm::length(center - view.position) - radius;
+                // 视点在包围球内
+                if (distance <= 0.0f) {
+                    return 0;
+                }
+                projectedRadius /= distance;
+            }
+
+            float limit = view.threshold * view.bias;
+            for (uint32_t i = static_cast<uint32_t>(lods.size()) - 1; i > 0; i--) {
+                if (lods[i].error * projectedRadius <= limit) {
+                    return i;
+                }
+            }
+            return 0;
         }
 
         void cleanup(VkDevice &device) override {
@@ -264,6 +469,11 @@ namespace jk {
             return translateMatrix() * rotateMatrix() * scaleMatrix();
         }
 
+        // 推送给顶点着色器的矩阵 包含压缩顶点的反量化
+        glm::mat4 vertexMatrix() {
+            return modelMatrix() * modelBuffer->getDequantizeMatrix();
+        }
+
         glm::mat4 normalMatrix() {
             return glm::transpose(glm::inverse(modelMatrix()));
         }
@@ -274,7 +484,37 @@ namespace jk {
 
     class MeshObject : public RenderObject {
     private:
+        // 某个材质在材质表中登记的下标 材质被修改后重新登记
+        struct InternedMaterial {
+            MaterialLibrary* library = nullptr;
+            Material material{};
+            int32_t index = -1;
+
+            // 没有材质表时返回-1
+            int32_t intern(FrameInfo &frame, const Material& current) {
+                if (frame.materialLibrary == nullptr) {
+                    return -1;
+                }
+                if (library != frame.materialLibrary || !(material == current)) {
+                    release();
+                    index = static_cast<int32_t>(frame.materialLibrary->acquire(current));
+                    library = frame.materialLibrary;
+                    material = current;
+                }
+                return index;
+            }
+
+            void release() {
+                if (library != nullptr && index >= 0 && library->isAvailable()) {
+                    library->release(index);
+                }
+                library = nullptr;
+                index = -1;
+            }
+        };
+
         Material material{};
+        InternedMaterial interned;
 
         #define USE_LIGHTING 1
         #define CAST_SHADOW 2
@@ -283,11 +523,56 @@ namespace jk {
         int useLighting = USE_LIGHTING;
         int castShadow = CAST_SHADOW;
         int useDLighting = USE_D_LIGHTING;
+
+        // 子网格材质 按材质id覆盖 其余的使用模型自带的材质(如果启用)或者material
+        std::unordered_map<int32_t, Material> submeshMaterials;
+        bool useModelMaterials = false;
+        // 各子网格材质登记的下标 按材质id索引
+        std::unordered_map<int32_t, InternedMaterial> internedSubmeshes;
+
+        Material resolveSubmeshMaterial(int32_t materialId) {
+            auto it = submeshMaterials.find(materialId);
+            if (it != submeshMaterials.end()) {
+                return it->second;
+            }
+            const auto& materials = getModelBuffer()->getMaterials();
+            if (!useModelMaterials || materialId < 0 || materialId >= static_cast<int32_t>(materials.size())) {
+                return material;
+            }
+            const MaterialInfo& info = materials[materialId];
+            Material result = material;
+            result.ambient = {info.ambient[0], info.ambient[1], info.ambient[2]};
+            result.diffuse = {info.diffuse[0], info.diffuse[1], info.diffuse[2]};
+            result.specular = {info.specular[0], info.specular[1], info.specular[2], info.shininess};
+            return result;
+        }
+
+        void releaseMaterial() {
+            interned.release();
+            for (auto& [materialId, submesh] : internedSubmeshes) {
+                submesh.release();
+            }
+            internedSubmeshes.clear();
+        }
     protected:
+        void prepareMaterial(FrameInfo &frame) override {
+            interned.intern(frame, material);
+        }
+
         void pushFunc(Shader& shader, FrameInfo &frame) {
             int args = 0;
             args |= useLighting | castShadow | useDLighting;
-            PushData pushData{modelMatrix(), normalMatrix(), material.color, material.ambient, material.diffuse, material.specular, args};
+            if (frame.objectBuffer != nullptr) {
+                if (objectFrame != frame.frameNumber) {
+                    PushData objectData{vertexMatrix(), normalMatrix(), material.color, material.ambient, material.diffuse, material.specular, args};
+                    objectData.materialIndex = interned.intern(frame, material);
+                    objectIndex = frame.objectBuffer->write(objectData);
+                    objectFrame = frame.frameNumber;
+                }
+                frame.objectBuffer->pushIndex(frame.commandBuffer, shader, objectIndex);
+                return;
+            }
+            PushData pushData{vertexMatrix(), normalMatrix(), material.color, material.ambient, material.diffuse, material.specular, args};
             // PPPPUSH!!!
             vkCmdPushConstants(
                                 frame.commandBuffer,
@@ -297,13 +582,62 @@ namespace jk {
                                 sizeof(PushData),
                                 &pushData);
         }
+
+        bool hasSubmeshMaterials() override {
+            return !submeshMaterials.empty() || (useModelMaterials && !getModelBuffer()->getMaterials().empty());
+        }
+
+        // 矩阵在pushFunc中已经推送 这里只更新材质部分
+        void pushSubmeshFunc(Shader& shader, FrameInfo &frame, int32_t materialId) override {
+            Material submeshMaterial = resolveSubmeshMaterial(materialId);
+            if (frame.objectBuffer != nullptr) {
+                PushData objectData{vertexMatrix(), normalMatrix(), submeshMaterial.color, submeshMaterial.ambient,
+                                    submeshMaterial.diffuse, submeshMaterial.specular, useLighting | castShadow | useDLighting};
+                objectData.materialIndex = internedSubmeshes[materialId].intern(frame, submeshMaterial);
+                frame.objectBuffer->pushIndex(frame.commandBuffer, shader, frame.objectBuffer->write(objectData));
+                return;
+            }
+            PushData pushData{};
+            pushData.color = submeshMaterial.color;
+            pushData.ambient = submeshMaterial.ambient;
+            pushData.diffuse = submeshMaterial.diffuse;
+            pushData.specular = submeshMaterial.specular;
+            pushData.args = useLighting | castShadow | useDLighting;
+            vkCmdPushConstants(
+                                frame.commandBuffer,
+                                shader.getPipelineLayout(),
+                                VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+                                offsetof(PushData, color),
+                                sizeof(PushData) - offsetof(PushData, color),
+                                &pushData.color);
+        }
     public:
         MeshObject(std::shared_ptr<ModelBuffer> modelBuffer) : RenderObject(std::move(modelBuffer)) {}
 
+        // 材质表需要比物体晚释放
+        void cleanup(VkDevice &device) override {
+            releaseMaterial();
+        }
+
         inline Material& getMaterial() {
             return material;
         }
 
+        // 最近一次登记的材质下标 没有使用材质表时为-1 作为绘制排序的依据
+        int32_t getMaterialIndex() const override {
+            return interned.index;
+        }
+
+        // 单独指定某个材质id的子网格使用的材质 初始值为当前的material
+        inline Material& getSubmeshMaterial(int32_t materialId) {
+            return submeshMaterials.try_emplace(materialId, material).first->second;
+        }
+
+        // 使用obj材质库中的颜色参数 默认关闭 保持整个物体使用同一个material
+        inline void setUseModelMaterials(bool useModelMaterials) {
+            this->useModelMaterials = useModelMaterials;
+        }
+
         inline void setUseLighting(bool useLighting) {
             this->useLighting = useLighting ? 1 : 0;
         }
@@ -107,7 +107,7 @@ namespace jk {
         }
     }
 
-    void RenderProcess::createGraphicsPipeline(Shader &shader) {
+    void RenderProcess::createGraphicsPipeline(Shader &shader, const VertexInputLayout& vertexInput) {
 
         // 创建着色器模块
         auto vertShaderModule = shader.getVertShaderModule();
@@ -137,15 +137,13 @@ namespace jk {
         VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
 
         // 设置顶点输入信息
-        auto bindingDescription = Vertex::getBindingDescription();
-        auto attributeDescriptions = Vertex::getAttributeDescriptions();
 
         VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
         vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-        vertexInputInfo.vertexBindingDescriptionCount = 1;
-        vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-        vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-        vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+        vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(vertexInput.bindings.size());
+        vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertexInput.attributes.size());
+        vertexInputInfo.pVertexBindingDescriptions = vertexInput.bindings.data();
+        vertexInputInfo.pVertexAttributeDescriptions = vertexInput.attributes.data();
 
         // 设置输入组装信息
         VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
@@ -271,6 +269,7 @@ namespace jk {
     void RenderProcess::beginRenderPass(FrameInfo &frameInfo) {
         renderPassInfo.framebuffer = swapChain.getFramebuffers()[frameInfo.imageIndex];
         vkCmdBeginRenderPass(frameInfo.commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+        frameInfo.geometryBinding.reset();
 
         auto swapChainExtent = swapChain.getExtent();
         // 绘制
@@ -390,19 +389,8 @@ namespace jk {
             throw std::runtime_error("failed to create offscreen image!");
         }
 
-        VkMemoryAllocateInfo memAlloc{};
-        memAlloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        VkMemoryRequirements memReqs;
-		vkGetImageMemoryRequirements(device, offscreenPass.depth.image, &memReqs);
-		memAlloc.allocationSize = memReqs.size;
-		memAlloc.memoryTypeIndex = app->findMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		if (vkAllocateMemory(device, &memAlloc, nullptr, &offscreenPass.depth.imageMemory) != VK_SUCCESS) {
-            throw std::runtime_error("failed to allocate offscreen image memory!");
-        }
-        
-        if (vkBindImageMemory(device, offscreenPass.depth.image, offscreenPass.depth.imageMemory, 0) != VK_SUCCESS) {
-            throw std::runtime_error("failed to bind offscreen image memory!");
-        }
+        offscreenPass.depth.imageMemory = app->getMemoryAllocator()->allocateForImage(offscreenPass.depth.image,
+                                                                                      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
         VkImageViewCreateInfo depthStencilView{};
         depthStencilView.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -488,10 +476,10 @@ namespace jk {
         vkDestroySampler(device, offscreenPass.depthSampler, nullptr);
         vkDestroyImageView(device, offscreenPass.depth.imageView, nullptr);
         vkDestroyImage(device, offscreenPass.depth.image, nullptr);
-        vkFreeMemory(device, offscreenPass.depth.imageMemory, nullptr);
+        freeMemory(offscreenPass.depth.imageMemory);
     }
 
-    void OffscreenRenderProcess::createGraphicsPipeline(Shader &shader) {
+    void OffscreenRenderProcess::createGraphicsPipeline(Shader &shader, const VertexInputLayout& vertexInput) {
         // 对于shadowmap，我们只需要顶点着色器
         auto vertShaderModule = shader.getVertShaderModule();
          // 设置着色器阶段信息
@@ -508,15 +496,13 @@ namespace jk {
         VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo};
 
         // 设置顶点输入信息
-        auto bindingDescription = Vertex::getBindingDescription();
-        auto attributeDescriptions = Vertex::getAttributeDescriptions();
 
         VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
         vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-        vertexInputInfo.vertexBindingDescriptionCount = 1;
-        vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-        vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-        vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+        vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(vertexInput.bindings.size());
+        vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertexInput.attributes.size());
+        vertexInputInfo.pVertexBindingDescriptions = vertexInput.bindings.data();
+        vertexInputInfo.pVertexAttributeDescriptions = vertexInput.attributes.data();
 
         // 设置输入组装信息
         VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
@@ -614,10 +600,15 @@ namespace jk {
             0.0f,
             depthBiasSlope);
 
+        // 阴影只需要位置
+        frameInfo.depthOnly = true;
+        frameInfo.geometryBinding.reset();
     }
 
     void OffscreenRenderProcess::endRenderPass(FrameInfo &frameInfo) {
         vkCmdEndRenderPass(frameInfo.commandBuffer);
+        frameInfo.depthOnly = false;
+        frameInfo.geometryBinding.reset();
     }
 
     void OffscreenRenderProcess::fillImageDescriptorSets(std::shared_ptr<DescriptorSets> descriptorSets, uint32_t binding) {
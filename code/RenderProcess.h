@@ -24,6 +24,7 @@
 #include "Shader.h"
 #include "SwapChain.h"
 #include "Texture.h"
+#include "VertexFormat.h"
 
 namespace jk {
 
@@ -52,7 +53,8 @@ namespace jk {
 
         virtual void endRenderPass(FrameInfo& frameInfo) = 0;
 
-        virtual void createGraphicsPipeline(Shader& shader) = 0;
+        // 顶点输入按模型使用的顶点格式生成
+        virtual void createGraphicsPipeline(Shader& shader, const VertexInputLayout& vertexInput = VertexInputLayout::of<VertexFormat::Full>()) = 0;
     };
 
     class RenderProcess : public AbstractRenderProcess {
@@ -69,7 +71,7 @@ namespace jk {
 
         virtual void init();
         virtual void cleanup();
-        virtual void createGraphicsPipeline(Shader& shader);
+        virtual void createGraphicsPipeline(Shader& shader, const VertexInputLayout& vertexInput = VertexInputLayout::of<VertexFormat::Full>());
 
         void setClearColor(VkClearColorValue clearColor);
 
@@ -129,7 +131,7 @@ namespace jk {
 
         virtual void init();
         virtual void cleanup();
-        virtual void createGraphicsPipeline(Shader& shader);
+        virtual void createGraphicsPipeline(Shader& shader, const VertexInputLayout& vertexInput = VertexInputLayout::depthOnly(VertexFormat::Full));
 
         virtual void beginRenderPass(FrameInfo& frameInfo);
         virtual void endRenderPass(FrameInfo& frameInfo);
@@ -5,10 +5,15 @@
 #ifndef VULKANTEST_RESOURCEHELPER_H
 #define VULKANTEST_RESOURCEHELPER_H
 
+#include <atomic>
+#include <cstdint>
 #include <iostream>
 #include <memory>
-#include <unordered_map>
+#include <mutex>
 #include <functional>
+#include <stdexcept>
+#include <thread>
+#include <vector>
 
 #include <vulkan/vulkan.h>
 
@@ -20,7 +25,7 @@ namespace jk {
 
     class IResource {
     private:
-        uint32_t resID;
+        uint32_t resID = UINT32_MAX;
         bool available = false;
     public:
         virtual void cleanup(VkDevice &device) = 0;
@@ -35,58 +40,234 @@ namespace jk {
         friend class ResourceHelper;
     };
 
+    // 分代的slot map 资源紧密存放在数组中 遍历时连续访问 不经过哈希桶
+    // resID的低INDEX_BITS位是槽位 高位是代数 槽位复用时代数加一 过期的resID查不到任何资源
+    // 槽位与紧密数组只由创建它的线程(渲染线程)修改 查找与遍历不加锁 也只能在该线程中进行
+    // 其他线程登记时原子地预留一个新槽位 resID在返回前写好 资源先放入待处理队列 由渲染线程调用publish并入
     class ResourceHelper {
-    private:
-        std::unordered_map<uint32_t, std::shared_ptr<IResource>> resources;
-        uint32_t resID = 0;
-        std::function<uint32_t(std::shared_ptr<IResource> res)> genID;
     public:
+        static constexpr uint32_t INDEX_BITS = 20;
+        static constexpr uint32_t INDEX_MASK = (1u << INDEX_BITS) - 1;
+        static constexpr uint32_t GENERATION_MASK = (1u << (32 - INDEX_BITS)) - 1;
+        // 最后一个槽位不使用 否则代数为GENERATION_MASK时resID等于UINT32_MAX 与无效值相同
+        static constexpr uint32_t MAX_RESOURCES = INDEX_MASK;
+    private:
+        struct Slot {
+            uint32_t generation = 0;
+            // 在resources中的位置 空闲时为下一个空闲槽位
+            uint32_t dense = 0;
+            bool occupied = false;
+        };
 
-        ResourceHelper() {
-            genID = std::bind(&ResourceHelper::genNewResourceID, this, std::placeholders::_1);
-        }
+        std::vector<Slot> slots;
+        uint32_t freeHead = UINT32_MAX;
+        // 下一个从未使用过的槽位 任意线程都可以预留 预留后由渲染线程扩充slots
+        std::atomic<uint32_t> nextSlot{0};
+
+        // 紧密数组 三者下标一致 删除时与末尾交换
+        std::vector<std::shared_ptr<IResource>> resources;
+        std::vector<IResource*> rawResources;
+        std::vector<uint32_t> denseToSlot;
 
-        ResourceHelper(std::function<uint32_t(std::shared_ptr<IResource> res)> genID) : genID(genID) {}
+        std::thread::id owner = std::this_thread::get_id();
+        std::mutex pendingMutex;
+        std::vector<std::shared_ptr<IResource>> pendingCreates;
+        std::vector<uint32_t> pendingDetaches;
+        // 没有待处理项时publish不加锁
+        std::atomic<bool> hasPending{false};
 
-        uint32_t genNewResourceID(std::shared_ptr<IResource> res) {
-            return resID++;
+        inline bool isOwnerThread() const {
+            return std::this_thread::get_id() == owner;
         }
 
-        std::shared_ptr<IResource> createResource(std::shared_ptr<IResource> resource) {
-            uint32_t resID = genID(resource);
-            resource->resID = resID;
+        // 新槽位的代数为0 空闲链表中的槽位只由渲染线程复用
+        uint32_t reserveSlot() {
+            uint32_t index = nextSlot.fetch_add(1, std::memory_order_relaxed);
+            if (index >= MAX_RESOURCES) {
+                throw std::runtime_error("too many resources!");
+            }
+            return index;
+        }
+
+        // 放入已经分配好resID的槽位 其他线程预留但尚未并入的槽位保持空闲 查找不到
+        void place(const std::shared_ptr<IResource>& resource, uint32_t index) {
+            if (index >= slots.size()) {
+                slots.resize(index + 1);
+            }
+            Slot& slot = slots[index];
+            slot.occupied = true;
+            slot.dense = static_cast<uint32_t>(resources.size());
+            resources.push_back(resource);
+            rawResources.push_back(resource.get());
+            denseToSlot.push_back(index);
             resource->available = true;
-            resources[resID] = resource;
+        }
+
+        std::shared_ptr<IResource> insert(std::shared_ptr<IResource> resource) {
+            uint32_t index;
+            if (freeHead != UINT32_MAX) {
+                index = freeHead;
+                freeHead = slots[index].dense;
+            } else {
+                index = reserveSlot();
+            }
+            uint32_t generation = index < slots.size() ? slots[index].generation : 0;
+            resource->resID = (generation << INDEX_BITS) | index;
+            place(resource, index);
             return resource;
         }
 
-        std::shared_ptr<IResource> getResource(uint32_t resID) {
-            auto it = resources.find(resID);
-            if (it == resources.end())
+        inline const Slot* findSlot(uint32_t resID) const {
+            uint32_t index = resID & INDEX_MASK;
+            if (index >= slots.size()) {
                 return nullptr;
-            return it->second;
+            }
+            const Slot& slot = slots[index];
+            if (!slot.occupied || slot.generation != (resID >> INDEX_BITS)) {
+                return nullptr;
+            }
+            return &slot;
+        }
+    public:
+        ResourceHelper() = default;
+        ResourceHelper(const ResourceHelper&) = delete;
+        ResourceHelper& operator=(const ResourceHelper&) = delete;
+
+        // 可以在任意线程调用 返回时resID已经有效 其他线程登记的资源在publish之后才能查到并参与遍历
+        std::shared_ptr<IResource> createResource(std::shared_ptr<IResource> resource) {
+            if (!isOwnerThread()) {
+                resource->resID = reserveSlot();
+                std::lock_guard<std::mutex> lock(pendingMutex);
+                pendingCreates.push_back(resource);
+                hasPending.store(true, std::memory_order_release);
+                return resource;
+            }
+            return insert(resource);
+        }
+
+        std::shared_ptr<IResource> getResource(uint32_t resID) {
+            const Slot* slot = findSlot(resID);
+            return slot != nullptr ? resources[slot->dense] : nullptr;
+        }
+
+        // 不增加引用计数 热路径上使用
+        inline IResource* getRawResource(uint32_t resID) const {
+            const Slot* slot = findSlot(resID);
+            return slot != nullptr ? rawResources[slot->dense] : nullptr;
         }
 
+        // 其他线程调用时与detachResource相同 资源在publish时交给retire
         void destroyResource(uint32_t resID, VkDevice& device) {
-            auto it = resources.find(resID);
-            if (it == resources.end())
+            // 先从数组中移除 cleanup中可能再访问这个资源管理器
+            std::shared_ptr<IResource> resource = detachResource(resID);
+            if (resource == nullptr)
                 return;
-            it->second->cleanup(device);
-            it->second->available = false;
-            resources.erase(it);
+            resource->cleanup(device);
+        }
+
+        // 移除但不cleanup 交给DeletionQueue在帧执行完后销毁
+        // 其他线程调用时只记录resID 返回空 publish时再移除
+        std::shared_ptr<IResource> detachResource(uint32_t resID) {
+            if (!isOwnerThread()) {
+                std::lock_guard<std::mutex> lock(pendingMutex);
+                pendingDetaches.push_back(resID);
+                hasPending.store(true, std::memory_order_release);
+                return nullptr;
+            }
+            const Slot* found = findSlot(resID);
+            if (found == nullptr)
+                return nullptr;
+            uint32_t index = resID & INDEX_MASK;
+            uint32_t dense = found->dense;
+            std::shared_ptr<IResource> resource = std::move(resources[dense]);
+            uint32_t last = static_cast<uint32_t>(resources.size()) - 1;
+            if (dense != last) {
+                resources[dense] = std::move(resources[last]);
+                rawResources[dense] = rawResources[last];
+                denseToSlot[dense] = denseToSlot[last];
+                slots[denseToSlot[dense]].dense = dense;
+            }
+            resources.pop_back();
+            rawResources.pop_back();
+            denseToSlot.pop_back();
+
+            Slot& slot = slots[index];
+            slot.occupied = false;
+            slot.generation = (slot.generation + 1) & GENERATION_MASK;
+            slot.dense = freeHead;
+            freeHead = index;
+
+            resource->available = false;
+            return resource;
+        }
+
+        // 在渲染线程中调用 并入其他线程的登记与移除 移除的资源交给retire(可能为空)
+        // 先登记后移除 同一批中登记的资源也可以按resID移除
+        template<typename Func>
+        void publish(Func&& retire) {
+            if (!hasPending.load(std::memory_order_acquire)) {
+                return;
+            }
+            std::vector<std::shared_ptr<IResource>> creates;
+            std::vector<uint32_t> detaches;
+            {
+                std::lock_guard<std::mutex> lock(pendingMutex);
+                creates.swap(pendingCreates);
+                detaches.swap(pendingDetaches);
+                hasPending.store(false, std::memory_order_relaxed);
+            }
+            for (auto& resource : creates) {
+                place(resource, resource->resID & INDEX_MASK);
+            }
+            for (uint32_t resID : detaches) {
+                retire(detachResource(resID));
+            }
         }
 
         void cleanup(VkDevice& device) {
+            // 尚未并入的资源同样持有设备对象 取出后在锁外cleanup
+            std::vector<std::shared_ptr<IResource>> creates;
+            {
+                std::lock_guard<std::mutex> lock(pendingMutex);
+                creates.swap(pendingCreates);
+                pendingDetaches.clear();
+                hasPending.store(false, std::memory_order_relaxed);
+            }
+            for (auto& resource : creates) {
+                resource->cleanup(device);
+            }
             for (auto& resource : resources) {
-                resource.second->cleanup(device);
-                resource.second->available = false;
+                resource->cleanup(device);
+                resource->available = false;
+            }
+            // 槽位保留 代数加一 之前的resID仍然失效
+            for (uint32_t index : denseToSlot) {
+                Slot& slot = slots[index];
+                slot.occupied = false;
+                slot.generation = (slot.generation + 1) & GENERATION_MASK;
+                slot.dense = freeHead;
+                freeHead = index;
             }
             resources.clear();
+            rawResources.clear();
+            denseToSlot.clear();
+        }
+
+        inline size_t size() const {
+            return resources.size();
         }
 
-        inline std::unordered_map<uint32_t, std::shared_ptr<IResource>>& getResources() {
+        // 紧密数组 顺序不固定 遍历时不能创建或销毁资源
+        inline const std::vector<std::shared_ptr<IResource>>& getResources() const {
             return resources;
         }
+
+        template<typename T, typename Func>
+        inline void forEach(Func&& func) const {
+            for (IResource* resource : rawResources) {
+                func(static_cast<T*>(resource));
+            }
+        }
     };
 
     class VulkanApp;
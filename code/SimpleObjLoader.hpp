@@ -5,73 +5,364 @@
 #ifndef VULKANTEST_SIMPLEOBJ_H
 #define VULKANTEST_SIMPLEOBJ_H
 
+#include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <unordered_map>
 #include "thirdparty/rapidobj/rapidobj.hpp"
 #include "Buffer.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "Meshlet.h"
+#include "Submesh.h"
+#include "ObjStream.h"
+#include "ThreadPool.hpp"
 
 namespace jk {
 
 class SimpleObj {
     public:
-        // 加载 obj 到ModelBuffer
-        static std::shared_ptr<ModelBuffer> load(GeneralBufferManager& allocator, const std::string& path) {
-            // 不考虑材质问题 这里简单地只加载顶点信息
+        // CPU侧的网格数据 可以在工作线程中解析
+        // 命中缓存时数据直接来自映射内存 否则来自streams与indices/shortIndices
+        // format与colorStream需要在解析前设置 顶点在工作线程中按它拆分 缓存也按它写入
+        struct MeshData {
+            VertexFormat format = VertexFormat::Full;
+            bool colorStream = false;
+            std::unique_ptr<CachedMesh> cached;
+            std::vector<Vertex> vertices;
+            VertexStreams streams;
+            uint32_t vertexCount = 0;
+            std::vector<uint32_t> indices;
+            std::vector<uint16_t> shortIndices;
+            std::vector<MeshLod> lods;
+            std::vector<Meshlet> meshlets;
+            std::vector<Submesh> submeshes;
+            std::vector<MaterialInfo> materials;
+            MeshBounds bounds{};
+            size_t cornerCount = 0;
+        };
+
+        // obj引用的材质库 与rapidobj的默认查找方式一致 相对于obj所在目录 没有mtllib时返回空
+        // headerOnly为true时遇到第一行顶点或面就停止 导出工具都把mtllib写在文件开头 不需要扫描整个文件
+        static std::string materialLibraryOf(const std::string& path, bool headerOnly = false) {
+            std::ifstream file(path);
+            std::string line;
+            while (std::getline(file, line)) {
+                if (headerOnly && line.size() > 1 && (line[0] == 'v' || line[0] == 'f') &&
+                    (line[1] == ' ' || line[1] == '\t' || line[1] == 'n' || line[1] == 't')) {
+                    break;
+                }
+                if (line.compare(0, 7, "mtllib ") != 0 && line.compare(0, 7, "mtllib\t") != 0) {
+                    continue;
+                }
+                size_t begin = line.find_first_not_of(" \t", 7);
+                size_t end = line.find_last_not_of(" \t\r");
+                if (begin == std::string::npos) {
+                    return {};
+                }
+                namespace fs = std::filesystem;
+                std::error_code ec;
+                fs::path library = fs::path(path).parent_path() / line.substr(begin, end - begin + 1);
+                fs::path canonical = fs::weakly_canonical(library, ec);
+                return (ec ? library : canonical).generic_string();
+            }
+            return {};
+        }
+
+        // 解析obj并焊接顶点 不涉及任何vulkan调用 可在任意线程执行
+        // useCache为true时优先映射二进制网格缓存 未命中则解析后写入缓存
+        static bool parse(const std::string& path, MeshData& mesh, bool useCache = true) {
+            if (useCache) {
+                mesh.cached = MeshCache::open(path, mesh.format, mesh.colorStream);
+                if (mesh.cached != nullptr) {
+                    std::cout << "[SimpleObj] " << path << ": mesh cache hit, "
+                              << mesh.cached->getVertexCount() << " vertices, " << mesh.cached->getIndexCount() << " indices" << std::endl;
+                    return true;
+                }
+            }
+
+            // 材质只取基础的颜色参数 贴图不在这里处理
             rapidobj::Result result = rapidobj::ParseFile(path, rapidobj::MaterialLibrary::Default(rapidobj::Load::Optional));
 
             if (result.error) {
                 std::cerr << "Failed to load obj file: " << result.error.code.message() << std::endl;
-                return nullptr;
+                return false;
             }
 
             bool success = rapidobj::Triangulate(result);
 
             if (!success) {
                 std::cerr << result.error.code.message() << '\n';
-                return nullptr;
+                return false;
             }
 
-            std::vector<Vertex> vertices;
-            // std::vector<uint32_t> indices;
+            // 统计面角数量 预留空间
+            size_t cornerCount = 0;
             for (const auto& shape : result.shapes) {
-                for (const auto& index : shape.mesh.indices) {
-                    Vertex vertex{};
-                    vertex.pos = {
-                            result.attributes.positions[index.position_index * 3 + 0],
-                            result.attributes.positions[index.position_index * 3 + 1],
-                            result.attributes.positions[index.position_index * 3 + 2]
-                    };
-
-
-                    if (result.attributes.texcoords.empty()) {
-                        vertex.texCoord = {0.0f, 0.0f};
-                    } else
-                    vertex.texCoord = {
-                        result.attributes.texcoords[2 * index.texcoord_index + 0],
-                        1.0f - result.attributes.texcoords[2 * index.texcoord_index + 1]
-                    };
-
-                    if (result.attributes.normals.empty()) {
-                        vertex.normal = {0.0f, 0.0f, 0.0f};
-                    } else
-                    vertex.normal = {
-                            result.attributes.normals[index.normal_index * 3 + 0],
-                            result.attributes.normals[index.normal_index * 3 + 1],
-                            result.attributes.normals[index.normal_index * 3 + 2]
-                    };
-
-                    vertex.color = {1.0f, 1.0f, 1.0f};
+                cornerCount += shape.mesh.indices.size();
+            }
+
+            // 顶点焊接 相同的顶点只保留一份 通过索引引用
+            std::vector<Vertex>& vertices = mesh.vertices;
+            std::vector<uint32_t>& indices = mesh.indices;
+            std::unordered_map<Vertex, uint32_t> uniqueVertices;
+            uniqueVertices.reserve(cornerCount);
+            indices.reserve(cornerCount);
 
+            auto weld = [&](const rapidobj::Index& index) {
+                Vertex vertex{};
+                vertex.pos = {
+                        result.attributes.positions[index.position_index * 3 + 0],
+                        result.attributes.positions[index.position_index * 3 + 1],
+                        result.attributes.positions[index.position_index * 3 + 2]
+                };
+
+
+                if (result.attributes.texcoords.empty()) {
+                    vertex.texCoord = {0.0f, 0.0f};
+                } else
+                vertex.texCoord = {
+                    result.attributes.texcoords[2 * index.texcoord_index + 0],
+                    1.0f - result.attributes.texcoords[2 * index.texcoord_index + 1]
+                };
+
+                if (result.attributes.normals.empty()) {
+                    vertex.normal = {0.0f, 0.0f, 0.0f};
+                } else
+                vertex.normal = {
+                        result.attributes.normals[index.normal_index * 3 + 0],
+                        result.attributes.normals[index.normal_index * 3 + 1],
+                        result.attributes.normals[index.normal_index * 3 + 2]
+                };
+
+                vertex.color = {1.0f, 1.0f, 1.0f};
+
+                auto [it, inserted] = uniqueVertices.try_emplace(vertex, static_cast<uint32_t>(vertices.size()));
+                if (inserted) {
                     vertices.push_back(vertex);
                 }
+                return it->second;
+            };
+
+            // 每个形状内按材质分组 每组成为一个子网格 组按材质首次出现的顺序排列
+            std::vector<Submesh> parts;
+            std::vector<std::pair<int32_t, std::vector<uint32_t>>> groups;
+            for (const auto& shape : result.shapes) {
+                const auto& shapeIndices = shape.mesh.indices;
+                const auto& materialIds = shape.mesh.material_ids;
+                groups.clear();
+                size_t current = 0;
+                for (size_t f = 0; f * 3 + 2 < shapeIndices.size(); f++) {
+                    int32_t materialId = materialIds.empty() ? -1 : materialIds[f];
+                    if (groups.empty() || groups[current].first != materialId) {
+                        current = 0;
+                        while (current < groups.size() && groups[current].first != materialId) {
+                            current++;
+                        }
+                        if (current == groups.size()) {
+                            groups.emplace_back(materialId, std::vector<uint32_t>());
+                        }
+                    }
+                    for (int k = 0; k < 3; k++) {
+                        groups[current].second.push_back(weld(shapeIndices[f * 3 + k]));
+                    }
+                }
+                for (const auto& [materialId, groupIndices] : groups) {
+                    Submesh part{};
+                    part.firstIndex = static_cast<uint32_t>(indices.size());
+                    part.indexCount = static_cast<uint32_t>(groupIndices.size());
+                    part.materialId = materialId;
+                    parts.push_back(part);
+                    indices.insert(indices.end(), groupIndices.begin(), groupIndices.end());
+                }
+            }
+            mesh.cornerCount = cornerCount;
+
+            for (const auto& material : result.materials) {
+                MaterialInfo info{};
+                for (int k = 0; k < 3; k++) {
+                    info.ambient[k] = material.ambient[k];
+                    info.diffuse[k] = material.diffuse[k];
+                    info.specular[k] = material.specular[k];
+                }
+                info.shininess = material.shininess;
+                mesh.materials.push_back(info);
+            }
+
+            // 三角形与顶点重排 结果会写进缓存 命中缓存时不需要重复优化
+            // 重排只发生在子网格内部 子网格的范围不变
+            VertexCacheStats cacheBefore = MeshOptimizer::analyzeVertexCache(indices.data(), indices.size(),
+                                                                             static_cast<uint32_t>(vertices.size()));
+            MeshOptimizer::optimize(vertices, indices, parts);
+
+            // LOD0按簇重排 绘制时可以逐簇剔除 簇不跨越子网格
+            for (auto& part : parts) {
+                part.firstMeshlet = static_cast<uint32_t>(mesh.meshlets.size());
+                MeshletBuilder::build(vertices, indices, {part.firstIndex, part.indexCount}, mesh.meshlets);
+                part.meshletCount = static_cast<uint32_t>(mesh.meshlets.size()) - part.firstMeshlet;
+            }
+            // 簇内会重新做三角形重排 按最终绘制的LOD0顺序统计
+            MeshOptimizer::report(path, cacheBefore, MeshOptimizer::analyzeVertexCache(indices.data(), indices.size(),
+                                                                                      static_cast<uint32_t>(vertices.size())));
+
+            // LOD链追加在LOD0的索引之后 共用顶点缓冲 各子网格分别简化并带上自己的材质
+            mesh.bounds = MeshSimplifier::computeBounds(vertices);
+            size_t partCount = parts.size();
+            MeshSimplifier::buildLodChain(vertices, indices, mesh.lods, parts);
+            mesh.submeshes = std::move(parts);
+
+            // 顶点数足够少时使用16位索引
+            bool useShortIndices = vertices.size() < 65536;
+            if (useShortIndices) {
+                mesh.shortIndices.assign(indices.begin(), indices.end());
+                indices.clear();
+                indices.shrink_to_fit();
+            }
+
+            // 拆分(压缩)也在工作线程中完成 之后不再需要交错的顶点
+            uint32_t vertexCount = mesh.vertexCount = static_cast<uint32_t>(vertices.size());
+            VertexPacker::split(vertices.data(), vertexCount, mesh.format, mesh.colorStream, mesh.streams);
+            vertices.clear();
+            vertices.shrink_to_fit();
+
+            if (useCache) {
+                // 材质库路径记录在缓存头中 命中时不再读取obj
+                // 只有加载到了材质而开头没有mtllib时才扫描整个文件
+                std::string library = materialLibraryOf(path, true);
+                if (library.empty() && !mesh.materials.empty()) {
+                    library = materialLibraryOf(path);
+                }
+                bool written = useShortIndices ?
+                               MeshCache::write(path, mesh.streams, mesh.format, mesh.colorStream, vertexCount, mesh.shortIndices.data(), static_cast<uint32_t>(mesh.shortIndices.size()), VK_INDEX_TYPE_UINT16, mesh.lods, mesh.bounds, mesh.meshlets, mesh.submeshes, mesh.materials, library) :
+                               MeshCache::write(path, mesh.streams, mesh.format, mesh.colorStream, vertexCount, indices.data(), static_cast<uint32_t>(indices.size()), VK_INDEX_TYPE_UINT32, mesh.lods, mesh.bounds, mesh.meshlets, mesh.submeshes, mesh.materials, library);
+                if (!written) {
+                    std::cerr << "Failed to write mesh cache for " << path << std::endl;
+                }
+            }
+
+            std::cout << "[SimpleObj] " << path << ": " << cornerCount << " corners -> "
+                      << vertexCount << " vertices, dedup ratio "
+                      << (vertexCount == 0 ? 0.0 : static_cast<double>(cornerCount) / vertexCount)
+                      << "x, " << (useShortIndices ? "uint16" : "uint32") << " indices, " << mesh.lods.size() << " LODs, " << mesh.meshlets.size() << " meshlets, "
+                      << partCount << " submeshes" << std::endl;
+            return true;
+        }
+
+        // 上传解析好的网格 需要在主线程调用
+        static std::shared_ptr<ModelBuffer> upload(GeneralBufferManager& allocator, MeshData& mesh) {
+            auto model = allocator.createModelBuffer();
+            model->setIndexed(true);
+            if (mesh.cached != nullptr) {
+                // 映射内存中已经是拆分好的顶点流 直接拷入暂存缓冲
+                allocator.loadVertexStreamsOntoBuffer(model, mesh.cached->getVertexStreams(), mesh.cached->getVertexFormat(),
+                                                      mesh.cached->hasColorStream(), mesh.cached->getVertexCount());
+                allocator.loadIndicesOntoBuffer(model, mesh.cached->getIndexData(), mesh.cached->getIndexCount(), mesh.cached->getIndexType());
+                model->setLods(mesh.cached->getLods());
+                model->setBounds(mesh.cached->getBounds());
+                model->setMeshlets(mesh.cached->getMeshlets());
+                model->setSubmeshes(mesh.cached->getSubmeshes());
+                model->setMaterials(mesh.cached->getMaterials());
+                return model;
+            }
+            allocator.loadVertexStreamsOntoBuffer(model, mesh.streams, mesh.format, mesh.colorStream, mesh.vertexCount);
+            if (!mesh.shortIndices.empty()) {
+                allocator.loadIndicesOntoBuffer(model, mesh.shortIndices);
+            } else {
+                allocator.loadIndicesOntoBuffer(model, mesh.indices);
+            }
+            model->setLods(mesh.lods);
+            model->setBounds(mesh.bounds);
+            model->setMeshlets(std::move(mesh.meshlets));
+            model->setSubmeshes(std::move(mesh.submeshes));
+            model->setMaterials(std::move(mesh.materials));
+            return model;
+        }
+
+        // 加载 obj 到ModelBuffer
+        static std::shared_ptr<ModelBuffer> load(GeneralBufferManager& allocator, const std::string& path, bool useCache = true) {
+            MeshData mesh;
+            mesh.format = allocator.getVertexFormat();
+            mesh.colorStream = allocator.hasColorStream();
+            if (!parse(path, mesh, useCache)) {
+                return nullptr;
             }
+            return upload(allocator, mesh);
+        }
+
+        // 同一路径只加载一次 返回共享的句柄 最后一个句柄释放时销毁
+        // hashContent为true时按文件内容去重
+        static std::shared_ptr<ModelBuffer> acquire(GeneralBufferManager& allocator, const std::string& path, bool useCache = true, bool hashContent = false) {
+            auto key = AssetCache<ModelBuffer>::pathKey("obj", path, hashContent);
+            return allocator.acquireModel(key, [&]() {
+                return load(allocator, path, useCache);
+            });
+        }
+
+        static const uint32_t DEFAULT_STREAM_CHUNK = 1 << 18;
 
-            // std::cout << vertices.size() << std::endl;
+        // 流式加载 用于大于内存的模型 主机内存占用只与chunkVertices有关
+        // 面展开为不焊接的三角形列表直接写入顶点缓冲 不生成索引 LOD 网格簇与子网格 也不写网格缓存
+        static std::shared_ptr<ModelBuffer> loadStreaming(GeneralBufferManager& allocator, const std::string& path,
+                                                          uint32_t chunkVertices = DEFAULT_STREAM_CHUNK) {
+            ObjStream stream;
+            if (!stream.open(path)) {
+                std::cerr << "Failed to load obj file: " << stream.getError() << std::endl;
+                return nullptr;
+            }
+            if (stream.getCornerCount() == 0 || stream.getCornerCount() > UINT32_MAX) {
+                std::cerr << "Failed to load obj file: " << path << " has " << stream.getCornerCount() << " corners" << std::endl;
+                return nullptr;
+            }
+            auto vertexCount = static_cast<uint32_t>(stream.getCornerCount());
 
             auto model = allocator.createModelBuffer();
-            allocator.loadVerticesOntoBuffer(model, vertices);
+            auto uploader = allocator.streamVerticesOntoBuffer(model, vertexCount, stream.getMinPosition(), stream.getMaxPosition(), chunkVertices);
+            std::vector<Vertex> chunk;
+            chunk.reserve(uploader->getChunkVertices());
+            while (stream.read(chunk, uploader->getChunkVertices())) {
+                uploader->append(chunk);
+            }
+            if (stream.failed() || !uploader->finished()) {
+                std::cerr << "Failed to load obj file: "
+                          << (stream.failed() ? stream.getError() : path + " changed while streaming") << std::endl;
+                uploader.reset();
+                allocator.destroyModelBuffer(model->getID());
+                return nullptr;
+            }
+
+            MeshBounds bounds{};
+            bounds.center = (stream.getMinPosition() + stream.getMaxPosition()) * 0.5f;
+            bounds.radius = glm::length(stream.getMaxPosition() - stream.getMinPosition()) * 0.5f;
+            model->setBounds(bounds);
+
+            std::cout << "[SimpleObj] " << path << ": streamed " << vertexCount << " vertices in chunks of "
+                      << uploader->getChunkVertices() << std::endl;
             return model;
         }
+
+        // 异步加载 解析在线程池中进行 上传在主线程每帧开始时完成
+        // 可以先给RenderObject一个占位模型 再用setModelBuffer(handle)在完成后替换
+        static std::shared_ptr<AsyncModelBuffer> loadAsync(GeneralBufferManager& allocator, const std::string& path, bool useCache = true) {
+            // 格式在提交时确定 工作线程不读取allocator
+            auto prepared = ThreadPool::global().submit([path, useCache, format = allocator.getVertexFormat(),
+                                                         colorStream = allocator.hasColorStream()]() {
+                auto mesh = std::make_shared<MeshData>();
+                mesh->format = format;
+                mesh->colorStream = colorStream;
+                if (!parse(path, *mesh, useCache)) {
+                    mesh = nullptr;
+                }
+                return mesh;
+            });
+            return allocator.uploadAsync<std::shared_ptr<MeshData>>(std::move(prepared),
+                [&allocator](std::shared_ptr<MeshData>& mesh) -> std::shared_ptr<ModelBuffer> {
+                    if (mesh == nullptr) {
+                        return nullptr;
+                    }
+                    return upload(allocator, *mesh);
+                });
+        }
     };
 }
 
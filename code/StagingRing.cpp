@@ -0,0 +1,153 @@
+#include "StagingRing.h"
+#include "VulkanApp.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace jk {
+
+    StagingRing::StagingRing(VulkanApp* app, VkDeviceSize capacity)
+            : app(app), device(app->getDevice()), capacity(capacity) {
+        app->createBuffer(capacity, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                          buffer, memory);
+    }
+
+    void StagingRing::reclaim(bool wait) {
+        UploadBatch* batch = app->getUploadBatch();
+        while (!inFlight.empty()) {
+            Submission& submission = inFlight.front();
+            if (wait) {
+                batch->wait(submission.ticket);
+                wait = false;
+            } else if (!batch->isComplete(submission.ticket)) {
+                break;
+            }
+            tail = submission.end;
+            inFlight.pop_front();
+        }
+    }
+
+    StagingRing::Region StagingRing::acquire(VkDeviceSize size, VkDeviceSize alignment) {
+        if (size > capacity) {
+            throw std::runtime_error("staging request exceeds the ring capacity!");
+        }
+        for (;;) {
+            reclaim(false);
+            bool empty = inFlight.empty() && !pending;
+            if (empty) {
+                head = tail = 0;
+            }
+            VkDeviceSize start = (head + alignment - 1) / alignment * alignment;
+            bool found = false;
+            if (empty || head > tail) {
+                // 空闲为[head, capacity)与[0, tail)
+                if (start + size <= capacity) {
+                    found = true;
+                } else if (size <= tail) {
+                    start = 0;
+                    found = true;
+                }
+            } else if (head < tail && start + size <= tail) {
+                found = true;
+            }
+            if (found) {
+                head = start + size;
+                pending = true;
+                return {buffer, start, size, static_cast<uint8_t*>(memory.mapped) + start};
+            }
+            // 只剩当前批次占用的区域 先提交才能等待
+            if (inFlight.empty()) {
+                app->getUploadBatch()->submit();
+                if (inFlight.empty()) {
+                    throw std::runtime_error("staging ring is exhausted!");
+                }
+            }
+            reclaim(true);
+        }
+    }
+
+    void StagingRing::commit(UploadTicket ticket) {
+        if (!pending) {
+            return;
+        }
+        inFlight.push_back({ticket, head});
+        pending = false;
+    }
+
+    void StagingRing::upload(const void* data, VkDeviceSize size, VkDeviceSize granularity,
+                             const std::function<void(VkCommandBuffer&, const Region&, VkDeviceSize)>& record) {
+        granularity = std::max<VkDeviceSize>(granularity, 1);
+        VkDeviceSize chunk = capacity / granularity * granularity;
+        if (chunk == 0) {
+            throw std::runtime_error("upload granularity exceeds the staging ring!");
+        }
+        for (VkDeviceSize offset = 0; offset < size; offset += chunk) {
+            Region region = acquire(std::min(chunk, size - offset));
+            memcpy(region.mapped, static_cast<const uint8_t*>(data) + offset, static_cast<size_t>(region.size));
+            app->getUploadBatch()->record([&](VkCommandBuffer& commandBuffer) {
+                record(commandBuffer, region, offset);
+            });
+        }
+    }
+
+    void StagingRing::uploadBuffers(const std::vector<BufferCopy>& copies) {
+        size_t i = 0;
+        while (i < copies.size()) {
+            if (copies[i].size > capacity) {
+                const BufferCopy& copy = copies[i++];
+                upload(copy.data, copy.size, 1, [&](VkCommandBuffer& commandBuffer, const Region& region, VkDeviceSize offset) {
+                    VkBufferCopy copyRegion{};
+                    copyRegion.srcOffset = region.offset;
+                    copyRegion.dstOffset = copy.dstOffset + offset;
+                    copyRegion.size = region.size;
+                    vkCmdCopyBuffer(commandBuffer, region.buffer, copy.dstBuffer, 1, &copyRegion);
+                });
+                continue;
+            }
+            // 连续放得下的拷贝共用一段暂存区
+            size_t end = i;
+            VkDeviceSize total = 0;
+            while (end < copies.size() && total + copies[end].size <= capacity) {
+                total += copies[end++].size;
+            }
+            if (total > 0) {
+                Region region = acquire(total);
+                VkDeviceSize offset = 0;
+                for (size_t k = i; k < end; k++) {
+                    if (copies[k].size > 0) {
+                        memcpy(region.mapped + offset, copies[k].data, static_cast<size_t>(copies[k].size));
+                    }
+                    offset += copies[k].size;
+                }
+                app->getUploadBatch()->record([&](VkCommandBuffer& commandBuffer) {
+                    VkBufferCopy copyRegion{};
+                    copyRegion.srcOffset = region.offset;
+                    for (size_t k = i; k < end; k++) {
+                        if (copies[k].size > 0) {
+                            copyRegion.dstOffset = copies[k].dstOffset;
+                            copyRegion.size = copies[k].size;
+                            vkCmdCopyBuffer(commandBuffer, region.buffer, copies[k].dstBuffer, 1, &copyRegion);
+                        }
+                        copyRegion.srcOffset += copies[k].size;
+                    }
+                });
+            }
+            i = end;
+        }
+    }
+
+    void StagingRing::cleanup() {
+        if (!inFlight.empty()) {
+            app->getUploadBatch()->wait(inFlight.back().ticket);
+            inFlight.clear();
+        }
+        if (buffer != VK_NULL_HANDLE) {
+            vkDestroyBuffer(device, buffer, nullptr);
+            buffer = VK_NULL_HANDLE;
+        }
+        freeMemory(memory);
+    }
+
+}
@@ -0,0 +1,91 @@
+#ifndef VULKANTEST_STAGINGRING_H
+#define VULKANTEST_STAGINGRING_H
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "MemoryAllocator.h"
+#include "UploadBatch.h"
+
+namespace jk {
+
+    class VulkanApp;
+
+    // 所有上传共用的暂存缓冲 常驻映射 按环形方式分配
+    // UploadBatch提交时commit 该批次完成后此前分配的区域才会被复用
+    // 空间不足时等待最早的批次 只剩未提交的区域时先提交当前批次 单次上传超过容量时由upload分块
+    class StagingRing {
+    public:
+        static constexpr VkDeviceSize DEFAULT_CAPACITY = 32ull * 1024 * 1024;
+        // 满足缓冲到图像拷贝对bufferOffset的对齐要求
+        static constexpr VkDeviceSize DEFAULT_ALIGNMENT = 16;
+
+        struct Region {
+            VkBuffer buffer = VK_NULL_HANDLE;
+            VkDeviceSize offset = 0;
+            VkDeviceSize size = 0;
+            uint8_t* mapped = nullptr;
+        };
+
+        struct BufferCopy {
+            const void* data;
+            VkDeviceSize size;
+            VkBuffer dstBuffer;
+            VkDeviceSize dstOffset;
+        };
+
+        StagingRing(VulkanApp* app, VkDeviceSize capacity = DEFAULT_CAPACITY);
+
+        StagingRing(const StagingRing&) = delete;
+        StagingRing& operator=(const StagingRing&) = delete;
+
+        // 分配连续的size字节 不能超过容量
+        Region acquire(VkDeviceSize size, VkDeviceSize alignment = DEFAULT_ALIGNMENT);
+        // 由UploadBatch在提交时调用 之前分配的区域归属于该批次
+        void commit(UploadTicket ticket);
+
+        // 按granularity的整数倍分块写入暂存区 每块调用一次record录制到当前批次
+        // record的offset为本块在data中的起始位置
+        void upload(const void* data, VkDeviceSize size, VkDeviceSize granularity,
+                    const std::function<void(VkCommandBuffer& commandBuffer, const Region& region, VkDeviceSize offset)>& record);
+        // 能放下的拷贝共用一段暂存区
+        void uploadBuffers(const std::vector<BufferCopy>& copies);
+
+        inline VkDeviceSize getCapacity() const {
+            return capacity;
+        }
+
+        // 需要在UploadBatch::cleanup之前调用
+        void cleanup();
+
+    private:
+        struct Submission {
+            UploadTicket ticket;
+            VkDeviceSize end;
+        };
+
+        VulkanApp* app;
+        VkDevice device;
+        VkDeviceSize capacity;
+
+        VkBuffer buffer = VK_NULL_HANDLE;
+        MemoryAllocation memory;
+
+        // 已用区间为[tail, head) 可能回绕
+        VkDeviceSize head = 0;
+        VkDeviceSize tail = 0;
+        // 已分配但还没有commit
+        bool pending = false;
+        std::deque<Submission> inFlight;
+
+        // 回收已经完成的提交 wait为true时至少等待最早的一个
+        void reclaim(bool wait);
+    };
+
+}
+
+#endif //VULKANTEST_STAGINGRING_H
@@ -0,0 +1,31 @@
+#ifndef VULKANTEST_SUBMESH_H
+#define VULKANTEST_SUBMESH_H
+
+#include <cstdint>
+
+#include "Meshlet.h"
+
+namespace jk {
+
+    // 按形状与材质划分的子网格 所有子网格共用同一个顶点/索引缓冲
+    // ModelBuffer中按LOD依次存放 每级LOD的子网格数量与顺序相同
+    struct Submesh {
+        uint32_t firstIndex = 0;
+        uint32_t indexCount = 0;
+        int32_t materialId = -1;    // 材质库中的下标 -1表示没有材质
+        // 只有LOD0有网格簇
+        uint32_t firstMeshlet = 0;
+        uint32_t meshletCount = 0;
+    };
+
+    // 从mtl读取的基础材质参数 用float数组保证缓存文件布局固定
+    struct MaterialInfo {
+        float ambient[3] = {};      // Ka
+        float diffuse[3] = {};      // Kd
+        float specular[3] = {};     // Ks
+        float shininess = 1.0f;     // Ns
+    };
+
+}
+
+#endif //VULKANTEST_SUBMESH_H
@@ -5,6 +5,8 @@
 #include "SyncManager.h"
 #include "VulkanApp.h"
 
+#include <algorithm>
+
 namespace jk {
 
     SyncManager::SyncManager(CommandManager* commandManager) : commandManager(commandManager) {
@@ -24,6 +26,7 @@ namespace jk {
         imageAvailableSemaphores.resize(VulkanApp::MAX_FRAMES_IN_FLIGHT);
         renderFinishedSemaphores.resize(VulkanApp::MAX_FRAMES_IN_FLIGHT);
         inFlightFences.resize(VulkanApp::MAX_FRAMES_IN_FLIGHT);
+        submittedFrames.assign(VulkanApp::MAX_FRAMES_IN_FLIGHT, 0);
 
         for (size_t i = 0; i < VulkanApp::MAX_FRAMES_IN_FLIGHT; i++) {
             if (vkCreateSemaphore(commandManager->device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
@@ -53,6 +56,8 @@ namespace jk {
 
     void SyncManager::waitFrame() {
         vkWaitForFences(commandManager->device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+        // 同一队列上的提交按顺序完成
+        retiredFrame = std::max(retiredFrame, submittedFrames[currentFrame]);
     }
 
     void SyncManager::acquireNextImage() {
@@ -96,9 +101,10 @@ namespace jk {
         submitInfo.pSignalSemaphores = signalSemaphores;
 
         // 提交命令缓冲
-        if (vkQueueSubmit(commandManager->app->getGraphicsQueue(), 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
+        if (commandManager->app->queueSubmit(commandManager->app->getGraphicsQueue(), 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
             throw std::runtime_error("failed to submit draw command buffer!");
         }
+        submittedFrames[currentFrame] = commandManager->frameCount;
     }
 
     void SyncManager::present() {
@@ -117,7 +123,7 @@ namespace jk {
         presentInfo.pImageIndices = &imageIndex;
 
         // 提交绘制结果
-        VkResult result = vkQueuePresentKHR(commandManager->app->getPresentQueue(), &presentInfo);
+        VkResult result = commandManager->app->queuePresent(presentInfo);
 
         // 检查是否需要重新创建交换链
         if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
@@ -34,6 +34,9 @@ class CommandManager;
         std::vector<VkSemaphore> imageAvailableSemaphores;
         std::vector<VkSemaphore> renderFinishedSemaphores;
         std::vector<VkFence> inFlightFences;
+        // 每个槽位最近一次提交的帧序号
+        std::vector<uint64_t> submittedFrames;
+        uint64_t retiredFrame = 0;
 
         uint32_t currentFrame = 0;
         uint32_t imageIndex = 0;
@@ -54,6 +57,11 @@ class CommandManager;
             return imageIndex;
         }
 
+        // 这一帧及之前的帧都已经执行完毕 在waitFrame时更新
+        inline uint64_t getRetiredFrame() const {
+            return retiredFrame;
+        }
+
         void waitFrame();
         void acquireNextImage();
         void nextFrame();
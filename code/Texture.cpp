@@ -19,18 +19,6 @@ namespace jk {
 
         VkDeviceSize imageSize = width * height * 4;
         
-        VkBuffer stagingBuffer;
-        VkDeviceMemory stagingBufferMemory;
-        
-        app->createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-        
-        void* bufferData;
-        vkMapMemory(device, stagingBufferMemory, 0, imageSize, 0, &bufferData);
-        
-        memcpy(bufferData, data, static_cast<size_t>(imageSize));
-        
-        vkUnmapMemory(device, stagingBufferMemory);
-
         auto useFlags = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
         if (useMipmap)
             useFlags |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
@@ -41,16 +29,28 @@ namespace jk {
         
         transitionImageLayout(texture->baseInfo.image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, texture->mipLevels);
         
-        copyBufferToImage(stagingBuffer, texture->baseInfo.image, static_cast<uint32_t>(width), static_cast<uint32_t>(height));
+        // 经暂存环按整行分块拷贝 大纹理不需要同样大的暂存缓冲
+        VkDeviceSize rowSize = static_cast<VkDeviceSize>(width) * 4;
+        app->getStagingRing()->upload(data, imageSize, rowSize,
+            [&](VkCommandBuffer& commandBuffer, const StagingRing::Region& region, VkDeviceSize offset) {
+                copyBufferToImage(commandBuffer, region.buffer, region.offset, texture->baseInfo.image, static_cast<uint32_t>(width),
+                                  static_cast<uint32_t>(offset / rowSize), static_cast<uint32_t>(region.size / rowSize));
+            });
         
+        // 上传在传输队列上完成后把所有权交给图形队列
+        // 生成mipmap需要图形队列 所有权转移时保持传输目标布局
+        auto batch = app->getUploadBatch();
         if (!useMipmap)
-            transitionImageLayout(texture->baseInfo.image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, texture->mipLevels);
-        
-        vkDestroyBuffer(device, stagingBuffer, nullptr);
-        vkFreeMemory(device, stagingBufferMemory, nullptr);
-
-        if (useMipmap)
+            batch->transferImage(texture->baseInfo.image, texture->mipLevels,
+                                 VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+        if (useMipmap) {
+            batch->transferImage(texture->baseInfo.image, texture->mipLevels,
+                                 VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                 VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT);
             generateMipmaps(texture->baseInfo.image, VK_FORMAT_R8G8B8A8_SRGB, width, height, texture->mipLevels);
+        }
         
     }
 
@@ -76,7 +76,7 @@ namespace jk {
             throw std::runtime_error("texture image format does not support linear blitting!");
         }
 
-        app->getCommandManager()->excuteCommand([&](VkCommandBuffer &commandBuffer)
+        app->getUploadBatch()->recordGraphics([&](VkCommandBuffer &commandBuffer)
                                                 {
                                                     // 设置内存屏障
 
@@ -190,7 +190,7 @@ namespace jk {
 
     void TextureManager::transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels) {
 
-        app->getCommandManager()->excuteCommand([&](VkCommandBuffer& commandBuffer)
+        app->getUploadBatch()->record([&](VkCommandBuffer& commandBuffer)
             {
                 // 设置内存屏障
                 VkImageMemoryBarrier barrier{};
@@ -237,24 +237,22 @@ namespace jk {
     }
 
 
-    void TextureManager::copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height) {
-        app->getCommandManager()->excuteCommand([&](VkCommandBuffer& commandBuffer)
-            {
-                // 设置拷贝区域
-                VkBufferImageCopy region{};
-                region.bufferOffset = 0; // 缓冲偏移
-                region.bufferRowLength = 0; // 缓冲行长度
-                region.bufferImageHeight = 0; // 缓冲图像高度
-                region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT; // 图像方面
-                region.imageSubresource.mipLevel = 0; // mipmap层级
-                region.imageSubresource.baseArrayLayer = 0; // 图像基数组层
-                region.imageSubresource.layerCount = 1; // 图像数组层数量
-                region.imageOffset = {0, 0, 0}; // 图像偏移
-                region.imageExtent = {width, height, 1}; // 图像范围
-
-                // 执行拷贝
-                vkCmdCopyBufferToImage(commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-        });
+    void TextureManager::copyBufferToImage(VkCommandBuffer& commandBuffer, VkBuffer buffer, VkDeviceSize bufferOffset, VkImage image,
+                                           uint32_t width, uint32_t firstRow, uint32_t rowCount) {
+        // 设置拷贝区域
+        VkBufferImageCopy region{};
+        region.bufferOffset = bufferOffset; // 缓冲偏移
+        region.bufferRowLength = 0; // 缓冲行长度
+        region.bufferImageHeight = 0; // 缓冲图像高度
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT; // 图像方面
+        region.imageSubresource.mipLevel = 0; // mipmap层级
+        region.imageSubresource.baseArrayLayer = 0; // 图像基数组层
+        region.imageSubresource.layerCount = 1; // 图像数组层数量
+        region.imageOffset = {0, static_cast<int32_t>(firstRow), 0}; // 图像偏移
+        region.imageExtent = {width, rowCount, 1}; // 图像范围
+
+        // 执行拷贝
+        vkCmdCopyBufferToImage(commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
     }
 
     // Texture::Texture() {
@@ -268,13 +266,18 @@ namespace jk {
         vkDestroySampler(device, textureSampler, nullptr);
         vkDestroyImageView(device, baseInfo.imageView, nullptr);
         vkDestroyImage(device, baseInfo.image, nullptr);
-        vkFreeMemory(device, baseInfo.imageMemory, nullptr);
+        freeMemory(baseInfo.imageMemory);
     }
 
-    TextureManager::TextureManager(VulkanApp *app, ResourceHelper& resourceHelper) : ResourceUser(app) {
+    TextureManager::TextureManager(VulkanApp *app, ResourceHelper& resourceHelper) : ResourceUser(app),
+        textureCache([this](std::shared_ptr<Texture>& texture) { destroyTexture(texture->getID()); }) {
         this->device = app->getDevice();
     }
 
+    std::vector<MemoryHeapStats> TextureManager::getMemoryStats() const {
+        return app->getMemoryAllocator()->getHeapStats();
+    }
+
     // load Texture
 
     void TextureManager::wrapTexture(std::shared_ptr<Texture>& texture) {
@@ -302,6 +305,14 @@ namespace jk {
         return texture;
     }
 
+    std::shared_ptr<Texture> TextureManager::acquireTexture(const std::string& filePath, bool useMipmap, MipMapSamplerInfo samplerInfo, bool hashContent) {
+        auto key = AssetCache<Texture>::makeKey(AssetCache<Texture>::pathKey("texture", filePath, hashContent), useMipmap,
+                                                samplerInfo.mipLodBias, samplerInfo.minLodRate, samplerInfo.maxLodRate);
+        return textureCache.acquire(key, [&]() {
+            return loadTexture(filePath, useMipmap, samplerInfo);
+        });
+    }
+
     std::shared_ptr<Texture> TextureManager::createFilledTexture(int width, int height, glm::vec3 color, bool useMipmap, MipMapSamplerInfo samplerInfo) {
         auto texture = std::make_shared<Texture>();
         resourceHelper.createResource(std::static_pointer_cast<IResource>(texture));
@@ -325,7 +336,7 @@ namespace jk {
 
     // destroy Texture
     void TextureManager::destroyTexture(uint32_t resID) {
-        resourceHelper.destroyResource(resID, device);
+        app->getDeletionQueue()->push(resourceHelper.detachResource(resID));
     }
 
     void TextureManager::cleanup() {
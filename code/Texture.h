@@ -24,6 +24,8 @@
 
 #include "ResourceHelper.hpp"
 #include "Descriptor.h"
+#include "MemoryAllocator.h"
+#include "AssetCache.h"
 
 namespace jk {
 
@@ -39,7 +41,7 @@ namespace jk {
     struct TextureBaseInfo {
         VkImage image;
         VkImageView imageView;
-        VkDeviceMemory imageMemory;
+        MemoryAllocation imageMemory;
     };
 
     class Texture : public IResource {
@@ -111,6 +113,18 @@ namespace jk {
         std::shared_ptr<Texture> getTexture(uint32_t resID);
         void destroyTexture(uint32_t resID);
 
+        // 按路径与采样参数去重 相同的纹理只上传一次 最后一个句柄释放时销毁
+        // hashContent为true时按文件内容去重 不同路径下的相同文件也共用
+        std::shared_ptr<Texture> acquireTexture(const std::string& filePath, bool useMipmap = false, MipMapSamplerInfo samplerInfo = {0.0f, 0.0f, 1.0f},
+                                                bool hashContent = false);
+
+        inline const AssetCache<Texture>& getTextureCache() const {
+            return textureCache;
+        }
+
+        // 各个堆的设备内存使用情况 与缓冲共用同一个分配器
+        std::vector<MemoryHeapStats> getMemoryStats() const;
+
         void cleanup();
 
         friend class SwapChain;
@@ -118,6 +132,8 @@ namespace jk {
 
         VkDevice device;
 
+        AssetCache<Texture> textureCache;
+
         void initDepthResource();
         void destroyDepthResource();
 
@@ -131,7 +147,9 @@ namespace jk {
 
         void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels = 1);
         void generateMipmaps(VkImage image, VkFormat imageFormat, int32_t texWidth, int32_t texHeight, uint32_t mipLevels);
-        void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height);
+        // 只拷贝从firstRow开始的rowCount行 由暂存环分块调用
+        void copyBufferToImage(VkCommandBuffer& commandBuffer, VkBuffer buffer, VkDeviceSize bufferOffset, VkImage image,
+                               uint32_t width, uint32_t firstRow, uint32_t rowCount);
     };
 
 }
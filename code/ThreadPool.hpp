@@ -0,0 +1,92 @@
+#ifndef VULKANTEST_THREADPOOL_H
+#define VULKANTEST_THREADPOOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace jk {
+
+    // 简单的工作线程池 用于资源加载等不涉及vulkan调用的CPU任务
+    class ThreadPool {
+    private:
+        std::vector<std::thread> workers;
+        std::queue<std::function<void()>> tasks;
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool stopping = false;
+
+        void workerLoop() {
+            for (;;) {
+                std::function<void()> task;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    condition.wait(lock, [this] { return stopping || !tasks.empty(); });
+                    if (stopping && tasks.empty()) {
+                        return;
+                    }
+                    task = std::move(tasks.front());
+                    tasks.pop();
+                }
+                task();
+            }
+        }
+    public:
+        explicit ThreadPool(size_t threadCount = std::thread::hardware_concurrency()) {
+            if (threadCount == 0) {
+                threadCount = 1;
+            }
+            workers.reserve(threadCount);
+            for (size_t i = 0; i < threadCount; i++) {
+                workers.emplace_back(&ThreadPool::workerLoop, this);
+            }
+        }
+
+        ~ThreadPool() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            condition.notify_all();
+            for (auto& worker : workers) {
+                worker.join();
+            }
+        }
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        template<typename F>
+        auto submit(F&& func) -> std::future<std::invoke_result_t<std::decay_t<F>>> {
+            using R = std::invoke_result_t<std::decay_t<F>>;
+            // packaged_task不可拷贝 包一层shared_ptr才能放进std::function
+            auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(func));
+            auto future = task->get_future();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                tasks.emplace([task] { (*task)(); });
+            }
+            condition.notify_one();
+            return future;
+        }
+
+        inline size_t size() const {
+            return workers.size();
+        }
+
+        // 全局加载线程池 按核心数创建
+        static ThreadPool& global() {
+            static ThreadPool pool;
+            return pool;
+        }
+    };
+
+}
+
+#endif //VULKANTEST_THREADPOOL_H
@@ -0,0 +1,417 @@
+#include "UploadBatch.h"
+#include "VulkanApp.h"
+
+#include <stdexcept>
+
+namespace jk {
+
+    UploadBatch::UploadBatch(VulkanApp* app) : app(app), device(app->getDevice()) {
+        const QueueFamilyIndices& queueFamilies = app->getQueueFamilies();
+        transferFamily = queueFamilies.transferFamily.value();
+        graphicsFamily = queueFamilies.graphicsFamily.value();
+        dedicated = transferFamily != graphicsFamily;
+        transferQueue = app->getTransferQueue();
+
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.queueFamilyIndex = transferFamily;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+        if (vkCreateCommandPool(device, &poolInfo, nullptr, &transferPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create upload command pool!");
+        }
+
+        // 获取所有权的命令在图形队列上执行
+        if (dedicated) {
+            poolInfo.queueFamilyIndex = graphicsFamily;
+            if (vkCreateCommandPool(device, &poolInfo, nullptr, &graphicsPool) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create upload acquire command pool!");
+            }
+        }
+    }
+
+    VkCommandBuffer UploadBatch::begin(VkCommandPool pool, std::vector<VkCommandBuffer>& freeList) {
+        VkCommandBuffer commandBuffer;
+        if (freeList.empty()) {
+            VkCommandBufferAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.commandPool = pool;
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            allocInfo.commandBufferCount = 1;
+            if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+                throw std::runtime_error("failed to allocate upload command buffer!");
+            }
+        } else {
+            commandBuffer = freeList.back();
+            freeList.pop_back();
+            vkResetCommandBuffer(commandBuffer, 0);
+        }
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("failed to begin recording upload command buffer!");
+        }
+        return commandBuffer;
+    }
+
+    VkFence UploadBatch::takeFence() {
+        if (!freeFences.empty()) {
+            VkFence fence = freeFences.back();
+            freeFences.pop_back();
+            return fence;
+        }
+        VkFenceCreateInfo fenceInfo{};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        VkFence fence;
+        if (vkCreateFence(device, &fenceInfo, nullptr, &fence) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create upload fence!");
+        }
+        return fence;
+    }
+
+    VkSemaphore UploadBatch::takeSemaphore() {
+        if (!freeSemaphores.empty()) {
+            VkSemaphore semaphore = freeSemaphores.back();
+            freeSemaphores.pop_back();
+            return semaphore;
+        }
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        VkSemaphore semaphore;
+        if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create upload semaphore!");
+        }
+        return semaphore;
+    }
+
+    void UploadBatch::record(const std::function<void(VkCommandBuffer&)>& func) {
+        if (recording == VK_NULL_HANDLE) {
+            recording = begin(transferPool, freeCommandBuffers);
+        }
+        func(recording);
+    }
+
+    void UploadBatch::recordGraphics(const std::function<void(VkCommandBuffer&)>& func) {
+        if (!dedicated) {
+            record(func);
+            return;
+        }
+        if (acquiring == VK_NULL_HANDLE) {
+            acquiring = begin(graphicsPool, freeAcquireCommandBuffers);
+        }
+        func(acquiring);
+    }
+
+    void UploadBatch::transferBuffer(VkBuffer buffer) {
+        // 同一队列族时由提交末尾的屏障负责可见性
+        if (!dedicated) {
+            return;
+        }
+        VkBufferMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = transferFamily;
+        barrier.dstQueueFamilyIndex = graphicsFamily;
+        barrier.buffer = buffer;
+        barrier.offset = 0;
+        barrier.size = VK_WHOLE_SIZE;
+
+        // 释放操作的目标访问被忽略
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = 0;
+        record([&](VkCommandBuffer& commandBuffer) {
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                                 0, 0, nullptr, 1, &barrier, 0, nullptr);
+        });
+
+        // 获取操作的源访问被忽略
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT |
+                                VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+        recordGraphics([&](VkCommandBuffer& commandBuffer) {
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                                 VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+                                 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                                 0, 0, nullptr, 1, &barrier, 0, nullptr);
+        });
+    }
+
+    void UploadBatch::transferImage(VkImage image, uint32_t mipLevels, VkImageLayout oldLayout, VkImageLayout newLayout,
+                                    VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = oldLayout;
+        barrier.newLayout = newLayout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = mipLevels;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+
+        if (!dedicated) {
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = dstAccess;
+            record([&](VkCommandBuffer& commandBuffer) {
+                vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage,
+                                     0, 0, nullptr, 0, nullptr, 1, &barrier);
+            });
+            return;
+        }
+
+        // 释放与获取使用相同的布局 布局转换只执行一次
+        barrier.srcQueueFamilyIndex = transferFamily;
+        barrier.dstQueueFamilyIndex = graphicsFamily;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = 0;
+        record([&](VkCommandBuffer& commandBuffer) {
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                                 0, 0, nullptr, 0, nullptr, 1, &barrier);
+        });
+
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = dstAccess;
+        recordGraphics([&](VkCommandBuffer& commandBuffer) {
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStage,
+                                 0, 0, nullptr, 0, nullptr, 1, &barrier);
+        });
+    }
+
+    UploadTicket UploadBatch::submit(bool deferred) {
+        if (recording == VK_NULL_HANDLE) {
+            // 只有图形队列上的处理时也需要一个空的传输批次来串联
+            if (acquiring == VK_NULL_HANDLE) {
+                return lastTicket;
+            }
+            recording = begin(transferPool, freeCommandBuffers);
+        }
+
+        if (!dedicated) {
+            // 之后提交的命令都能看到本批次写入的内容
+            VkMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT |
+                                    VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT |
+                                    VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+            vkCmdPipelineBarrier(recording, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                 VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+                                 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                 0, 1, &barrier, 0, nullptr, 0, nullptr);
+        }
+
+        if (vkEndCommandBuffer(recording) != VK_SUCCESS) {
+            throw std::runtime_error("failed to record upload command buffer!");
+        }
+
+        Submission submission{};
+        submission.ticket = lastTicket + 1;
+        submission.fence = takeFence();
+        submission.commandBuffer = recording;
+        submission.deferred = deferred;
+        submission.acquired = !dedicated;
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &recording;
+        if (dedicated) {
+            submission.semaphore = takeSemaphore();
+            submitInfo.signalSemaphoreCount = 1;
+            submitInfo.pSignalSemaphores = &submission.semaphore;
+            // 没有单独的获取命令时也要在图形队列上等待信号量
+            if (acquiring == VK_NULL_HANDLE) {
+                acquiring = begin(graphicsPool, freeAcquireCommandBuffers);
+            }
+            submission.acquireCommandBuffer = acquiring;
+        }
+        if (app->queueSubmit(transferQueue, 1, &submitInfo, submission.fence) != VK_SUCCESS) {
+            throw std::runtime_error("failed to submit upload command buffer!");
+        }
+
+        lastTicket = submission.ticket;
+        inFlight.push_back(submission);
+        recording = VK_NULL_HANDLE;
+        acquiring = VK_NULL_HANDLE;
+        // 本批次用到的暂存区在票据完成后回收
+        app->getStagingRing()->commit(submission.ticket);
+        collect();
+        return submission.ticket;
+    }
+
+    void UploadBatch::submitAcquire(Submission& submission) {
+        VkCommandBuffer commandBuffer = submission.acquireCommandBuffer;
+
+        // 共享的缓冲没有所有权转移 之后的帧通过这个屏障看到写入
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT |
+                                VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT |
+                                VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                             VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+                             VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to record upload acquire command buffer!");
+        }
+
+        // 传输已经完成时信号量已触发 不会阻塞图形队列
+        VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.waitSemaphoreCount = 1;
+        submitInfo.pWaitSemaphores = &submission.semaphore;
+        submitInfo.pWaitDstStageMask = &waitStage;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffer;
+
+        submission.acquireFence = takeFence();
+        if (app->queueSubmit(app->getGraphicsQueue(), 1, &submitInfo, submission.acquireFence) != VK_SUCCESS) {
+            throw std::runtime_error("failed to submit upload acquire command buffer!");
+        }
+        submission.acquired = true;
+    }
+
+    void UploadBatch::flush() {
+        submit();
+        for (auto& submission : inFlight) {
+            if (submission.acquired) {
+                continue;
+            }
+            // deferred批次完成后才获取 普通批次由图形队列等待
+            if (!submission.deferred || vkGetFenceStatus(device, submission.fence) == VK_SUCCESS) {
+                submitAcquire(submission);
+            }
+        }
+        collect();
+    }
+
+    void UploadBatch::finish() {
+        wait(submit());
+        for (auto& submission : inFlight) {
+            if (!submission.acquired) {
+                submitAcquire(submission);
+            }
+        }
+        for (auto& submission : inFlight) {
+            if (submission.acquireFence != VK_NULL_HANDLE) {
+                vkWaitForFences(device, 1, &submission.acquireFence, VK_TRUE, UINT64_MAX);
+            }
+        }
+        collect();
+    }
+
+    void UploadBatch::retire(Submission& submission) {
+        vkResetFences(device, 1, &submission.fence);
+        freeFences.push_back(submission.fence);
+        freeCommandBuffers.push_back(submission.commandBuffer);
+        if (submission.semaphore != VK_NULL_HANDLE) {
+            // 已经被获取命令等待过 可以复用
+            freeSemaphores.push_back(submission.semaphore);
+        }
+        if (submission.acquireFence != VK_NULL_HANDLE) {
+            vkResetFences(device, 1, &submission.acquireFence);
+            freeFences.push_back(submission.acquireFence);
+        }
+        if (submission.acquireCommandBuffer != VK_NULL_HANDLE) {
+            freeAcquireCommandBuffers.push_back(submission.acquireCommandBuffer);
+        }
+        completedTicket = submission.ticket;
+    }
+
+    void UploadBatch::collect() {
+        while (!inFlight.empty()) {
+            Submission& submission = inFlight.front();
+            if (!submission.acquired || vkGetFenceStatus(device, submission.fence) != VK_SUCCESS) {
+                break;
+            }
+            if (submission.acquireFence != VK_NULL_HANDLE &&
+                vkGetFenceStatus(device, submission.acquireFence) != VK_SUCCESS) {
+                break;
+            }
+            retire(submission);
+            inFlight.pop_front();
+        }
+    }
+
+    UploadBatch::Submission* UploadBatch::find(UploadTicket ticket) {
+        for (auto& submission : inFlight) {
+            if (submission.ticket == ticket) {
+                return &submission;
+            }
+        }
+        return nullptr;
+    }
+
+    bool UploadBatch::isComplete(UploadTicket ticket) {
+        if (ticket <= completedTicket) {
+            return true;
+        }
+        Submission* submission = find(ticket);
+        return submission == nullptr || vkGetFenceStatus(device, submission->fence) == VK_SUCCESS;
+    }
+
+    void UploadBatch::wait(UploadTicket ticket) {
+        for (auto& submission : inFlight) {
+            if (submission.ticket > ticket) {
+                break;
+            }
+            vkWaitForFences(device, 1, &submission.fence, VK_TRUE, UINT64_MAX);
+        }
+        collect();
+    }
+
+    bool UploadBatch::isReady(UploadTicket ticket) {
+        if (ticket <= completedTicket) {
+            return true;
+        }
+        Submission* submission = find(ticket);
+        return submission == nullptr || submission->acquired;
+    }
+
+    void UploadBatch::cleanup() {
+        if (recording != VK_NULL_HANDLE) {
+            vkEndCommandBuffer(recording);
+            recording = VK_NULL_HANDLE;
+        }
+        if (acquiring != VK_NULL_HANDLE) {
+            vkEndCommandBuffer(acquiring);
+            acquiring = VK_NULL_HANDLE;
+        }
+        for (auto& submission : inFlight) {
+            vkWaitForFences(device, 1, &submission.fence, VK_TRUE, UINT64_MAX);
+            vkDestroyFence(device, submission.fence, nullptr);
+            if (submission.acquireFence != VK_NULL_HANDLE) {
+                vkWaitForFences(device, 1, &submission.acquireFence, VK_TRUE, UINT64_MAX);
+                vkDestroyFence(device, submission.acquireFence, nullptr);
+            }
+            if (submission.semaphore != VK_NULL_HANDLE) {
+                vkDestroySemaphore(device, submission.semaphore, nullptr);
+            }
+        }
+        inFlight.clear();
+        completedTicket = lastTicket;
+        for (auto fence : freeFences) {
+            vkDestroyFence(device, fence, nullptr);
+        }
+        freeFences.clear();
+        for (auto semaphore : freeSemaphores) {
+            vkDestroySemaphore(device, semaphore, nullptr);
+        }
+        freeSemaphores.clear();
+        freeCommandBuffers.clear();
+        freeAcquireCommandBuffers.clear();
+        // 命令缓冲随命令池一起释放
+        vkDestroyCommandPool(device, transferPool, nullptr);
+        if (graphicsPool != VK_NULL_HANDLE) {
+            vkDestroyCommandPool(device, graphicsPool, nullptr);
+        }
+    }
+
+}
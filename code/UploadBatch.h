@@ -0,0 +1,112 @@
+#ifndef VULKANTEST_UPLOADBATCH_H
+#define VULKANTEST_UPLOADBATCH_H
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+namespace jk {
+
+    class VulkanApp;
+
+    // 提交后返回的票据 按提交顺序递增 0表示没有提交过
+    using UploadTicket = uint64_t;
+
+    // 上传命令的批次 拷贝与布局转换都录制到同一个命令缓冲中 submit时一次提交 不等待队列
+    // 有独立的传输队列族时在传输队列上执行 完成后由图形队列上的获取命令接管资源的所有权
+    // 每帧提交前调用flush 普通批次在本帧之前获取(必要时GPU等待) deferred批次完成后才获取 不阻塞渲染
+    // 没有独立传输队列时退化为图形队列上的单个命令缓冲 末尾的屏障保证之后的帧能看到写入
+    class UploadBatch {
+    private:
+        struct Submission {
+            UploadTicket ticket;
+            VkFence fence;
+            VkCommandBuffer commandBuffer;
+            // 以下只在独立传输队列时使用
+            VkSemaphore semaphore;
+            VkCommandBuffer acquireCommandBuffer;
+            VkFence acquireFence;
+            bool deferred;
+            bool acquired;
+        };
+
+        VulkanApp* app;
+        VkDevice device;
+        uint32_t transferFamily;
+        uint32_t graphicsFamily;
+        bool dedicated;
+        VkQueue transferQueue;
+
+        VkCommandPool transferPool = VK_NULL_HANDLE;
+        VkCommandPool graphicsPool = VK_NULL_HANDLE;
+
+        // 正在录制的命令缓冲 没有时为空
+        VkCommandBuffer recording = VK_NULL_HANDLE;
+        VkCommandBuffer acquiring = VK_NULL_HANDLE;
+        UploadTicket lastTicket = 0;
+        UploadTicket completedTicket = 0;
+        std::deque<Submission> inFlight;
+        std::vector<VkFence> freeFences;
+        std::vector<VkSemaphore> freeSemaphores;
+        std::vector<VkCommandBuffer> freeCommandBuffers;
+        std::vector<VkCommandBuffer> freeAcquireCommandBuffers;
+
+        VkCommandBuffer begin(VkCommandPool pool, std::vector<VkCommandBuffer>& freeList);
+        VkFence takeFence();
+        VkSemaphore takeSemaphore();
+        void submitAcquire(Submission& submission);
+        void retire(Submission& submission);
+        Submission* find(UploadTicket ticket);
+    public:
+        UploadBatch(VulkanApp* app);
+
+        UploadBatch(const UploadBatch&) = delete;
+        UploadBatch& operator=(const UploadBatch&) = delete;
+
+        // 录制到当前批次的传输命令 没有打开的批次时开始一个新的
+        // 在func中不要再申请暂存区 暂存区不足时会提交当前批次
+        void record(const std::function<void(VkCommandBuffer& commandBuffer)>& func);
+        // 需要图形队列的后续处理 如生成mipmap 在资源所有权转移之后执行
+        void recordGraphics(const std::function<void(VkCommandBuffer& commandBuffer)>& func);
+
+        // 写入完成后把所有权交给图形队列族 同一队列族时只做必要的布局转换
+        void transferBuffer(VkBuffer buffer);
+        void transferImage(VkImage image, uint32_t mipLevels, VkImageLayout oldLayout, VkImageLayout newLayout,
+                           VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+
+        // 只录制了图形队列上的获取或后续处理时也算 需要submit
+        inline bool hasPending() const {
+            return recording != VK_NULL_HANDLE || acquiring != VK_NULL_HANDLE;
+        }
+
+        inline bool hasDedicatedQueue() const {
+            return dedicated;
+        }
+
+        // 没有录制内容时返回上一次的票据
+        // deferred为true时帧循环不会等待它 需要用isReady确认后再使用其中的资源
+        UploadTicket submit(bool deferred = false);
+
+        // 每帧提交前调用
+        void flush();
+        // 等待所有批次完成并被图形队列获取 用于需要独占资源的操作
+        void finish();
+
+        // 回收已经完成的批次
+        void collect();
+        // 传输命令执行完毕 暂存区可以复用
+        bool isComplete(UploadTicket ticket);
+        void wait(UploadTicket ticket);
+        // 所有权已经转移 之后提交的帧可以使用其中的资源
+        bool isReady(UploadTicket ticket);
+
+        // 未提交的内容直接丢弃 等待已提交的批次完成
+        void cleanup();
+    };
+
+}
+
+#endif //VULKANTEST_UPLOADBATCH_H
@@ -6,6 +6,8 @@
 #define VULKANTEST_VERTEX_H
 
 #include <array>
+#include <cstring>
+#include <functional>
 
 #include <glm/glm.hpp>
 #include <vulkan/vulkan.h>
@@ -60,4 +62,28 @@ namespace jk {
 
 }
 
+namespace std {
+
+    // 顶点去重用的哈希 与operator==保持一致
+    template<> struct hash<jk::Vertex> {
+        static inline void combine(size_t& seed, float v) {
+            // -0.0f == 0.0f 但二者位模式不同 先归一化
+            v += 0.0f;
+            uint32_t bits;
+            memcpy(&bits, &v, sizeof(bits));
+            seed ^= std::hash<uint32_t>()(bits) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+        }
+
+        size_t operator()(const jk::Vertex& vertex) const {
+            size_t seed = 0;
+            for (int i = 0; i < 3; i++) combine(seed, vertex.pos[i]);
+            for (int i = 0; i < 3; i++) combine(seed, vertex.normal[i]);
+            for (int i = 0; i < 3; i++) combine(seed, vertex.color[i]);
+            for (int i = 0; i < 2; i++) combine(seed, vertex.texCoord[i]);
+            return seed;
+        }
+    };
+
+}
+
 #endif //VULKANTEST_VERTEX_H
@@ -0,0 +1,272 @@
+#ifndef VULKANTEST_VERTEXFORMAT_H
+#define VULKANTEST_VERTEXFORMAT_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+#include <vulkan/vulkan.h>
+
+#include "Vertex.h"
+
+namespace jk {
+
+    // 顶点缓冲布局 位置与其它属性分成两个流存放
+    // 只读位置的深度pass(阴影等)只需绑定紧凑的位置流
+    // Full为原始精度 位置12字节 属性32字节
+    // Packed与PackedHalf位置8字节 属性8字节 着色器看到的仍是float 不需要修改
+    enum class VertexFormat : uint32_t {
+        Full = 0,
+        Packed,         // 位置按包围盒归一化为16位snorm 反量化矩阵并入模型矩阵
+        PackedHalf,     // 位置为半精度浮点 适合不在意精度的小模型
+    };
+
+    // Full格式的属性流 与Vertex中除位置外的部分一致
+    struct VertexAttributes {
+        glm::vec3 normal;
+        glm::vec3 color;
+        glm::vec2 texCoord;
+    };
+
+    struct PackedPosition {
+        uint16_t pos[4];
+    };
+    static_assert(sizeof(PackedPosition) == 8, "PackedPosition must stay 8 bytes");
+
+    // 法线为8位snorm 纹理坐标为半精度浮点
+    struct PackedAttributes {
+        int8_t normal[4];
+        uint16_t texCoord[2];
+    };
+    static_assert(sizeof(PackedAttributes) == 8, "PackedAttributes must stay 8 bytes");
+
+    // 压缩格式下可选的颜色流
+    struct VertexColor {
+        uint8_t rgba[4];
+    };
+
+    #define VERTEX_POSITION_BINDING 0
+    #define VERTEX_ATTRIBUTE_BINDING 1
+    #define VERTEX_COLOR_BINDING 2
+
+    // 编译期生成的顶点输入描述
+    // ColorStream为false时颜色绑定的步长为0 所有顶点读同一个常量颜色
+    template<VertexFormat Format, bool ColorStream = false>
+    struct VertexLayout;
+
+    template<bool ColorStream>
+    struct VertexLayout<VertexFormat::Full, ColorStream> {
+        static constexpr std::array<VkVertexInputBindingDescription, 2> bindings = {{
+            {VERTEX_POSITION_BINDING, sizeof(glm::vec3), VK_VERTEX_INPUT_RATE_VERTEX},
+            {VERTEX_ATTRIBUTE_BINDING, sizeof(VertexAttributes), VK_VERTEX_INPUT_RATE_VERTEX},
+        }};
+        static constexpr std::array<VkVertexInputAttributeDescription, 4> attributes = {{
+            {0, VERTEX_POSITION_BINDING, VK_FORMAT_R32G32B32_SFLOAT, 0},
+            {1, VERTEX_ATTRIBUTE_BINDING, VK_FORMAT_R32G32B32_SFLOAT, offsetof(VertexAttributes, normal)},
+            {2, VERTEX_ATTRIBUTE_BINDING, VK_FORMAT_R32G32B32_SFLOAT, offsetof(VertexAttributes, color)},
+            {3, VERTEX_ATTRIBUTE_BINDING, VK_FORMAT_R32G32_SFLOAT, offsetof(VertexAttributes, texCoord)},
+        }};
+        static constexpr VkFormat positionFormat = VK_FORMAT_R32G32B32_SFLOAT;
+        static constexpr uint32_t positionStride = sizeof(glm::vec3);
+    };
+
+    template<VertexFormat Format, bool ColorStream>
+    struct PackedVertexLayout {
+        static constexpr VkFormat positionFormat = Format == VertexFormat::Packed ?
+                                                   VK_FORMAT_R16G16B16A16_SNORM : VK_FORMAT_R16G16B16A16_SFLOAT;
+        static constexpr uint32_t positionStride = sizeof(PackedPosition);
+        static constexpr std::array<VkVertexInputBindingDescription, 3> bindings = {{
+            {VERTEX_POSITION_BINDING, sizeof(PackedPosition), VK_VERTEX_INPUT_RATE_VERTEX},
+            {VERTEX_ATTRIBUTE_BINDING, sizeof(PackedAttributes), VK_VERTEX_INPUT_RATE_VERTEX},
+            {VERTEX_COLOR_BINDING, ColorStream ? static_cast<uint32_t>(sizeof(VertexColor)) : 0u, VK_VERTEX_INPUT_RATE_VERTEX},
+        }};
+        static constexpr std::array<VkVertexInputAttributeDescription, 4> attributes = {{
+            {0, VERTEX_POSITION_BINDING, positionFormat, 0},
+            {1, VERTEX_ATTRIBUTE_BINDING, VK_FORMAT_R8G8B8A8_SNORM, offsetof(PackedAttributes, normal)},
+            {2, VERTEX_COLOR_BINDING, VK_FORMAT_R8G8B8A8_UNORM, 0},
+            {3, VERTEX_ATTRIBUTE_BINDING, VK_FORMAT_R16G16_SFLOAT, offsetof(PackedAttributes, texCoord)},
+        }};
+    };
+
+    template<bool ColorStream>
+    struct VertexLayout<VertexFormat::Packed, ColorStream> : PackedVertexLayout<VertexFormat::Packed, ColorStream> {};
+
+    template<bool ColorStream>
+    struct VertexLayout<VertexFormat::PackedHalf, ColorStream> : PackedVertexLayout<VertexFormat::PackedHalf, ColorStream> {};
+
+    // 深度pass只声明位置流
+    template<VertexFormat Format>
+    struct DepthVertexLayout {
+        static constexpr std::array<VkVertexInputBindingDescription, 1> bindings = {{
+            {VERTEX_POSITION_BINDING, VertexLayout<Format>::positionStride, VK_VERTEX_INPUT_RATE_VERTEX},
+        }};
+        static constexpr std::array<VkVertexInputAttributeDescription, 1> attributes = {{
+            {0, VERTEX_POSITION_BINDING, VertexLayout<Format>::positionFormat, 0},
+        }};
+    };
+
+    // 管线创建时使用的顶点输入描述
+    struct VertexInputLayout {
+        std::vector<VkVertexInputBindingDescription> bindings;
+        std::vector<VkVertexInputAttributeDescription> attributes;
+
+        template<typename Layout>
+        static VertexInputLayout from() {
+            VertexInputLayout layout;
+            layout.bindings.assign(Layout::bindings.begin(), Layout::bindings.end());
+            layout.attributes.assign(Layout::attributes.begin(), Layout::attributes.end());
+            return layout;
+        }
+
+        template<VertexFormat Format, bool ColorStream = false>
+        static VertexInputLayout of() {
+            return from<VertexLayout<Format, ColorStream>>();
+        }
+
+        static VertexInputLayout of(VertexFormat format, bool colorStream = false) {
+            switch (format) {
+                case VertexFormat::Packed:
+                    return colorStream ? of<VertexFormat::Packed, true>() : of<VertexFormat::Packed, false>();
+                case VertexFormat::PackedHalf:
+                    return colorStream ? of<VertexFormat::PackedHalf, true>() : of<VertexFormat::PackedHalf, false>();
+                default:
+                    return of<VertexFormat::Full>();
+            }
+        }
+
+        static VertexInputLayout depthOnly(VertexFormat format) {
+            switch (format) {
+                case VertexFormat::Packed:
+                    return from<DepthVertexLayout<VertexFormat::Packed>>();
+                case VertexFormat::PackedHalf:
+                    return from<DepthVertexLayout<VertexFormat::PackedHalf>>();
+                default:
+                    return from<DepthVertexLayout<VertexFormat::Full>>();
+            }
+        }
+    };
+
+    // 上传前拆分好的顶点流
+    struct VertexStreams {
+        std::vector<uint8_t> positions;
+        std::vector<uint8_t> attributes;
+        std::vector<VertexColor> colors;    // 只有需要颜色流时非空
+        glm::mat4 dequantize{1.0f};         // 需要乘在模型矩阵右侧的反量化矩阵
+    };
+
+    // 不持有数据的顶点流 指向VertexStreams或者映射的网格缓存 上传时直接从这里拷贝
+    struct VertexStreamData {
+        const void* positions = nullptr;
+        size_t positionBytes = 0;
+        const void* attributes = nullptr;
+        size_t attributeBytes = 0;
+        const VertexColor* colors = nullptr;
+        size_t colorCount = 0;
+        glm::mat4 dequantize{1.0f};
+
+        VertexStreamData() = default;
+
+        VertexStreamData(const VertexStreams& streams)
+                : positions(streams.positions.data()), positionBytes(streams.positions.size()),
+                  attributes(streams.attributes.data()), attributeBytes(streams.attributes.size()),
+                  colors(streams.colors.data()), colorCount(streams.colors.size()), dequantize(streams.dequantize) {}
+    };
+
+    // 把交错的Vertex拆分(并压缩)为各个顶点流
+    class VertexPacker {
+    private:
+        template<typename T>
+        static T* resizeStream(std::vector<uint8_t>& stream, uint32_t vertexCount) {
+            stream.resize(sizeof(T) * vertexCount);
+            return reinterpret_cast<T*>(stream.data());
+        }
+    public:
+        static uint32_t positionStride(VertexFormat format) {
+            return format == VertexFormat::Full ? sizeof(glm::vec3) : sizeof(PackedPosition);
+        }
+
+        static uint32_t attributeStride(VertexFormat format) {
+            return format == VertexFormat::Full ? sizeof(VertexAttributes) : sizeof(PackedAttributes);
+        }
+
+        static void split(const Vertex* vertices, uint32_t vertexCount, VertexFormat format, bool colorStream,
+                          VertexStreams& streams) {
+            glm::vec3 minPos{-1.0f};
+            glm::vec3 maxPos{1.0f};
+            if (format == VertexFormat::Packed && vertexCount > 0) {
+                minPos = vertices[0].pos;
+                maxPos = vertices[0].pos;
+                for (uint32_t i = 1; i < vertexCount; i++) {
+                    minPos = glm::min(minPos, vertices[i].pos);
+                    maxPos = glm::max(maxPos, vertices[i].pos);
+                }
+            }
+            split(vertices, vertexCount, format, colorStream, minPos, maxPos, streams);
+        }
+
+        // 按给定的包围盒量化位置 分块上传时每块都使用整个模型的包围盒
+        static void split(const Vertex* vertices, uint32_t vertexCount, VertexFormat format, bool colorStream,
+                          const glm::vec3& minPos, const glm::vec3& maxPos, VertexStreams& streams) {
+            streams.dequantize = glm::mat4(1.0f);
+            streams.colors.clear();
+
+            if (format == VertexFormat::Full) {
+                auto positions = resizeStream<glm::vec3>(streams.positions, vertexCount);
+                auto attributes = resizeStream<VertexAttributes>(streams.attributes, vertexCount);
+                for (uint32_t i = 0; i < vertexCount; i++) {
+                    positions[i] = vertices[i].pos;
+                    attributes[i] = {vertices[i].normal, vertices[i].color, vertices[i].texCoord};
+                }
+                return;
+            }
+
+            glm::vec3 center{0.0f};
+            glm::vec3 extent{1.0f};
+            if (format == VertexFormat::Packed) {
+                center = (minPos + maxPos) * 0.5f;
+                extent = glm::max((maxPos - minPos) * 0.5f, glm::vec3(1e-6f));
+                // 模型空间坐标 = center + extent * snorm
+                streams.dequantize[0][0] = extent.x;
+                streams.dequantize[1][1] = extent.y;
+                streams.dequantize[2][2] = extent.z;
+                streams.dequantize[3] = glm::vec4(center, 1.0f);
+            }
+
+            auto positions = resizeStream<PackedPosition>(streams.positions, vertexCount);
+            auto attributes = resizeStream<PackedAttributes>(streams.attributes, vertexCount);
+            for (uint32_t i = 0; i < vertexCount; i++) {
+                const Vertex& v = vertices[i];
+                PackedPosition& p = positions[i];
+                PackedAttributes& a = attributes[i];
+                for (int k = 0; k < 3; k++) {
+                    p.pos[k] = format == VertexFormat::Packed ?
+                               glm::packSnorm1x16((v.pos[k] - center[k]) / extent[k]) :
+                               glm::packHalf1x16(v.pos[k]);
+                }
+                p.pos[3] = format == VertexFormat::Packed ? glm::packSnorm1x16(1.0f) : glm::packHalf1x16(1.0f);
+                for (int k = 0; k < 3; k++) {
+                    a.normal[k] = static_cast<int8_t>(glm::packSnorm1x8(v.normal[k]));
+                }
+                a.normal[3] = 0;
+                a.texCoord[0] = glm::packHalf1x16(v.texCoord.x);
+                a.texCoord[1] = glm::packHalf1x16(v.texCoord.y);
+            }
+
+            if (colorStream) {
+                streams.colors.resize(vertexCount);
+                for (uint32_t i = 0; i < vertexCount; i++) {
+                    for (int k = 0; k < 3; k++) {
+                        streams.colors[i].rgba[k] = glm::packUnorm1x8(vertices[i].color[k]);
+                    }
+                    streams.colors[i].rgba[3] = 255;
+                }
+            }
+        }
+    };
+
+}
+
+#endif //VULKANTEST_VERTEXFORMAT_H
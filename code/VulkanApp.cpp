@@ -113,6 +113,10 @@ namespace jk {
         pickPhysicalDevice();
         createLogicalDevice();
 
+        memoryAllocator = std::make_unique<MemoryAllocator>(physicalDevice, device);
+        std::cout << (memoryAllocator->isUnifiedMemory() ? "unified memory: vertex, index and uniform buffers are written directly"
+                                                         : "discrete memory: vertex and index buffers are uploaded through staging") << std::endl;
+
         // 资源池利用相关
         textureManager = std::make_unique<TextureManager>(this, globalResourcePool);
 
@@ -129,6 +133,10 @@ namespace jk {
         commandManager = std::make_unique<CommandManager>(this);
         commandManager->init(commandBuffers);
 
+        uploadBatch = std::make_unique<UploadBatch>(this);
+        stagingRing = std::make_unique<StagingRing>(this);
+        deletionQueue = std::make_unique<DeletionQueue>(this);
+
         globalDescriptorPool = std::make_unique<jk::DescriptorPool>(this, globalResourcePool, 50);
 
         prepareResources();
@@ -159,6 +167,9 @@ namespace jk {
 
         clean();
 
+        // 主循环结束时设备已经空闲
+        deletionQueue->flush();
+
         // 清理
         // textureManager->cleanup();
 
@@ -171,8 +182,14 @@ namespace jk {
 
         globalDescriptorPool->cleanup();
 
+        stagingRing->cleanup();
+        uploadBatch->cleanup();
+
         commandManager->cleanup();
 
+        memoryAllocator->printStats(std::cout);
+        memoryAllocator->cleanup();
+
         vkDestroyDevice(device, nullptr);
 
         if (enableValidationLayers) {
@@ -409,7 +426,8 @@ namespace jk {
         // 获取所有需要的队列族
         std::set<uint32_t> uniqueQueueFamilies = {
                 indices.graphicsFamily.value(),
-                indices.presentFamily.value()
+                indices.presentFamily.value(),
+                indices.transferFamily.value()
         };
 
         // 指定队列族的优先级
@@ -459,6 +477,8 @@ namespace jk {
         // 获取队列族句柄
         vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
         vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+        vkGetDeviceQueue(device, indices.transferFamily.value(), 0, &transferQueue);
+        queueFamilies = indices;
     }
 
     void VulkanApp::createSurface() {
@@ -469,6 +489,9 @@ namespace jk {
     }
 
     void VulkanApp::drawFrame() {
+        // 异步加载完成的模型在录制命令前上传
+        globalBufManager->processPendingUploads();
+
         FrameInfo frame = commandManager->beginFrame(commandBuffers);
 
         // 重置命令缓冲
@@ -504,7 +527,7 @@ namespace jk {
     }
 
     void VulkanApp::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
-                                    VkBuffer &buffer, VkDeviceMemory &bufferMemory) {
+                                    VkBuffer &buffer, MemoryAllocation &bufferMemory, bool concurrent) {
 
         // 设置缓冲信息
         VkBufferCreateInfo bufferInfo{};
@@ -513,29 +536,35 @@ namespace jk {
         bufferInfo.usage = usage;
         bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
+        uint32_t families[] = {queueFamilies.graphicsFamily.value(), queueFamilies.transferFamily.value()};
+        if (concurrent && families[0] != families[1]) {
+            bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+            bufferInfo.queueFamilyIndexCount = 2;
+            bufferInfo.pQueueFamilyIndices = families;
+        }
+
         // 创建缓冲
         if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
             throw std::runtime_error("failed to create buffer!");
         }
 
-        // 获取缓冲内存需求
-        VkMemoryRequirements memRequirements;
-        vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
-
-        // 设置内存信息
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+        // 从分配器的内存块中分配并绑定
+        bufferMemory = memoryAllocator->allocateForBuffer(buffer, properties);
+    }
 
-        // 分配内存
-        if (vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-            throw std::runtime_error("failed to allocate buffer memory!");
-        }
+    VkResult VulkanApp::queueSubmit(VkQueue queue, uint32_t submitCount, const VkSubmitInfo* submits, VkFence fence) {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        return vkQueueSubmit(queue, submitCount, submits, fence);
+    }
 
-        // 绑定内存
-        vkBindBufferMemory(device, buffer, bufferMemory, 0);
+    VkResult VulkanApp::queuePresent(const VkPresentInfoKHR& presentInfo) {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        return vkQueuePresentKHR(presentQueue, &presentInfo);
+    }
 
+    void VulkanApp::queueWaitIdle(VkQueue queue) {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        vkQueueWaitIdle(queue);
     }
 
     uint32_t VulkanApp::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
@@ -552,8 +581,8 @@ namespace jk {
     }
 
     void VulkanApp::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
-        // 复制缓冲
-        commandManager->excuteCommand([&](VkCommandBuffer& commandBuffer) {
+        // 复制缓冲 随上传批次提交
+        uploadBatch->record([&](VkCommandBuffer& commandBuffer) {
             VkBufferCopy copyRegion{};
             copyRegion.size = size;
             vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
@@ -582,7 +611,7 @@ namespace jk {
 
     void VulkanApp::createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling,
                             VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image,
-                            VkDeviceMemory& imageMemory, uint32_t mipLevels, VkSampleCountFlagBits numSamples) {                    
+                            MemoryAllocation& imageMemory, uint32_t mipLevels, VkSampleCountFlagBits numSamples) {                    
 
         VkImageCreateInfo imageInfo{};
         imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -603,21 +632,8 @@ namespace jk {
             throw std::runtime_error("failed to create image!");
         }
 
-        // 分配内存
-        VkMemoryRequirements memRequirements;
-        vkGetImageMemoryRequirements(device, image, &memRequirements);
-
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO; // 类型
-        allocInfo.allocationSize = memRequirements.size; // 分配大小
-        allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties); // 内存类型索引
-
-        if (vkAllocateMemory(device, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
-            throw std::runtime_error("failed to allocate image memory!");
-        }
-
-        // 绑定内存
-        vkBindImageMemory(device, image, imageMemory, 0);
+        // 分配并绑定内存
+        imageMemory = memoryAllocator->allocateForImage(image, properties, tiling == VK_IMAGE_TILING_LINEAR);
     }
 
     // 深度图
@@ -633,7 +649,7 @@ namespace jk {
     void VulkanApp::destroyDepthResource() {
         vkDestroyImageView(device, depthResource.imageView, nullptr);
         vkDestroyImage(device, depthResource.image, nullptr);
-        vkFreeMemory(device, depthResource.imageMemory, nullptr);
+        freeMemory(depthResource.imageMemory);
     }
 
     // 超采样
@@ -649,7 +665,7 @@ namespace jk {
     void VulkanApp::destroyColorResource() {
         vkDestroyImageView(device, colorResource.imageView, nullptr);
         vkDestroyImage(device, colorResource.image, nullptr);
-        vkFreeMemory(device, colorResource.imageMemory, nullptr);
+        freeMemory(colorResource.imageMemory);
     }
 
     VkSampleCountFlagBits VulkanApp::getMaxUsableSampleCount() {
@@ -667,6 +683,12 @@ namespace jk {
         return VK_SAMPLE_COUNT_1_BIT;
     }
 
+    void VulkanApp::publishResources() {
+        globalResourcePool.publish([this](std::shared_ptr<IResource> resource) {
+            deletionQueue->push(resource);
+        });
+    }
+
     ResourceUser::ResourceUser(VulkanApp* app) : app(app), resourceHelper(app->globalResourcePool) {}
 
 }
@@ -36,6 +36,10 @@
 #include "Shader.h"
 #include "Texture.h"
 #include "ResourceHelper.hpp"
+#include "MemoryAllocator.h"
+#include "StagingRing.h"
+#include "UploadBatch.h"
+#include "DeletionQueue.h"
 
 namespace jk {
 
@@ -72,10 +76,18 @@ namespace jk {
         VkDevice device;
         VkQueue graphicsQueue;
 
+        // 所有缓冲与图像的设备内存都从这里分配
+        std::unique_ptr<MemoryAllocator> memoryAllocator;
+
         // surface
         VkSurfaceKHR surface;
         // 显示
         VkQueue presentQueue;
+        // 上传 没有独立的传输队列族时与图形队列相同
+        VkQueue transferQueue;
+        QueueFamilyIndices queueFamilies;
+        // 同一个队列不能同时被多个线程提交
+        std::mutex queueMutex;
 
         // 深度图
         TextureBaseInfo depthResource;
@@ -91,6 +103,13 @@ namespace jk {
         std::unique_ptr<CommandManager> commandManager;
         std::vector<VkCommandBuffer> commandBuffers;
 
+        // 上传共用的暂存缓冲与命令批次
+        std::unique_ptr<StagingRing> stagingRing;
+        std::unique_ptr<UploadBatch> uploadBatch;
+
+        // 运行中销毁的资源等到使用它的帧执行完
+        std::unique_ptr<DeletionQueue> deletionQueue;
+
         // descriptor
         std::unique_ptr<DescriptorPool> globalDescriptorPool;
 
@@ -174,7 +193,13 @@ namespace jk {
         uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
 
         void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
-        void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
+        // concurrent为true时缓冲在图形与传输队列族间共享 不需要转移所有权
+        void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, MemoryAllocation& bufferMemory, bool concurrent = false);
+
+        // 所有队列操作都经过这里加锁
+        VkResult queueSubmit(VkQueue queue, uint32_t submitCount, const VkSubmitInfo* submits, VkFence fence);
+        VkResult queuePresent(const VkPresentInfoKHR& presentInfo);
+        void queueWaitIdle(VkQueue queue);
 
         VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels = 1);
 
@@ -194,7 +219,7 @@ namespace jk {
 
         void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling,
                         VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage &image,
-                        VkDeviceMemory &imageMemory, uint32_t mipLevels = 1, VkSampleCountFlagBits numSamples = VK_SAMPLE_COUNT_1_BIT);
+                        MemoryAllocation &imageMemory, uint32_t mipLevels = 1, VkSampleCountFlagBits numSamples = VK_SAMPLE_COUNT_1_BIT);
 
         inline VkImageView getDepthResource() {
             return depthResource.imageView;
@@ -236,6 +261,25 @@ namespace jk {
             return globalDescriptorPool.get();
         }
 
+        inline MemoryAllocator *getMemoryAllocator() const {
+            return memoryAllocator.get();
+        }
+
+        inline StagingRing *getStagingRing() const {
+            return stagingRing.get();
+        }
+
+        inline UploadBatch *getUploadBatch() const {
+            return uploadBatch.get();
+        }
+
+        inline DeletionQueue *getDeletionQueue() const {
+            return deletionQueue.get();
+        }
+
+        // 并入其他线程登记或移除的全局资源 移除的资源延迟销毁 由beginFrame调用
+        void publishResources();
+
         inline TextureManager *getTextureManager() const {
             return textureManager.get();
         }
@@ -260,6 +304,14 @@ namespace jk {
             return presentQueue;
         }
 
+        inline VkQueue& getTransferQueue() {
+            return transferQueue;
+        }
+
+        inline const QueueFamilyIndices& getQueueFamilies() const {
+            return queueFamilies;
+        }
+
         inline VkPhysicalDevice& getPhysicalDevice() {
             return physicalDevice;
         }
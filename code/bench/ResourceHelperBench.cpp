@@ -0,0 +1,97 @@
+// ResourceHelper的遍历与查找基准 与原先的unordered_map加static_pointer_cast对比
+// 不创建设备 只需要vulkan头文件 用法: resourceHelperBench [iterations]
+
+#include "../ResourceHelper.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <unordered_map>
+
+namespace {
+
+    struct BenchResource : public jk::IResource {
+        uint64_t value = 0;
+        virtual void cleanup(VkDevice& device) {}
+    };
+
+    // 改为slot map之前的存储方式 resID自增 查找与遍历都经过哈希桶
+    struct MapStorage {
+        std::unordered_map<uint32_t, std::shared_ptr<jk::IResource>> resources;
+        uint32_t nextID = 0;
+
+        uint32_t add(std::shared_ptr<jk::IResource> resource) {
+            resources[nextID] = resource;
+            return nextID++;
+        }
+    };
+
+    using Clock = std::chrono::steady_clock;
+
+    template<typename Func>
+    double nanosPerElement(int iterations, size_t count, Func&& func) {
+        auto start = Clock::now();
+        for (int i = 0; i < iterations; i++) {
+            func();
+        }
+        auto end = Clock::now();
+        return std::chrono::duration<double, std::nano>(end - start).count() / iterations / count;
+    }
+
+    void run(size_t count, int iterations) {
+        jk::ResourceHelper helper;
+        MapStorage map;
+        std::vector<uint32_t> helperIDs;
+        std::vector<uint32_t> mapIDs;
+        for (size_t i = 0; i < count; i++) {
+            auto resource = std::make_shared<BenchResource>();
+            resource->value = i;
+            helper.createResource(std::static_pointer_cast<jk::IResource>(resource));
+            helperIDs.push_back(resource->getID());
+            mapIDs.push_back(map.add(resource));
+        }
+        // 查找按打乱后的顺序 两边使用同一个排列
+        std::vector<size_t> order(count);
+        for (size_t i = 0; i < count; i++) {
+            order[i] = i;
+        }
+        std::shuffle(order.begin(), order.end(), std::mt19937(12345));
+
+        // 累加结果并输出 防止循环被优化掉
+        uint64_t sum = 0;
+        double mapIterate = nanosPerElement(iterations, count, [&]() {
+            for (auto& [resID, resource] : map.resources) {
+                sum += std::static_pointer_cast<BenchResource>(resource)->value;
+            }
+        });
+        double helperIterate = nanosPerElement(iterations, count, [&]() {
+            helper.forEach<BenchResource>([&](BenchResource* resource) {
+                sum += resource->value;
+            });
+        });
+        double mapLookup = nanosPerElement(iterations, count, [&]() {
+            for (size_t i : order) {
+                sum += std::static_pointer_cast<BenchResource>(map.resources.find(mapIDs[i])->second)->value;
+            }
+        });
+        double helperLookup = nanosPerElement(iterations, count, [&]() {
+            for (size_t i : order) {
+                sum += static_cast<BenchResource*>(helper.getRawResource(helperIDs[i]))->value;
+            }
+        });
+
+        printf("%7zu resources  iterate: map %6.2f ns  slot map %6.2f ns  lookup: map %6.2f ns  slot map %6.2f ns  (checksum %llu)\n",
+               count, mapIterate, helperIterate, mapLookup, helperLookup, static_cast<unsigned long long>(sum));
+    }
+
+}
+
+int main(int argc, char** argv) {
+    int iterations = argc > 1 ? std::max(1, atoi(argv[1])) : 200;
+    printf("ns per element, %d iterations\n", iterations);
+    run(10000, iterations);
+    run(100000, iterations);
+    return 0;
+}
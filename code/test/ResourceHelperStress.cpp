@@ -0,0 +1,205 @@
+// ResourceHelper跨线程登记与移除的压力测试 配合-fsanitize=thread运行
+// 工作线程创建资源并立即使用返回的resID移除其中一部分 渲染线程同时publish 遍历 查找与销毁
+// 渲染循环至少运行minFrames帧 并一直运行到工作线程全部结束
+// 之后单线程检查代数回绕与槽位上限
+// 用法: resourceHelperStress [threads] [resourcesPerThread] [minFrames]
+
+#include "../ResourceHelper.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+
+    std::atomic<uint32_t> cleanedCount{0};
+
+    struct StressResource : public jk::IResource {
+        uint32_t owner = 0;
+        // 工作线程会移除的资源 渲染线程不销毁它们
+        bool detachedByWorker = false;
+        virtual void cleanup(VkDevice& device) {
+            cleanedCount.fetch_add(1, std::memory_order_relaxed);
+        }
+    };
+
+    bool check(bool condition, const char* message) {
+        if (!condition) {
+            fprintf(stderr, "FAILED: %s\n", message);
+        }
+        return condition;
+    }
+
+    // 同一个槽位反复创建销毁 代数回绕后resID仍然有效 上一代的resID查不到
+    bool checkGenerationWrap(VkDevice& device) {
+        jk::ResourceHelper helper;
+        bool ok = true;
+        uint32_t previous = UINT32_MAX;
+        for (uint32_t i = 0; i < jk::ResourceHelper::GENERATION_MASK * 2 + 2; i++) {
+            uint32_t resID = helper.createResource(std::make_shared<StressResource>())->getID();
+            ok &= (resID & jk::ResourceHelper::INDEX_MASK) == 0;
+            ok &= (resID >> jk::ResourceHelper::INDEX_BITS) == (i & jk::ResourceHelper::GENERATION_MASK);
+            ok &= resID != UINT32_MAX && helper.getRawResource(resID) != nullptr;
+            ok &= previous == UINT32_MAX || helper.getRawResource(previous) == nullptr;
+            helper.destroyResource(resID, device);
+            ok &= helper.getRawResource(resID) == nullptr;
+            previous = resID;
+        }
+        return check(ok, "generation wraparound produced an invalid or stale resID");
+    }
+
+    // 占满所有槽位 最后一个槽位在最大代数时resID也不能等于UINT32_MAX
+    bool checkSlotLimit(VkDevice& device) {
+        jk::ResourceHelper helper;
+        uint32_t last = UINT32_MAX;
+        for (uint32_t i = 0; i < jk::ResourceHelper::MAX_RESOURCES; i++) {
+            last = helper.createResource(std::make_shared<StressResource>())->getID();
+        }
+        bool ok = (last & jk::ResourceHelper::INDEX_MASK) == jk::ResourceHelper::MAX_RESOURCES - 1;
+        bool threw = false;
+        try {
+            helper.createResource(std::make_shared<StressResource>());
+        } catch (const std::runtime_error&) {
+            threw = true;
+        }
+        ok &= check(threw, "creating past the slot limit did not throw");
+        // 把最后一个槽位的代数推到最大
+        for (uint32_t i = 0; i < jk::ResourceHelper::GENERATION_MASK; i++) {
+            helper.destroyResource(last, device);
+            last = helper.createResource(std::make_shared<StressResource>())->getID();
+        }
+        ok &= check((last >> jk::ResourceHelper::INDEX_BITS) == jk::ResourceHelper::GENERATION_MASK &&
+                    last != UINT32_MAX && helper.getRawResource(last) != nullptr,
+                    "the last slot at the last generation collided with the invalid resID");
+        helper.cleanup(device);
+        return ok;
+    }
+
+}
+
+int main(int argc, char** argv) {
+    uint32_t threadCount = argc > 1 ? std::max(1, atoi(argv[1])) : 8;
+    uint32_t perThread = argc > 2 ? std::max(1, atoi(argv[2])) : 20000;
+    uint64_t minFrames = argc > 3 ? std::max(1, atoi(argv[3])) : 500;
+
+    VkDevice device = VK_NULL_HANDLE;
+    // 在主线程构造 主线程即渲染线程
+    jk::ResourceHelper helper;
+
+    std::atomic<uint32_t> running{threadCount};
+    // 渲染循环开始后工作线程才开始 每登记一批等待渲染线程完成一帧 保证登记与移除和遍历在很多帧中重叠
+    std::atomic<uint32_t> ready{0};
+    std::atomic<bool> started{false};
+    std::atomic<uint64_t> renderedFrames{0};
+    std::atomic<bool> invalidID{false};
+    std::vector<std::vector<uint32_t>> createdIDs(threadCount);
+    std::vector<std::thread> workers;
+    for (uint32_t t = 0; t < threadCount; t++) {
+        workers.emplace_back([&, t]() {
+            ready.fetch_add(1, std::memory_order_release);
+            while (!started.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+            for (uint32_t i = 0; i < perThread; i++) {
+                auto resource = std::make_shared<StressResource>();
+                resource->owner = t;
+                resource->detachedByWorker = i % 4 == 0;
+                uint32_t resID = helper.createResource(std::static_pointer_cast<jk::IResource>(resource))->getID();
+                if (resID == UINT32_MAX) {
+                    invalidID.store(true, std::memory_order_relaxed);
+                }
+                createdIDs[t].push_back(resID);
+                // 返回的resID立即可用 同一批publish中先登记后移除
+                if (i % 4 == 0) {
+                    helper.detachResource(resID);
+                }
+                if (i % 64 == 63) {
+                    uint64_t seen = renderedFrames.load(std::memory_order_acquire);
+                    while (renderedFrames.load(std::memory_order_acquire) == seen) {
+                        std::this_thread::yield();
+                    }
+                }
+            }
+            running.fetch_sub(1, std::memory_order_release);
+        });
+    }
+
+    uint64_t retired = 0;
+    uint64_t destroyedOnRender = 0;
+    uint64_t frames = 0;
+    bool consistent = true;
+    auto retire = [&](std::shared_ptr<jk::IResource> resource) {
+        if (resource != nullptr) {
+            resource->cleanup(device);
+            retired++;
+        }
+    };
+    while (ready.load(std::memory_order_acquire) < threadCount) {
+        std::this_thread::yield();
+    }
+    started.store(true, std::memory_order_release);
+    while (frames < minFrames || running.load(std::memory_order_acquire) > 0) {
+        helper.publish(retire);
+        // 遍历与查找必须得到同一个对象 工作线程此时仍在登记与移除
+        uint32_t visited = 0;
+        uint32_t victim = UINT32_MAX;
+        helper.forEach<StressResource>([&](StressResource* resource) {
+            consistent &= helper.getRawResource(resource->getID()) == resource;
+            if (!resource->detachedByWorker) {
+                victim = resource->getID();
+            }
+            visited++;
+        });
+        consistent &= visited == helper.size();
+        // 渲染线程自己也销毁一部分 槽位复用时代数加一
+        if (frames % 3 == 0 && victim != UINT32_MAX) {
+            uint32_t resID = victim;
+            helper.destroyResource(resID, device);
+            consistent &= helper.getRawResource(resID) == nullptr;
+            destroyedOnRender++;
+        }
+        frames++;
+        renderedFrames.store(frames, std::memory_order_release);
+        // 相当于等待呈现 核数少时也让工作线程有机会运行
+        std::this_thread::yield();
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    helper.publish(retire);
+
+    bool ok = check(!invalidID.load(), "worker received an invalid resID");
+    ok &= check(consistent, "lookup disagreed with iteration");
+
+    std::vector<uint32_t> allIDs;
+    for (auto& ids : createdIDs) {
+        allIDs.insert(allIDs.end(), ids.begin(), ids.end());
+    }
+    std::sort(allIDs.begin(), allIDs.end());
+    ok &= check(std::adjacent_find(allIDs.begin(), allIDs.end()) == allIDs.end(), "two workers received the same resID");
+
+    uint64_t total = static_cast<uint64_t>(threadCount) * perThread;
+    uint64_t detachedByWorkers = static_cast<uint64_t>(threadCount) * ((perThread + 3) / 4);
+    ok &= check(retired == detachedByWorkers, "worker detaches were not all retired");
+    ok &= check(helper.size() + retired + destroyedOnRender == total, "resources were lost or duplicated");
+
+    // 尚未并入的登记由cleanup处理
+    std::thread late([&]() {
+        helper.createResource(std::make_shared<StressResource>());
+    });
+    late.join();
+    uint32_t before = cleanedCount.load();
+    size_t live = helper.size();
+    helper.cleanup(device);
+    ok &= check(cleanedCount.load() - before == live + 1, "cleanup missed pending resources");
+    ok &= check(helper.size() == 0, "cleanup left resources behind");
+    ok &= check(frames >= minFrames, "render loop stopped early");
+
+    ok &= checkGenerationWrap(device);
+    ok &= checkSlotLimit(device);
+
+    printf("%s: %u threads x %u resources, %llu frames, %llu retired, %llu destroyed on the render thread\n",
+           ok ? "ok" : "FAILED", threadCount, perThread, static_cast<unsigned long long>(frames),
+           static_cast<unsigned long long>(retired), static_cast<unsigned long long>(destroyedOnRender));
+    return ok ? 0 : 1;
+}
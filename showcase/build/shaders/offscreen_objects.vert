@@ -0,0 +1,41 @@
+#version 450
+
+layout (location = 0) in vec3 inPosition;
+
+layout (set = 0, binding = 0) uniform UBO 
+{
+	mat4 depthVP;
+} ubo;
+
+out gl_PerVertex 
+{
+    vec4 gl_Position;   
+};
+
+struct ObjectData {
+    mat4 model;
+    mat4 normal;
+    vec3 color;
+    vec3 ambient;
+    vec3 diffuse;
+    vec4 specular;
+    int args;
+    int materialIndex;
+};
+
+// 与ObjectBuffer中的PushData一致 下标由push constant给出
+layout(std430, set = 1, binding = 0) readonly buffer ObjectBuffer {
+    ObjectData objects[];
+};
+
+layout(push_constant) uniform Push {
+    uint objectIndex;
+} object;
+
+#define push objects[object.objectIndex]
+ 
+void main()
+{
+	vec4 positionWorld = push.model * vec4(inPosition, 1.0);
+	gl_Position =  ubo.depthVP * positionWorld;
+}
\ No newline at end of file
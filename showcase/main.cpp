@@ -33,20 +33,29 @@ private:
     std::shared_ptr<jk::RenderBatchManager> renderBatchManager;
     std::shared_ptr<jk::RenderBatch> batchShadow;
 
+    // 全局ubo 只有变化的字段会被标记 静态帧不做拷贝
     std::shared_ptr<jk::UniformBuffer> globalBuf;
-    std::shared_ptr<jk::UniformBuffer> offscreenBuf;
-
-    std::shared_ptr<jk::DescriptorSets> depthMVPDescriptor;
+    // 阴影pass的depthVP随平行光每帧变化 从中分配 使用动态uniform描述符集
+    std::shared_ptr<jk::FrameAllocator> frameAllocator;
+    std::shared_ptr<jk::DescriptorSets> depthVPDescriptor;
     std::shared_ptr<jk::DescriptorSets> shadowMapDescriptor;
 
+    // 每帧的物体数据 两个pass共用 着色器按push constant中的下标读取
+    std::shared_ptr<jk::ObjectBuffer> objectBuf;
+    // 去重后的材质表 与物体数据放在同一个描述符集中
+    std::shared_ptr<jk::MaterialLibrary> materialLib;
+    std::shared_ptr<jk::DescriptorSets> objectDescriptor;
+
     glm::mat4 depthProjectionMatrix{glm::ortho(-10.0f, 10.0f, -10.0f, 10.0f, 1.0f, 100.0f)};
     jk::DepthVP depthVP{};
-    jk::GlobalBufferObject ubo{};
     // pos dir color
     jk::DirectionalLight directionalLight{glm::vec3(0.0f, 40.0f, 0.0f),
                                         glm::normalize(glm::vec3(-1.0f, 0.0f, 0.0f)), glm::vec4(1.0f, 1.0f, 1.0f, 0.8f)};
     jk::PointLight pointLights[4];
 
+    // 阴影pass允许更大的LOD误差 只影响阴影轮廓
+    float shadowLodBias = 4.0f;
+
     // 调试用
     bool enableShadow = true;
     bool enableLights[2]{true, true};
@@ -107,6 +116,15 @@ public:
             case GLFW_KEY_G:
                 enableERev = !enableERev;
                 break;
+            // 打印排序前后的状态切换次数
+            case GLFW_KEY_O: {
+                auto& stats = renderBatchManager->getDrawOrderStats();
+                std::cout << "draws: " << stats.drawCount
+                          << " descriptor sets: " << stats.unsorted.descriptorSets << " -> " << stats.sorted.descriptorSets
+                          << " materials: " << stats.unsorted.materials << " -> " << stats.sorted.materials
+                          << " meshes: " << stats.unsorted.meshes << " -> " << stats.sorted.meshes << std::endl;
+                break;
+            }
         }
     }
 
@@ -118,29 +136,59 @@ public:
 
         auto uniformBinding = camera->getViewLayoutBinding();
         auto imageBinding = jk::DescriptorSetLayout::imageDescriptorLayoutBinding(0);
-        // 创建两个layout
+        // 创建layout 主场景依次为ubo 纹理 阴影贴图
         globalDescriptorPool->fillLayoutsByBindings(layouts, {uniformBinding, imageBinding, imageBinding});
+        // 物体数据与材质表 binding 0与1
+        VkDescriptorSetLayoutBinding objectBindings[] = {jk::DescriptorSetLayout::storageDescriptorLayoutBinding(0),
+                                                         jk::DescriptorSetLayout::storageDescriptorLayoutBinding(1)};
+        VkDescriptorSetLayoutCreateInfo objectLayoutInfo{};
+        objectLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        objectLayoutInfo.bindingCount = 2;
+        objectLayoutInfo.pBindings = objectBindings;
+        layouts.push_back(globalDescriptorPool->createDescriptorSetLayout(objectLayoutInfo)->getDescriptorSetLayout());
         globalBuf = camera->initDescriptorSets(*globalDescriptorPool, layouts[0]);
-
+        // 阴影pass的set 0 动态uniform 每帧只分配一次depthVP
+        VkDescriptorSetLayoutBinding depthVPBinding = jk::DescriptorSetLayout::uniformDynamicDescriptorLayoutBinding(0);
+        VkDescriptorSetLayoutCreateInfo depthVPLayoutInfo{};
+        depthVPLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        depthVPLayoutInfo.bindingCount = 1;
+        depthVPLayoutInfo.pBindings = &depthVPBinding;
+        VkDescriptorSetLayout depthVPLayout = globalDescriptorPool->createDescriptorSetLayout(depthVPLayoutInfo)->getDescriptorSetLayout();
+        frameAllocator = globalBufManager->createFrameAllocator(sizeof(jk::DepthVP), 4 * 1024);
+        depthVPDescriptor = globalDescriptorPool->createDescriptorSets();
+        depthVPDescriptor->init(depthVPLayout);
+        frameAllocator->fillUniformDescriptorSets(depthVPDescriptor, 0);
+
+        // 压缩顶点 管线的顶点输入跟随缓冲管理器的格式
+        globalBufManager->setVertexFormat(jk::VertexFormat::Packed);
+
+        // 物体数据在storage buffer中 push constant只有一个下标
         VkPushConstantRange pushConstantRange{};
-        shader = shaderManager->createShader("shaders/vert.spv", "shaders/frag.spv",
+        shader = shaderManager->createShader("shaders/objects_vert.spv", "shaders/objects_frag.spv",
                                              layouts.data(), layouts.size(),
-                                             jk::MeshObject::getPushConstantInfo(pushConstantRange));
+                                             jk::ObjectBuffer::getPushConstantInfo(pushConstantRange));
         // 使用对应的renderprocess进行最后的pipeline创建
-        renderProcess->createGraphicsPipeline(*shader);
+        renderProcess->createGraphicsPipeline(*shader, globalBufManager->getVertexInputLayout());
         renderProcess->setClearColor({0.1f, 0.1f, 1.0f, 1.0f});
 
         // 准备offscreen部分做shadow mapping
-        // 不需要片元着色器
-        offscreenShader = shaderManager->createShader("shaders/offscreen.spv", "",
-                                                      layouts.data(), 1,
-                                                      jk::MeshObject::getPushConstantInfo(pushConstantRange));
+        // 不需要片元着色器 物体数据在set 1
+        VkDescriptorSetLayout offscreenLayouts[] = {depthVPLayout, layouts[3]};
+        offscreenShader = shaderManager->createShader("shaders/offscreen_objects.spv", "",
+                                                      offscreenLayouts, 2,
+                                                      jk::ObjectBuffer::getPushConstantInfo(pushConstantRange));
 
         // renderprocess这一块因为最初只有单个renderpass 设计得也不好 没时间改了已经 
         // 暂时用继承抽象基类的方式解决
         offscreenRenderProcess = std::make_unique<jk::OffscreenRenderProcess>(this);
         offscreenRenderProcess->init();
-        offscreenRenderProcess->createGraphicsPipeline(*offscreenShader);
+        offscreenRenderProcess->createGraphicsPipeline(*offscreenShader, globalBufManager->getDepthVertexInputLayout());
+
+        // 尽早提交obj解析 与下面的纹理加载并行
+        auto vikingRoomModel = jk::SimpleObj::loadAsync(*globalBufManager, "viking_room.obj");
+        auto smoothVaseModel = jk::SimpleObj::loadAsync(*globalBufManager, "smooth_vase.obj");
+        auto teapotModel = jk::SimpleObj::loadAsync(*globalBufManager, "teapot.obj");
+        auto lampModel = jk::SimpleObj::loadAsync(*globalBufManager, "lamp.obj");
 
         /////////////////////////// 其它资源初始化 ///////////////////////////
         std::vector<std::shared_ptr<jk::DescriptorSets>> d;
@@ -162,6 +210,13 @@ public:
         // shadowmap descriptor
         shadowMapDescriptor = globalDescriptorPool->createDescriptorSets();
         shadowMapDescriptor->init(layouts[2]);
+        // 物体数据 记录与PushData一致
+        objectBuf = globalBufManager->createObjectBuffer(sizeof(jk::PushData));
+        objectDescriptor = globalDescriptorPool->createDescriptorSets();
+        objectDescriptor->init(layouts[3]);
+        objectBuf->fillStorageDescriptorSets(objectDescriptor, 0);
+        materialLib = globalBufManager->createMaterialLibrary();
+        materialLib->fillStorageDescriptorSets(objectDescriptor, 1);
 
         // 准备创建渲染批处理
         // 将一类具有相同资源描述的渲染对象放在同一个渲染批处理中
@@ -176,22 +231,25 @@ public:
             auto &des = batches[i]->getDescriptorSets();
             des.push_back(d[i]);
             des.push_back(shadowMapDescriptor);
+            des.push_back(objectDescriptor);
             batches[i]->updateDescriptorSets();
         }
 
         // 加入渲染对象
 
-        // 模型加载
-        auto myBuf = jk::SimpleObj::load(*globalBufManager, "viking_room.obj");
-        auto myBuf2 = jk::SimpleObj::load(*globalBufManager, "smooth_vase.obj");
+        // 模型加载 obj加载完成前先用立方体占位
         auto cubeBuf = globalBufManager->genCube();
         auto planeBuf = globalBufManager->genDoublePlane();
         auto sphereBuf = globalBufManager->genSphere();
-        myObj = std::make_shared<jk::MeshObject>(myBuf);
-        myObj2 = std::make_shared<jk::MeshObject>(myBuf2);
-        myObj3 = std::make_shared<jk::MeshObject>(jk::SimpleObj::load(*globalBufManager, "teapot.obj"));
+        myObj = std::make_shared<jk::MeshObject>(cubeBuf);
+        myObj->setModelBuffer(vikingRoomModel);
+        myObj2 = std::make_shared<jk::MeshObject>(cubeBuf);
+        myObj2->setModelBuffer(smoothVaseModel);
+        myObj3 = std::make_shared<jk::MeshObject>(cubeBuf);
+        myObj3->setModelBuffer(teapotModel);
         cube = std::make_shared<jk::MeshObject>(cubeBuf);
-        lightSign = std::make_shared<jk::MeshObject>(jk::SimpleObj::load(*globalBufManager, "lamp.obj"));
+        lightSign = std::make_shared<jk::MeshObject>(cubeBuf);
+        lightSign->setModelBuffer(lampModel);
         plane = std::make_shared<jk::MeshObject>(planeBuf);
         plane2 = std::make_shared<jk::MeshObject>(planeBuf);
         earth = std::make_shared<jk::MeshObject>(sphereBuf);
@@ -208,15 +266,12 @@ public:
         renderBatchManager->addRenderObject(sun, batches[6]);
 
         // offscreen部分
-        offscreenBuf = globalBufManager->createUniformBuffer(sizeof(jk::DepthVP));
-        depthMVPDescriptor = globalDescriptorPool->createDescriptorSets();
-        depthMVPDescriptor->init(layouts[0]);
-        offscreenBuf->fillUniformDescriptorSets(depthMVPDescriptor, 0);
         offscreenRenderProcess->fillImageDescriptorSets(shadowMapDescriptor, 0);
 
         // 加入阴影渲染对象
         batchShadow = renderBatchManager->createRenderBatch(0); // 这个0也挺不严谨的 一般不会跟其它batch的ID冲突 因为是自增ID
-        batchShadow->setGlobalDescriptorSet(depthMVPDescriptor);
+        batchShadow->setGlobalDescriptorSet(depthVPDescriptor, true);
+        batchShadow->getDescriptorSets().push_back(objectDescriptor);
         batchShadow->updateDescriptorSets();
 
         batchShadow->addRenderObject(myObj);
@@ -358,15 +413,32 @@ public:
     }
 
     void renderFrame(jk::FrameInfo& frame) override {
+        // 两个pass绘制之前启用 物体在本帧第一次绘制时写入记录并登记材质
+        // 每个物体至少一条记录 按已并入的物体数预先扩容 避免缓冲已满时少画一帧
+        objectBuf->begin(frame, renderBatchManager->getRenderObjectCount());
+        materialLib->begin(frame);
+
+        // 只拷贝当前帧槽位落后的字段 相机与灯光都没有变化时什么都不做
+        globalBuf->update(frame.currentFrame);
+
+        // LOD按主相机选择
+        frame.lodView = camera->getLodView(static_cast<float>(getSwapChain()->getExtent().height));
+
         // first pass
         offscreenRenderProcess->beginRenderPass(frame);
         if (enableShadow) {
+            frame.lodView.bias = shadowLodBias;
+            // endFrame提交前flush
+            frameAllocator->begin(frame);
+            frame.globalOffset = frameAllocator->push(depthVP);
             offscreenShader->bind(frame.commandBuffer);
             batchShadow->drawBatch(*commandManager, *offscreenShader, frame);
+            frame.lodView.bias = 1.0f;
         }
         offscreenRenderProcess->endRenderPass(frame);
 
-        // second pass
+        // second pass 主相机视锥与背面剔除
+        frame.cullView = camera->getCullView();
         renderProcess->beginRenderPass(frame);
         renderBatchManager->drawBatches(frame);
         renderProcess->endRenderPass(frame);
@@ -469,18 +541,15 @@ public:
                                                 glm::vec3(0.0f), // 目标点通常设置为原点或场景中心
                                                 glm::vec3(0.0, 1.0, 0.0)); // 上方向通常保持不变
         depthVP.depthVP = depthProjectionMatrix * depthViewMatrix;
-        offscreenBuf->updateUniformBuffer(frame.currentFrame, &depthVP);
-
-        // 更新主场景的uniform buffer
-        ubo.proj = camera->getProjection();
-        ubo.view = camera->getView();
-        ubo.depthVP = depthVP.depthVP;
-        ubo.directionalLightDirection = directionalLight.direction;
-        ubo.directionalLightColor = directionalLight.color;
+
+        // 更新主场景的uniform buffer view与proj由camera->update写入
+        // 只有变化的字段会被标记 renderFrame中的update只拷贝当前帧落后的部分
+        globalBuf->write(offsetof(jk::GlobalBufferObject, depthVP), depthVP.depthVP);
+        globalBuf->write(offsetof(jk::GlobalBufferObject, directionalLightDirection), directionalLight.direction);
+        globalBuf->write(offsetof(jk::GlobalBufferObject, directionalLightColor), directionalLight.color);
         // ubo.pointLights[0] = lightObject->getPointLight();
-        ubo.lightNum = 3;
-        memcpy(ubo.pointLights, pointLights, sizeof(jk::PointLight) * 3);
-        globalBuf->updateUniformBuffer(frame.currentFrame, &ubo);
+        globalBuf->write(offsetof(jk::GlobalBufferObject, lightNum), 3);
+        globalBuf->write(offsetof(jk::GlobalBufferObject, pointLights), pointLights, sizeof(jk::PointLight) * 3);
     }
 
     void clean() override {